@@ -0,0 +1,88 @@
+// Copyright (c) 2020-present, Adriano Lange.  All rights reserved.
+// This source code is licensed under both the GPLv2 (found in the
+// LICENSE.GPLv2 file in the root directory) and Apache 2.0 License
+// (found in the LICENSE.Apache file in the root directory).
+
+#pragma once
+
+#include "alutils/random.h"
+
+#include <memory>
+#include <atomic>
+#include <cstdint>
+
+namespace alutils {
+
+////////////////////////////////////////////////////////////////////////////////////
+#undef __CLASS__
+#define __CLASS__ "ArrivalProcess::"
+
+typedef enum {
+	ARRIVAL_EXPONENTIAL, // Poisson process
+	ARRIVAL_UNIFORM,     // gaps uniform in [0, 2/rate]
+	ARRIVAL_MMPP         // 2-state Markov-modulated Poisson process (bursts)
+} arrival_t;
+
+// Parameters of ARRIVAL_MMPP. The process alternates between a normal and
+// a burst state, both with exponential durations. The burst rate is
+// burst_factor times the normal rate, and the mean rate is the target rate.
+struct MMPPParams {
+	double burst_factor   = 10;    // burst rate / normal rate
+	double burst_fraction = 0.1;   // fraction of the time in bursts
+	double burst_duration = 0.01;  // mean duration of a burst (s)
+};
+
+// Open-loop arrivals: the schedule of deadlines does not depend on the time
+// spent serving the requests. Late requests are not skipped, so the caller
+// can measure latencies from the deadlines (avoiding coordinated omission).
+// Each instance is used by one thread; setRate() can be called from any
+// thread and takes effect on the next gap.
+class ArrivalProcess {
+	arrival_t             type;
+	std::atomic<double>   rate;   // mean arrivals per second
+	MMPPParams            mmpp;
+	bool                  burst = true;    // switched to normal on the first gap
+	double                state_left = 0;  // time left in the MMPP state (s)
+	uint64_t              deadline = 0;    // next arrival (CLOCK_MONOTONIC ns)
+	uint64_t              spin_ns;
+	std::unique_ptr<RandEngine> rand_engine;
+
+	double nextGapSeconds();
+
+	public:
+	// spin_ns: the final part of each wait is spent polling the clock.
+	ArrivalProcess(double rate, arrival_t type=ARRIVAL_EXPONENTIAL, MMPPParams mmpp=MMPPParams(),
+	               uint64_t spin_ns=100000, RandEngine::type_t engine_type=default_rand_engine_type);
+
+	static uint64_t now(); // CLOCK_MONOTONIC ns
+
+	// Sets the timer slack of the calling thread (Linux, PR_SET_TIMERSLACK).
+	// The default slack (50 us) can delay the wake up of wait() beyond
+	// spin_ns, so threads that need precise arrivals call this once with a
+	// small value before waiting. It affects every timed sleep of the thread;
+	// 0 restores the thread's default.
+	static void setTimerSlack(uint64_t slack_ns=1);
+
+	void     setRate(double rate);
+	double   getRate();
+	void     start(uint64_t start_ns=now()); // first deadline = start_ns + gap
+	// Draws a gap (ns) without moving the deadline. The draw is not a peek:
+	// it consumes the random engine and, with MMPP, advances the state (time
+	// left, burst switches) as if the gap had elapsed, so it changes the gaps
+	// of the following nextDeadline() calls.
+	uint64_t nextGap();
+	uint64_t nextDeadline();                 // advances the schedule
+	void     next_batch(uint64_t* deadlines, size_t count);
+
+	// Advances the schedule and waits for the deadline: clock_nanosleep until
+	// spin_ns before it, then spinning. Returns the lateness (ns) of the
+	// return in relation to the deadline, or of the deadline itself when it
+	// had already passed.
+	int64_t  wait(uint64_t* deadline=nullptr);
+};
+
+////////////////////////////////////////////////////////////////////////////////////
+#undef __CLASS__
+#define __CLASS__ ""
+
+} // namespace alutils
@@ -9,6 +9,7 @@
 #include <vector>
 #include <memory>
 #include <functional>
+#include <chrono>
 
 #include "alutils/process.h"
 
@@ -52,9 +53,11 @@ typedef CmdTemplate<std::string> CmdString;
 
 ////////////////////////////////////////////////////////////////////////////////////
 
+// [<time>:]<command>, where time is a duration relative to the script start
+// (see parseDuration; no unit: seconds), e.g. "1.5s:cmd=1" or "250ms:cmd=2"
 struct ScriptCommand {
-	uint64_t    time = 0;
-	std::string command;
+	std::chrono::nanoseconds time{0};
+	std::string              command;
 
 	ScriptCommand(const std::string& str);
 };
@@ -66,7 +69,7 @@ class Commands {
 
 	// script variables
 	std::string                           script_delimiter = ";";
-	std::chrono::system_clock::time_point time_ini;
+	std::chrono::steady_clock::time_point time_ini;
 	std::vector<ScriptCommand>            parsed_script;
 	std::unique_ptr<ThreadController>     script_thread;
 
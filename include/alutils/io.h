@@ -38,6 +38,34 @@ struct Poll {
 	static const short error_events = POLLERR   | POLLNVAL;
 };
 
+////////////////////////////////////////////////////////////////////////////////////
+#undef __CLASS__
+#define __CLASS__ "MMapFile::"
+
+// Read-only memory mapping of a whole file, unmapped by the destructor.
+struct MMapFile {
+	MMapFile(const std::string& filename, bool populate=false);
+	~MMapFile();
+	MMapFile(const MMapFile&) = delete;
+	MMapFile& operator=(const MMapFile&) = delete;
+
+	const void* data() const { return addr; }
+	size_t      size() const { return length; }
+
+	template <typename T>
+	const T*    data() const { return static_cast<const T*>(addr); }
+	template <typename T>
+	size_t      count() const { return length / sizeof(T); }
+
+	void adviseSequential();
+	void adviseRandom();
+
+	private:
+	std::string filename;
+	void*       addr   = nullptr;
+	size_t      length = 0;
+};
+
 ////////////////////////////////////////////////////////////////////////////////////
 #undef __CLASS__
 #define __CLASS__ ""
@@ -0,0 +1,67 @@
+// Copyright (c) 2020-present, Adriano Lange.  All rights reserved.
+// This source code is licensed under both the GPLv2 (found in the
+// LICENSE.GPLv2 file in the root directory) and Apache 2.0 License
+// (found in the LICENSE.Apache file in the root directory).
+
+#pragma once
+
+#include "alutils/random.h"
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <cstdint>
+
+namespace alutils {
+
+////////////////////////////////////////////////////////////////////////////////////
+#undef __CLASS__
+#define __CLASS__ "PayloadGenerator::"
+
+typedef enum {
+	SIZE_FIXED,    // max_size
+	SIZE_UNIFORM,  // uniform in [min_size, max_size]
+	SIZE_ZIPF      // min_size + Zipf rank - 1: small values are the most frequent
+} payload_size_t;
+
+// Values for storage benchmarks, based on RandomGenerator of RocksDB's
+// db_bench. A pool of compressible data is built once: each 100-byte segment
+// repeats compression_ratio*100 random printable bytes, so the data
+// compresses to about compression_ratio of its size. Values are views of
+// the pool at random offsets, no data is copied (the pool lives as long as
+// the generator). Thread safety follows the distributions: one RandEngine
+// per thread, or the per-thread default engines when rand_engine=nullptr.
+class PayloadGenerator {
+	payload_size_t size_type;
+	size_t         min_size;
+	size_t         max_size;
+	double         compression_ratio;
+	std::string    pool;
+	std::unique_ptr<RejectionInversionZipfDistribution<int64_t>> zipf; // SIZE_ZIPF only
+
+	ThreadEngines default_rand_engines;
+
+	std::string_view view(size_t size, RandEngine* rand_engine);
+
+	public:
+	// pool_size=0: 1 MiB or 2*max_size, whichever is larger
+	PayloadGenerator(payload_size_t size_type, size_t min_size, size_t max_size,
+	                 double compression_ratio=0.5, double theta=0.99, size_t pool_size=0);
+	PayloadGenerator(size_t size, double compression_ratio=0.5);
+
+	size_t nextSize(RandEngine* rand_engine=nullptr);
+	std::string_view next(RandEngine* rand_engine=nullptr);              // value of nextSize() bytes
+	std::string_view next(size_t size, RandEngine* rand_engine=nullptr); // size <= max_size
+	void next_batch(std::string_view* out, size_t count, RandEngine* rand_engine=nullptr);
+	size_t fill(char* buffer, size_t size, RandEngine* rand_engine=nullptr); // copies size bytes, any size
+	std::unique_ptr<RandEngine> newEngine(RandEngine::type_t type=default_rand_engine_type); // use one engine per thread
+
+	const std::string& getPool() const { return pool; }
+	size_t getMaxSize() const { return max_size; }
+};
+
+////////////////////////////////////////////////////////////////////////////////////
+#undef __CLASS__
+#define __CLASS__ ""
+
+} // namespace alutils
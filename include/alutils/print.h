@@ -6,6 +6,10 @@
 #pragma once
 
 #include <functional>
+#include <cstdarg>
+#include <cstddef>
+#include <string>
+#include <string_view>
 
 namespace alutils {
 
@@ -21,7 +25,7 @@ typedef enum {
 
 extern log_level_t log_level;
 
-void default_print_none(const char* format, ...);
+void default_print_none(const char* format, ...) __attribute__((format(printf, 1, 2)));
 
 typedef decltype(default_print_none) print_type;
 
@@ -33,10 +37,34 @@ extern print_type* print_warn;
 extern print_type* print_error;
 extern print_type* print_critical;
 
+// Message of ALUTILS_PRINT_WRAPPER, formatted into a thread-local buffer that
+// is kept between the calls, so printing does not allocate memory once the
+// buffer has grown. Nested messages (printing from a print function) use
+// their own buffers. It converts to std::string_view (no copy) and to
+// std::string (a copy), so wrappers written for the former std::string msg
+// keep working; the message is valid only during the wrapped call.
+class PrintMessage {
+	const char* data;
+	size_t      length;
+
+	public:
+	PrintMessage(const char* format, va_list args);
+	~PrintMessage();
+	PrintMessage(const PrintMessage&) = delete;
+	PrintMessage& operator=(const PrintMessage&) = delete;
+
+	const char* c_str() const { return data; }
+	size_t      size() const { return length; }
+	std::string str() const { return std::string(data, length); }
+
+	operator std::string_view() const { return std::string_view(data, length); }
+	operator std::string() const { return str(); }
+};
+
 #define ALUTILS_PRINT_WRAPPER(name, function) \
 void name(const char* format, ...) {         \
 	va_list args; va_start(args, format);    \
-	std::string msg = vsprintf(format, args);  \
+	alutils::PrintMessage msg(format, args); \
 	function;                                \
 	va_end(args);                            \
 }
@@ -8,12 +8,197 @@
 #include <memory>
 #include <vector>
 #include <random>
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <variant>
+#include <unordered_map>
+#include <algorithm>
+
+#include <stdio.h>
 
 namespace alutils {
 
 ////////////////////////////////////////////////////////////////////////////////////
 
-class RandEngine {};
+// Per-thread random number engine. Instances are created by newRandEngine()
+// or by the newEngine() method of the distributions, and can be shared among
+// all distributions used by the same thread.
+class RandEngine {
+	public:
+	enum type_t {
+		tXoshiro256ss, // xoshiro256** (32 bytes of state), default
+		tPCG64,        // PCG XSL-RR 128/64 (32 bytes of state)
+		tSplitMix64,   // splitmix64 (8 bytes of state)
+		tMT19937_64,   // std::mt19937_64 (2.5 KB of state), for compatibility
+		tPhilox4x32    // Philox4x32-10, counter-based (see newCounterRandEngine())
+	};
+	virtual ~RandEngine();
+};
+
+// engine type used by the distributions' default engines and by newEngine()
+extern RandEngine::type_t default_rand_engine_type;
+
+// Seeding: every engine takes one stream of the master seed, in O(1) for any
+// stream. PCG64 uses the stream as its sequence selector and Philox as its
+// substream (see below), so their streams never overlap. xoshiro256**,
+// splitmix64 and mt19937_64 hash the stream into their seeds: distinct
+// streams start at distinct states, and for xoshiro256** (period 2^256 - 1)
+// an overlap of two streams is negligibly unlikely, not excluded. Engines
+// created without an explicit stream take streams 0, 1, 2, ... in creation
+// order (including the distributions' default engines). Fixing the master seed before creating the engines makes
+// the whole run reproducible. If setRandSeed() is never called, the master
+// seed comes from std::random_device.
+void     setRandSeed(uint64_t seed); // also restarts the stream counter
+uint64_t getRandSeed();
+
+std::unique_ptr<RandEngine> newRandEngine(RandEngine::type_t type=default_rand_engine_type);                  // next stream
+std::unique_ptr<RandEngine> newRandEngine(uint64_t stream, RandEngine::type_t type=default_rand_engine_type); // given stream
+
+// Raw 64-bit outputs of an engine, for samplers built outside this file
+uint64_t randUint64(RandEngine* rand_engine);
+void     randUint64(RandEngine* rand_engine, uint64_t* out, size_t count);
+
+// Counter-based engine (tPhilox4x32) with its own seed, independent of the
+// master seed. Output j of a substream depends only on (seed, substream, j),
+// and seekRandEngine() moves to the beginning of any substream in O(1), so
+// independent processes can reproduce any part of a random sequence without
+// generating what comes before it.
+std::unique_ptr<RandEngine> newCounterRandEngine(uint64_t seed, uint64_t substream=0);
+void seekRandEngine(RandEngine* rand_engine, uint64_t substream); // throws std::invalid_argument if not tPhilox4x32
+
+////////////////////////////////////////////////////////////////////////////////////
+
+uint64_t newPerThreadId(); // unique, never reused
+
+// One object of an instance per thread (engines, cursors, shards), created on
+// the first use in each thread and owned by the instance. Each thread caches
+// its objects in a thread_local map that holds only weak references to the
+// instances: entries of destroyed instances are swept when the map grows,
+// and the objects of a thread are released when it exits, unless
+// keep_on_thread_exit (e.g., shards with data still reported).
+template <typename V>
+class PerThread {
+	struct State {
+		std::mutex                      mutex;
+		std::vector<std::unique_ptr<V>> objects;
+		bool                            keep_on_thread_exit;
+	};
+
+	struct Cache {
+		struct Entry {
+			std::weak_ptr<State> state;
+			V*                   object;
+		};
+		uint64_t                            last_id = 0;
+		V*                                  last = nullptr;
+		std::unordered_map<uint64_t, Entry> map;
+		size_t                              sweep_size = 16;
+
+		~Cache() { // thread exit
+			for (auto& i : map) {
+				auto state = i.second.state.lock();
+				if (!state || state->keep_on_thread_exit) continue;
+				std::lock_guard<std::mutex> lock(state->mutex);
+				auto& objects = state->objects;
+				for (auto o = objects.begin(); o != objects.end(); o++) {
+					if (o->get() == i.second.object) {
+						objects.erase(o);
+						break;
+					}
+				}
+			}
+		}
+
+		void sweep() {
+			for (auto i = map.begin(); i != map.end(); ) {
+				if (i->second.state.expired())
+					i = map.erase(i);
+				else
+					i++;
+			}
+			sweep_size = std::max<size_t>(16, map.size() * 2);
+		}
+	};
+
+	uint64_t               id;
+	std::shared_ptr<State> state;
+
+	static Cache& threadCache() {
+		thread_local Cache cache;
+		return cache;
+	}
+
+	public:
+	PerThread(bool keep_on_thread_exit=false) : id(newPerThreadId()), state(new State) {
+		state->keep_on_thread_exit = keep_on_thread_exit;
+	}
+	PerThread(const PerThread&) = delete;
+	PerThread& operator=(const PerThread&) = delete;
+
+	// object of the calling thread; create() returns a std::unique_ptr<V>
+	template <typename F>
+	V* get(F create) {
+		Cache& cache = threadCache();
+		if (cache.last_id == id)
+			return cache.last;
+
+		V* object;
+		auto it = cache.map.find(id);
+		if (it != cache.map.end()) {
+			object = it->second.object;
+		} else {
+			if (cache.map.size() >= cache.sweep_size)
+				cache.sweep();
+			std::unique_ptr<V> aux = create();
+			object = aux.get();
+			{
+				std::lock_guard<std::mutex> lock(state->mutex);
+				state->objects.push_back(std::move(aux));
+			}
+			cache.map.emplace(id, typename Cache::Entry{state, object});
+		}
+		cache.last_id = id;
+		cache.last = object;
+		return object;
+	}
+
+	// objects of all threads, for reports; only stable with keep_on_thread_exit
+	std::vector<V*> all() {
+		std::lock_guard<std::mutex> lock(state->mutex);
+		std::vector<V*> ret;
+		for (auto& i : state->objects)
+			ret.push_back(i.get());
+		return ret;
+	}
+};
+
+// Engines used by the distributions when next() receives rand_engine=nullptr:
+// one engine per thread and per distribution instance, created on the first
+// use in each thread. Engines are owned by the instance and released with it
+// or when their thread exits.
+class ThreadEngines {
+	PerThread<RandEngine> engines;
+
+	public:
+	RandEngine* get() { // engine of the calling thread
+		return engines.get([]{ return newRandEngine(default_rand_engine_type); });
+	}
+};
+
+////////////////////////////////////////////////////////////////////////////////////
+
+// Generalized harmonic number: zeta(n, theta) = sum_{i=1}^{n} 1/i^theta.
+// zeta() sums the first terms explicitly and approximates the remaining ones
+// with the Euler-Maclaurin formula, costing O(1) for any n (truncation error
+// far below the double precision). zeta_exact() sums all n terms split among several threads
+// (threads=0 uses std::thread::hardware_concurrency()).
+double zeta(uint64_t n, double theta);
+double zeta_exact(uint64_t n, double theta, uint32_t threads=0);
+
+// zeta_range(first, last, theta) = sum_{i=first}^{last} 1/i^theta, in O(1).
+double zeta_range(uint64_t first, uint64_t last, double theta);
 
 ////////////////////////////////////////////////////////////////////////////////////
 
@@ -24,20 +209,37 @@ class RandEngine {};
 // https://github.com/brianfrankcooper/YCSB/blob/master/core/src/main/java/site/ycsb/generator/ZipfianGenerator.java
 template <typename T>
 class ZipfDistribution {
-	T      n;
 	double theta;
 	double alpha;
-	double zeta_n;
 	double zeta_theta;
-	double eta;
-	double zeta(T n, double theta);
+	double half_pow_theta;
+	bool   exact_zeta;
+
+	// n, zeta_n and eta change in grow() while other threads may be in next().
+	// They are published through a sequence lock, so readers never block.
+	std::atomic<T>        n;
+	std::atomic<double>   zeta_n;
+	std::atomic<double>   eta;
+	std::atomic<uint64_t> version {0};
+	std::mutex            grow_mutex;
 
-	std::unique_ptr<RandEngine> default_rand_engine;
+	double calcEta(T n, double zeta_n);
+	void   load(T& n, double& zeta_n, double& eta);
+
+	ThreadEngines default_rand_engines;
 
 	public:
-	ZipfDistribution(T n, double theta);
+	ZipfDistribution(T n, double theta, bool exact_zeta=false);
 	T next(RandEngine* rand_engine=nullptr);
-	RandEngine* newEngine(); // use one engine per thread
+	void next_batch(T* out, size_t count, RandEngine* rand_engine=nullptr); // same as count calls to next()
+	std::unique_ptr<RandEngine> newEngine(RandEngine::type_t type=default_rand_engine_type); // use one engine per thread
+
+	// Raises the number of items to new_n (YCSB's insert workloads). zeta_n is
+	// updated incrementally from its previous value. Thread safe: concurrent
+	// calls to next() keep sampling from either the old or the new n.
+	void   grow(T new_n);
+	T      getN();
+	double getZetaN();
 };
 
 typedef ZipfDistribution<int32_t> ZipfDistributionUint32;
@@ -45,22 +247,688 @@ typedef ZipfDistribution<int64_t> ZipfDistributionUint64;
 
 ////////////////////////////////////////////////////////////////////////////////////
 
+// Exact Zipf sampler for any theta > 0 (including theta >= 1), with O(1)
+// setup and O(1) expected time per sample. Implementation based on:
+// W. Hörmann and G. Derflinger, “Rejection-inversion to generate variates
+// from monotone discrete distributions,” ACM TOMACS 6(3), 1996.
+// and
+// https://github.com/apache/commons-rng/blob/master/commons-rng-sampling/src/main/java/org/apache/commons/rng/sampling/distribution/RejectionInversionZipfSampler.java
+template <typename T>
+class RejectionInversionZipfDistribution {
+	T      n;
+	double theta;
+	double h_integral_x1;
+	double h_integral_n;
+	double s;
+
+	double h(double x);
+	double hIntegral(double x);
+	double hIntegralInverse(double x);
+
+	ThreadEngines default_rand_engines;
+
+	public:
+	RejectionInversionZipfDistribution(T n, double theta);
+	T next(RandEngine* rand_engine=nullptr);
+	void next_batch(T* out, size_t count, RandEngine* rand_engine=nullptr); // same as count calls to next()
+	std::unique_ptr<RandEngine> newEngine(RandEngine::type_t type=default_rand_engine_type); // use one engine per thread
+};
+
+typedef RejectionInversionZipfDistribution<int32_t> RejectionInversionZipfDistributionUint32;
+typedef RejectionInversionZipfDistribution<int64_t> RejectionInversionZipfDistributionUint64;
+
+////////////////////////////////////////////////////////////////////////////////////
+
+struct MMapFile;
+
+// Exact Zipf probabilities from a precomputed CDF table, for n up to tens of
+// millions. The CDF is stored in 0.32 fixed point (4 bytes per key, keys with
+// probability below 2^-32 may not be sampled), in groups of 16 values (one
+// cache line). The group of a sample is found in an Eytzinger-layout tree of
+// the first values of the groups, and the key inside the group by counting
+// the values below the sample (vectorizable). The table can be saved to a
+// file and then memory mapped, read-only, by any number of processes.
 template <typename T>
+class CdfZipfDistribution {
+	T               n;
+	double          theta;
+	uint64_t        groups;
+	uint32_t        height;     // of the tree
+	const uint32_t* cdf;        // groups * 16 values
+	const uint32_t* tree;       // 2^height values, 1-based
+	std::vector<uint32_t>     storage;
+	std::unique_ptr<MMapFile> file;
+
+	ThreadEngines default_rand_engines;
+
+	T search(uint32_t u) const;
+
+	public:
+	CdfZipfDistribution(T n, double theta, uint32_t threads=0); // threads computing zeta(n)
+	CdfZipfDistribution(const std::string& cdf_file);
+	~CdfZipfDistribution();
+	void save(const std::string& cdf_file);
+	T next(RandEngine* rand_engine=nullptr);
+	void next_batch(T* out, size_t count, RandEngine* rand_engine=nullptr);
+	std::unique_ptr<RandEngine> newEngine(RandEngine::type_t type=default_rand_engine_type); // use one engine per thread
+	T getN();
+	double getTheta();
+};
+
+typedef CdfZipfDistribution<int32_t> CdfZipfDistributionUint32;
+typedef CdfZipfDistribution<int64_t> CdfZipfDistributionUint64;
+
+////////////////////////////////////////////////////////////////////////////////////
+
+// Keyed bijection of [1, n]: a balanced Feistel network over the smallest
+// even number of bits that covers n, with cycle-walking to stay inside the
+// range. It uses no table, and the same seed gives the same permutation in
+// any process.
+template <typename T>
+class KeyPermutation {
+	static const int rounds = 6;
+	uint64_t n;
+	uint32_t half_bits;
+	uint64_t half_mask;
+	uint64_t round_keys[rounds];
+
+	public:
+	KeyPermutation(T n, uint64_t seed);
+	T operator()(T key) const; // key in [1, n]
+};
+
+////////////////////////////////////////////////////////////////////////////////////
+
+typedef enum {
+	SCRAMBLE_LIST,        // shuffled table of sample_size keys (sizeof(T) bytes per key)
+	SCRAMBLE_PERMUTATION  // KeyPermutation of [1, n], no memory per key
+} scramble_t;
+
+// Zipf is the engine that ranks the keys: ZipfDistribution<T> (default),
+// RejectionInversionZipfDistribution<T> or CdfZipfDistribution<T>. The seed defines the permutation
+// used by SCRAMBLE_PERMUTATION. SCRAMBLE_LIST builds its table with
+// <threads> threads, in at most 1.25 sizeof(T) * sample_size bytes; the
+// table depends on the master seed (see setRandSeed()), not on the number of
+// threads.
+template <typename T, typename Zipf=ZipfDistribution<T>>
 class ScrambledZipfDistribution {
 	T              n;
 	T              sample_size;
+	scramble_t     scramble;
 	std::vector<T> sample_list;
+	std::unique_ptr<KeyPermutation<T>> permutation;
 
-	std::unique_ptr<ZipfDistribution<T>> zipf;
-	std::unique_ptr<RandEngine>          default_rand_engine;
+	std::unique_ptr<Zipf>       zipf;
+	ThreadEngines default_rand_engines;
+
+	void buildSampleList(uint32_t threads);
 
 	public:
-	ScrambledZipfDistribution(T n, T sample_size, double theta);
+	ScrambledZipfDistribution(T n, T sample_size, double theta, scramble_t scramble=SCRAMBLE_LIST, uint64_t seed=0, uint32_t threads=1);
 	T next(RandEngine* rand_engine=nullptr);
-	RandEngine* newEngine(); // use one engine per thread
+	void next_batch(T* out, size_t count, RandEngine* rand_engine=nullptr); // same as count calls to next()
+	std::unique_ptr<RandEngine> newEngine(RandEngine::type_t type=default_rand_engine_type); // use one engine per thread
 };
 
 typedef ScrambledZipfDistribution<int32_t> ScrambledZipfDistributionUint32;
 typedef ScrambledZipfDistribution<int64_t> ScrambledZipfDistributionUint64;
+typedef ScrambledZipfDistribution<int32_t, RejectionInversionZipfDistribution<int32_t>> ScrambledRejectionInversionZipfDistributionUint32;
+typedef ScrambledZipfDistribution<int64_t, RejectionInversionZipfDistribution<int64_t>> ScrambledRejectionInversionZipfDistributionUint64;
+typedef ScrambledZipfDistribution<int32_t, CdfZipfDistribution<int32_t>> ScrambledCdfZipfDistributionUint32;
+typedef ScrambledZipfDistribution<int64_t, CdfZipfDistribution<int64_t>> ScrambledCdfZipfDistributionUint64;
+
+////////////////////////////////////////////////////////////////////////////////////
+
+class Commands;
+
+// Zipf distribution whose parameters drift while it runs: theta (optionally
+// ramped linearly over a period), the offset of the hot set (hot_shift, in
+// keys, optionally rotating at a fixed rate) and the key range (key_shift).
+// Rank r (1 is the hottest) is mapped to the key
+//   ((r - 1 + hot_shift) mod n) + 1 + key_shift
+// Ranks are sampled by rejection-inversion (see above), so changing theta
+// only recomputes three constants. The parameters are published through a
+// sequence lock: samplers never block, and they keep the previous values
+// until a change is complete. During a ramp, theta is refreshed every 10 ms
+// by whichever sampler finds the update lock free.
+template <typename T>
+class DriftingZipfDistribution {
+	T n;
+
+	// state of the changes, protected by mutex
+	std::mutex mutex;
+	double     theta_from;
+	double     theta_to;
+	uint64_t   ramp_begin = 0;  // ns
+	uint64_t   ramp_ns = 0;
+	double     theta_ramp = 0;  // s, applied to the theta command
+
+	// published snapshot
+	struct Snapshot {
+		double   theta;
+		double   h_integral_x1;
+		double   h_integral_n;
+		double   s;
+		int64_t  shift;        // in [0, n) at rotate_begin
+		double   rotate;       // keys per second
+		uint64_t rotate_begin; // ns
+		int64_t  key_shift;
+		uint64_t next_update;  // ns, UINT64_MAX when there is no ramp
+	};
+	std::atomic<double>   theta;
+	std::atomic<double>   h_integral_x1;
+	std::atomic<double>   h_integral_n;
+	std::atomic<double>   s;
+	std::atomic<int64_t>  shift {0};
+	std::atomic<double>   rotate {0};
+	std::atomic<uint64_t> rotate_begin {0};
+	std::atomic<int64_t>  key_shift {0};
+	std::atomic<uint64_t> next_update;
+	std::atomic<uint64_t> version {0};
+
+	void     load(Snapshot& snap);
+	void     publish(const Snapshot& snap);
+	uint64_t current(Snapshot& snap); // loads snap and updates the ramp if due (never blocks), returns the time
+	void     updateTheta(Snapshot& snap, uint64_t now);
+	int64_t  currentShift(const Snapshot& snap, uint64_t now);
+	bool     sampleRank(const Snapshot& snap, double u, T& rank);
+	T        toKey(const Snapshot& snap, int64_t shift, T rank);
+
+	ThreadEngines default_rand_engines;
+
+	public:
+	DriftingZipfDistribution(T n, double theta);
+	T next(RandEngine* rand_engine=nullptr);
+	void next_batch(T* out, size_t count, RandEngine* rand_engine=nullptr); // same as count calls to next()
+	std::unique_ptr<RandEngine> newEngine(RandEngine::type_t type=default_rand_engine_type); // use one engine per thread
+
+	// Thread safe, concurrent samplers are not blocked.
+	void setTheta(double new_theta, double ramp_seconds=0); // linear ramp from the current theta
+	void setHotShift(int64_t hot_shift);                    // restarts a rotation from this offset
+	void setRotate(double keys_per_second);                 // 0 stops at the current offset
+	void setKeyShift(int64_t key_shift);
+
+	T       getN();
+	double  getTheta();    // current value, during a ramp
+	int64_t getHotShift(); // current offset, in [0, n)
+	int64_t getKeyShift();
+
+	// Registers the commands (names prefixed by prefix):
+	//   theta=<double>       changes theta, ramped over theta_ramp seconds
+	//   theta_ramp=<double>  ramp period of the next theta changes (default 0)
+	//   hot_shift=<int64>    offset of the hottest key
+	//   rotate=<double>      rotation rate of hot_shift, in keys per second
+	//   key_shift=<int64>    shifts the whole key range
+	// e.g., commands.monitorScript("30s:theta=0.99;60s:hot_shift=1000000").
+	// The distribution must outlive commands.
+	void registerCommands(Commands& commands, const std::string& prefix="");
+};
+
+typedef DriftingZipfDistribution<int32_t> DriftingZipfDistributionUint32;
+typedef DriftingZipfDistribution<int64_t> DriftingZipfDistributionUint64;
+
+////////////////////////////////////////////////////////////////////////////////////
+// YCSB-style key distributions:
+// https://github.com/brianfrankcooper/YCSB/tree/master/core/src/main/java/site/ycsb/generator
+//
+// All distributions share the interface of ZipfDistribution: next(),
+// next_batch() and newEngine(), with one RandEngine per thread (or the
+// per-thread default engines when rand_engine=nullptr).
+
+// Keys uniformly distributed in [min, max].
+template <typename T>
+class UniformDistribution {
+	T min;
+	T max;
+	ThreadEngines default_rand_engines;
+
+	public:
+	UniformDistribution(T min, T max);
+	T next(RandEngine* rand_engine=nullptr);
+	void next_batch(T* out, size_t count, RandEngine* rand_engine=nullptr);
+	std::unique_ptr<RandEngine> newEngine(RandEngine::type_t type=default_rand_engine_type);
+};
+
+// Hot set: the first hot_set_fraction of the keys in [1, n] receives
+// hot_op_fraction of the operations. Keys are uniform inside each set.
+template <typename T>
+class HotspotDistribution {
+	T      n;
+	T      hot_n;
+	double hot_op_fraction;
+	ThreadEngines default_rand_engines;
+
+	public:
+	HotspotDistribution(T n, double hot_set_fraction=0.2, double hot_op_fraction=0.8);
+	T next(RandEngine* rand_engine=nullptr);
+	void next_batch(T* out, size_t count, RandEngine* rand_engine=nullptr);
+	std::unique_ptr<RandEngine> newEngine(RandEngine::type_t type=default_rand_engine_type);
+};
+
+// Exponentially distributed keys in [1, n]: <percentile>% of the operations
+// fall in the first <fraction> of the keys.
+template <typename T>
+class ExponentialDistribution {
+	T      n;
+	double gamma;
+	ThreadEngines default_rand_engines;
+
+	public:
+	ExponentialDistribution(T n, double percentile=95, double fraction=0.8571428571);
+	T next(RandEngine* rand_engine=nullptr);
+	void next_batch(T* out, size_t count, RandEngine* rand_engine=nullptr);
+	std::unique_ptr<RandEngine> newEngine(RandEngine::type_t type=default_rand_engine_type);
+};
+
+// Counter: start, start+1, ... shared by all threads (rand_engine is
+// ignored). lastValue() is the last value returned.
+template <typename T>
+class CounterDistribution {
+	protected:
+	std::atomic<T> counter;
+
+	public:
+	CounterDistribution(T start=1);
+	T next(RandEngine* rand_engine=nullptr);
+	void next_batch(T* out, size_t count, RandEngine* rand_engine=nullptr);
+	std::unique_ptr<RandEngine> newEngine(RandEngine::type_t type=default_rand_engine_type);
+	T lastValue();
+};
+
+// Counter whose lastValue() is the highest value v such that all values up
+// to v were acknowledged (e.g., inserts completed). Values are tracked in a
+// window of 2^20 unacknowledged values; acknowledge() throws when it is full.
+template <typename T>
+class AcknowledgedCounterDistribution : public CounterDistribution<T> {
+	static const uint64_t window_size = 1 << 20;
+	static const uint64_t window_mask = window_size - 1;
+	std::unique_ptr<std::atomic<bool>[]> window;
+	std::atomic<T>    limit;
+	std::atomic<bool> advancing {false}; // a thread is advancing limit
+
+	public:
+	AcknowledgedCounterDistribution(T start=1);
+	void acknowledge(T value);
+	T lastValue();
+};
+
+// Sequential keys first, first+1, ..., last, first, ... shared by all threads.
+template <typename T>
+class SequentialDistribution {
+	T first;
+	T last;
+	std::atomic<uint64_t> counter {0};
+
+	public:
+	SequentialDistribution(T first, T last);
+	T next(RandEngine* rand_engine=nullptr);
+	void next_batch(T* out, size_t count, RandEngine* rand_engine=nullptr);
+	std::unique_ptr<RandEngine> newEngine(RandEngine::type_t type=default_rand_engine_type);
+};
+
+// Keys in [1, basis->lastValue()], Zipf-skewed toward the most recent key.
+// Counter is CounterDistribution<T> (latest: skewed toward the last key
+// issued) or AcknowledgedCounterDistribution<T> (skewed latest: toward the
+// last acknowledged key). The Zipf engine grows with the counter. next() and
+// next_batch() throw std::runtime_error while the basis has no last value
+// (lastValue() < 1, e.g., a fresh CounterDistribution with start = 1).
+template <typename T, typename Counter=CounterDistribution<T>>
+class LatestDistribution {
+	Counter* basis;
+	std::unique_ptr<ZipfDistribution<T>> zipf;
+	ThreadEngines default_rand_engines;
+
+	T getLast();
+
+	public:
+	LatestDistribution(Counter* basis, double theta=0.99);
+	T next(RandEngine* rand_engine=nullptr);
+	void next_batch(T* out, size_t count, RandEngine* rand_engine=nullptr);
+	std::unique_ptr<RandEngine> newEngine(RandEngine::type_t type=default_rand_engine_type);
+};
+
+template <typename T>
+using SkewedLatestDistribution = LatestDistribution<T, AcknowledgedCounterDistribution<T>>;
+
+////////////////////////////////////////////////////////////////////////////////////
+
+// Keys in [1, n] with probabilities proportional to weights[0..n), e.g., an
+// access histogram captured from production. Samples are drawn in O(1) from
+// an alias table (Walker's method, built with Vose's algorithm in O(n)).
+// weight_file is a binary file of n native-endian doubles, memory mapped
+// only during the construction.
+template <typename T>
+class AliasDistribution {
+	struct Bucket {
+		uint64_t threshold; // P(index+1 | bucket) in 0.64 fixed point
+		T        alias;
+	};
+	T n;
+	std::vector<Bucket> table;
+	ThreadEngines default_rand_engines;
+
+	void build(const double* weights, size_t count);
+
+	public:
+	AliasDistribution(const std::vector<double>& weights);
+	AliasDistribution(const double* weights, size_t count);
+	AliasDistribution(const std::string& weight_file);
+	T next(RandEngine* rand_engine=nullptr);
+	void next_batch(T* out, size_t count, RandEngine* rand_engine=nullptr);
+	std::unique_ptr<RandEngine> newEngine(RandEngine::type_t type=default_rand_engine_type);
+	T getN();
+};
+
+typedef AliasDistribution<int32_t> AliasDistributionUint32;
+typedef AliasDistribution<int64_t> AliasDistributionUint64;
+
+////////////////////////////////////////////////////////////////////////////////////
+
+// Distribution selected at run time by a configuration string of
+// comma-separated key=value pairs, e.g., "type=zipf,n=1000000,theta=0.99".
+//   type=uniform        n
+//   type=zipf           n, theta
+//   type=zipf_ri        n, theta (rejection-inversion)
+//   type=zipf_cdf       n, theta, or file (see CdfZipfDistribution)
+//   type=scrambled      n, theta, sample_size (default n), permutation (bool), seed
+//   type=hotspot        n, hot_set, hot_ops
+//   type=exponential    n, percentile, fraction
+//   type=sequential     n (keys 1..n, wrapping)
+//   type=counter        start
+//   type=latest         n, theta
+//   type=alias          file (see AliasDistribution)
+//   type=skewed_latest  n, theta
+// latest and skewed_latest own an insert counter that starts after n (see
+// insertCounter()). The distribution is selected once per call of next() and
+// next_batch(), without virtual calls.
+template <typename T>
+class KeyDistribution {
+	std::variant<
+		std::unique_ptr<UniformDistribution<T>>,
+		std::unique_ptr<ZipfDistribution<T>>,
+		std::unique_ptr<RejectionInversionZipfDistribution<T>>,
+		std::unique_ptr<CdfZipfDistribution<T>>,
+		std::unique_ptr<ScrambledZipfDistribution<T>>,
+		std::unique_ptr<HotspotDistribution<T>>,
+		std::unique_ptr<ExponentialDistribution<T>>,
+		std::unique_ptr<SequentialDistribution<T>>,
+		std::unique_ptr<CounterDistribution<T>>,
+		std::unique_ptr<LatestDistribution<T>>,
+		std::unique_ptr<SkewedLatestDistribution<T>>,
+		std::unique_ptr<AliasDistribution<T>>
+	> dist;
+	std::unique_ptr<AcknowledgedCounterDistribution<T>> insert_counter;
+
+	public:
+	KeyDistribution(const std::string& config);
+	T next(RandEngine* rand_engine=nullptr);
+	void next_batch(T* out, size_t count, RandEngine* rand_engine=nullptr);
+	std::unique_ptr<RandEngine> newEngine(RandEngine::type_t type=default_rand_engine_type);
+	AcknowledgedCounterDistribution<T>* insertCounter(); // nullptr if not latest or skewed_latest
+};
+
+typedef KeyDistribution<int32_t> KeyDistributionUint32;
+typedef KeyDistribution<int64_t> KeyDistributionUint64;
+
+////////////////////////////////////////////////////////////////////////////////////
+
+// Global key stream defined by (distribution, seed, count), split into parts
+// generated independently by any number of threads or processes, without
+// coordination or shared state. Key i of the stream is drawn by dist.next()
+// from a counter-based engine at substream i (see newCounterRandEngine()),
+// so it depends only on (seed, i) and part p of P covers the indexes
+// [count*p/P, count*(p+1)/P): the concatenation of the parts is the same
+// sequence for any P, including the single client (P = 1).
+// Every process builds its own dist with the same parameters. dist must not
+// depend on other random state: e.g., ScrambledZipfDistribution with
+// SCRAMBLE_PERMUTATION and an explicit seed (SCRAMBLE_LIST draws its table
+// from the master seed), and not the counter-based types of KeyDistribution.
+// One instance per thread; dist may be shared by the threads of a process.
+template <typename T, typename Dist=ZipfDistribution<T>>
+class PartitionedKeyStream {
+	Dist&    dist;
+	uint64_t count;
+	uint64_t first;
+	uint64_t last;
+	uint64_t pos;
+	std::unique_ptr<RandEngine> rand_engine;
+
+	public:
+	PartitionedKeyStream(Dist& dist, uint64_t seed, uint64_t count, uint64_t part=0, uint64_t parts=1);
+	T      at(uint64_t index);               // key of any index in [0, count) of the global stream
+	bool   next(T& key);                     // false at the end of this part
+	size_t next_batch(T* out, size_t count); // number of keys written, 0 at the end of this part
+	void   seek(uint64_t index);             // next index of this part, in [getFirst(), getLast()]
+
+	uint64_t getFirst();    // first index of this part
+	uint64_t getLast();     // one past the last index of this part
+	uint64_t getPosition(); // next index
+};
+
+typedef PartitionedKeyStream<int32_t> PartitionedZipfKeyStreamUint32;
+typedef PartitionedKeyStream<int64_t> PartitionedZipfKeyStreamUint64;
+typedef PartitionedKeyStream<int32_t, ScrambledZipfDistribution<int32_t>> PartitionedScrambledZipfKeyStreamUint32;
+typedef PartitionedKeyStream<int64_t, ScrambledZipfDistribution<int64_t>> PartitionedScrambledZipfKeyStreamUint64;
+
+////////////////////////////////////////////////////////////////////////////////////
+
+// Key traces: the output of any distribution recorded to a binary file and
+// replayed later, reproducing the same key sequence on every run and machine.
+//
+// File layout (native endianness):
+//   header: "ALTRACE" magic (8 bytes), version (uint32), reserved (uint32)
+//   blocks: count (uint32), size (uint32) and size bytes of keys, encoded
+//           as zigzag varints of the deltas to the previous key (the first
+//           key of each block is a delta to 0). The lengths of the varints
+//           (0 to 8 bytes, 4 bits each, two per byte) are stored before their
+//           bytes, so decoding does not depend on the previous varint value.
+//   index:  file offset of each block (uint64), aligned to 8 bytes
+//   footer: index offset, number of blocks, number of keys (uint64 each),
+//           and the magic again
+// Blocks are independent, so readers can start at any of them.
+
+template <typename T>
+class TraceWriter {
+	FILE*                 file;
+	std::string           filename;
+	uint32_t              keys_per_block;
+	std::vector<uint8_t>  lengths;    // current block: lengths of the varints
+	std::vector<uint8_t>  bytes;      // current block: bytes of the varints
+	uint32_t              bytes_size  = 0;
+	uint32_t              block_count = 0;
+	T                     prev        = 0;
+	uint64_t              offset      = 0;
+	uint64_t              total_keys  = 0;
+	std::vector<uint64_t> index;
+
+	void writeRaw(const void* data, size_t size);
+	void flushBlock();
+
+	public:
+	TraceWriter(const std::string& filename, uint32_t keys_per_block=65536);
+	~TraceWriter(); // calls close()
+	void write(T key);
+	void write(const T* keys, size_t count);
+	void close(); // writes the index and the footer
+
+	// Records count keys generated by dist (any distribution of this file)
+	template <typename Dist>
+	void record(Dist& dist, uint64_t count, RandEngine* rand_engine=nullptr) {
+		T buffer[4096];
+		while (count > 0) {
+			size_t c = count < 4096 ? count : 4096;
+			dist.next_batch(buffer, c, rand_engine);
+			write(buffer, c);
+			count -= c;
+		}
+	}
+};
+
+// Zero-copy reader of memory-mapped traces. Keys are read through cursors,
+// each one covering a range of blocks. Trace readers also have the
+// interface of the distributions, so they can replace a live generator:
+// next() and next_batch() read from a cursor of the calling thread, which
+// takes the next unread block of the trace when it reaches the end of its
+// current block (rand_engine is ignored). A single thread replays the whole
+// trace in order; with several threads, each block is read by one of them.
+// After the last block, the trace restarts if loop is true, otherwise
+// std::out_of_range is thrown.
+template <typename T>
+class TraceReader {
+	std::unique_ptr<MMapFile> file;
+	const uint8_t*            data;
+	const uint64_t*           index;
+	uint64_t                  blocks;
+	uint64_t                  keys;
+	bool                      loop;
+
+	public:
+	struct Cursor {
+		uint64_t       block;     // next block to open
+		uint64_t       end_block;
+		const uint8_t* lengths = nullptr;
+		const uint8_t* p       = nullptr;
+		const uint8_t* end     = nullptr;
+		uint32_t       pos     = 0;  // keys read from the current block
+		uint32_t       left    = 0;  // keys left in the current block
+		T              prev = 0;
+	};
+
+	private:
+	std::atomic<uint64_t>                next_block {0}; // shared by the thread cursors
+	PerThread<Cursor>                    thread_cursors;
+
+	bool openBlock(Cursor& cursor);
+	Cursor* threadCursor();
+
+	public:
+	TraceReader(const std::string& filename, bool loop=true);
+	~TraceReader();
+
+	uint64_t getBlocks() { return blocks; }
+	uint64_t getKeys()   { return keys; }
+
+	// Blocks [part*blocks/parts, (part+1)*blocks/parts): disjoint cursors
+	// for the threads of a run, each one with a reproducible sequence.
+	Cursor getCursor(uint32_t part=0, uint32_t parts=1);
+	size_t read(Cursor& cursor, T* out, size_t count); // returns < count at the end of the range
+
+	T next(RandEngine* rand_engine=nullptr);
+	void next_batch(T* out, size_t count, RandEngine* rand_engine=nullptr);
+	std::unique_ptr<RandEngine> newEngine(RandEngine::type_t type=default_rand_engine_type);
+};
+
+typedef TraceWriter<int32_t> TraceWriterUint32;
+typedef TraceWriter<int64_t> TraceWriterUint64;
+typedef TraceReader<int32_t> TraceReaderUint32;
+typedef TraceReader<int64_t> TraceReaderUint64;
+
+////////////////////////////////////////////////////////////////////////////////////
+
+// Frequency estimates of a key stream in fixed memory:
+// G. Cormode and S. Muthukrishnan, “An improved data stream summary: the
+// count-min sketch and its applications,” Journal of Algorithms 55(1), 2005.
+// estimate() never returns less than the true count, and exceeds it by at
+// most e/width of the total count with probability 1 - e^-depth. One writer,
+// any number of concurrent readers (relaxed atomic counters).
+class CountMinSketch {
+	uint32_t width;  // power of 2
+	uint32_t depth;
+	std::unique_ptr<std::atomic<uint32_t>[]> counters; // depth rows of width counters
+
+	public:
+	CountMinSketch(uint32_t width=16384, uint32_t depth=4);
+	static void checkArgs(uint32_t width, uint32_t depth); // throws std::invalid_argument
+	uint64_t add(uint64_t key, uint32_t count=1); // returns estimate(key)
+	uint64_t estimate(uint64_t key) const;
+	uint32_t getWidth() const { return width; }
+	uint32_t getDepth() const { return depth; }
+};
+
+// Top-k most frequent keys of a stream in O(k) memory:
+// A. Metwally, et al. “Efficient computation of frequent and top-k elements
+// in data streams,” in Proceedings of ICDT 2005.
+// Every key with count above total/k is in the summary. The counts are
+// overestimated by at most error (the count of the evicted key they replaced).
+// add() optionally takes an upper bound of the key's total count, e.g. from a
+// CountMinSketch: keys out of the summary whose bound is not above
+// minCount() are not inserted, which avoids most of the evictions of
+// long-tailed streams without changing the guarantees (filtered space-saving:
+// N. Homem and J. P. Carvalho, “Finding top-k elements in data streams,”
+// Information Sciences 180(24), 2010). Not thread safe.
+class SpaceSaving {
+	public:
+	struct Item {
+		uint64_t key;
+		uint64_t count;
+		uint64_t error;
+	};
+
+	private:
+	struct Counter : Item {
+		uint32_t slot; // in index
+	};
+	uint32_t             k;
+	std::vector<Counter> heap;  // min-heap by count
+	std::vector<uint32_t> index; // open addressing table of heap positions + 1 (0 = empty)
+	uint32_t             index_mask;
+
+	uint32_t find(uint64_t key) const; // slot of key or of the empty slot where it would be
+	void     erase(uint32_t slot);
+	void     siftUp(uint32_t pos);
+	void     siftDown(uint32_t pos);
+	void     place(uint32_t pos, const Counter& c);
+
+	public:
+	SpaceSaving(uint32_t k=1024);
+	static void checkArgs(uint32_t k); // throws std::invalid_argument
+	void              add(uint64_t key, uint64_t count=1, uint64_t upper_bound=UINT64_MAX);
+	uint32_t          getK() const { return k; }
+	uint64_t          minCount() const; // count of any key not in the summary is at most this
+	std::vector<Item> items() const;    // sorted by count, descending
+};
+
+// Thread-sharded skew monitor: validates during a run that the keys hitting
+// the store follow the configured skew. Every thread records into its own
+// shard (count-min sketch + space-saving summary), so recording takes no
+// shared locks. record() buffers keys per thread and applies them in chunks
+// (flush() applies the calling thread's buffer, e.g., before it finishes);
+// record_batch() applies them at once. With the default sample_every = 1
+// every key is applied, which costs tens of ns per key (depth sketch rows
+// plus a summary update). With sample_every > 1 only one of every
+// sample_every keys of each thread is applied, for about 1 ns per skipped
+// key, and the counts are scaled back (theta is not affected); e.g., 16
+// brings record_batch() to a few ns per key.
+// Reports read the sketches without locks and copy each top-k summary under
+// its shard's lock, delaying a writer by at most one copy of k items.
+class SkewMonitor {
+	struct Shard;
+	uint32_t                            width;
+	uint32_t                            depth;
+	uint32_t                            k;
+	uint32_t                            sample_every;
+	PerThread<Shard>                    shards; // kept after their threads exit
+
+	Shard* shard(); // of the calling thread
+	void   apply(Shard* s, const uint64_t* keys, size_t count);
+
+	public:
+	SkewMonitor(uint32_t top_k=1024, uint32_t width=16384, uint32_t depth=4, uint32_t sample_every=1);
+	~SkewMonitor();
+
+	void record(uint64_t key);
+	template <typename T>
+	void record_batch(const T* keys, size_t count);
+	void flush();
+
+	uint64_t                       getTotal();         // keys recorded, up to the last chunk applied by each thread
+	uint64_t                       estimate(uint64_t key);
+	std::vector<SpaceSaving::Item> topK();             // merged over the shards, descending
+	// Least squares fit of log(count) = c - theta * log(rank) over the top
+	// ranks (up to max_ranks, default k/4), stopping at the first rank whose
+	// count is not reliable. It depends only on the frequencies, so it also
+	// holds for scrambled keys. Returns NaN if less than 2 ranks are reliable.
+	double                         estimateTheta(uint32_t max_ranks=0);
+};
 
 } // namespace alutils
@@ -11,6 +11,16 @@
 #include <algorithm>
 #include <functional>
 #include <regex>
+#include <string_view>
+#include <list>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <type_traits>
+#include <cstdint>
+#include <cstring>
+#include <cstdarg>
 
 namespace alutils {
 
@@ -18,6 +28,10 @@ extern const char* strip_default;
 
 std::string& inplace_strip(std::string& src, const char* to_strip=strip_default);
 
+// view of src without the leading and trailing to_strip characters (no copy)
+std::string_view strip_view(std::string_view src, const char* to_strip=strip_default);
+std::string_view& inplace_strip(std::string_view& src, const char* to_strip=strip_default);
+
 inline std::string strip(const std::string& src, const char* to_strip=strip_default) {
 	std::string ret = src;
 	return inplace_strip(ret, to_strip);
@@ -27,21 +41,124 @@ std::string str_replace(const std::string& src, const char find, const char repl
 
 std::string& str_replace(std::string& dest, const std::string& src, const char find, const char replace);
 
+// Lazy tokenizer: the tokens are views of src, which must outlive them, and
+// no memory is allocated. Modes:
+//   Tokenizer(src)                 tokens separated by runs of whitespace
+//                                  (strip_default), no empty tokens
+//   Tokenizer(src, ',')            every delimiter separates two tokens,
+//   Tokenizer(src, "::")           including empty ones ("" has one token)
+// with strip=true, the tokens of the delimiter modes are stripped.
+// Whitespace is scanned 8 bytes at a time and delimiters with memchr().
+// Usage:
+//   for (auto token : Tokenizer(line)) ...
+//   Tokenizer t(line, ','); std::string_view token; while (t.next(token)) ...
+class Tokenizer {
+	public:
+	typedef enum { WHITESPACE, CHAR, STRING } mode_t;
+
+	private:
+	std::string_view src;        // not consumed yet
+	std::string_view delimiter;
+	char             delimiter_char = 0;
+	mode_t           mode;
+	bool             strip = false;
+	bool             done = false;
+
+	public:
+	class iterator {
+		Tokenizer*       tokenizer = nullptr;
+		std::string_view token;
+
+		public:
+		iterator() {}
+		iterator(Tokenizer* tokenizer) : tokenizer(tokenizer) { ++(*this); }
+		iterator& operator++() { if (!tokenizer->next(token)) tokenizer = nullptr; return *this; }
+		std::string_view operator*() const { return token; }
+		bool operator==(const iterator& other) const { return tokenizer == other.tokenizer; }
+		bool operator!=(const iterator& other) const { return tokenizer != other.tokenizer; }
+	};
+
+	Tokenizer(std::string_view src) : src(src), mode(WHITESPACE) {}
+	Tokenizer(std::string_view src, char delimiter, bool strip=false) : src(src), delimiter_char(delimiter), mode(CHAR), strip(strip) {}
+	Tokenizer(std::string_view src, std::string_view delimiter, bool strip=false) : src(src), delimiter(delimiter), mode(STRING), strip(strip) {}
+
+	bool             next(std::string_view& token); // false after the last token
+	std::string_view rest() const { return src; }   // not tokenized yet
+	iterator         begin() { return iterator(this); }
+	iterator         end()   { return iterator(); }
+};
+
+// Whitespace-separated columns of str (of the rest of the line after the
+// regular expression prefix followed by whitespace, if prefix is not null)
 int split_columns(std::vector<std::string>& ret, const char* str, const char* prefix=nullptr);
 
+// Stripped pieces of str between the delimiters
 std::vector<std::string> split_str(const std::string& str, const std::string& delimiter);
 
+// Bulk parser of whitespace-separated columns, e.g. of the iostat or vmstat
+// output read by ProcessController. Each parse() call appends the complete
+// lines of a chunk to typed column arrays. Lines with a number of fields
+// different from the schema, or with a field that is not a number in an
+// INT64/DOUBLE column (e.g. headers), are skipped; empty lines are ignored.
+// STRING columns view the chunks, which must outlive them.
+//
+// Field boundaries are found 64 bytes at a time with SSE2 bitmasks (or a
+// portable scan), and numbers are converted column by column with
+// std::from_chars after the whole chunk has been split.
+//
+//   ColumnParser p({ColumnParser::STRING, ColumnParser::DOUBLE, ColumnParser::DOUBLE});
+//   size_t n = p.parse(chunk); // chunk.substr(n) is an incomplete line
+//   for (size_t i = 0; i < p.getRows(); i++) ... p.getString(0)[i] ... p.getDouble(1)[i]
+class ColumnParser {
+	public:
+	typedef enum { INT64, DOUBLE, STRING, SKIP } type_t;
+
+	private:
+	std::vector<type_t>                        schema;
+	std::vector<std::vector<int64_t>>          int64_columns;  // only for the INT64 columns
+	std::vector<std::vector<double>>           double_columns; // only for the DOUBLE columns
+	std::vector<std::vector<std::string_view>> string_columns; // only for the STRING columns
+	size_t                                     rows = 0;
+	size_t                                     skipped = 0;
+
+	// fields of the rows of the current chunk, row-major
+	std::vector<std::string_view> staged;
+	std::vector<uint8_t>          invalid;
+
+	void endRow(size_t fields);
+	void convertStaged();
+
+	public:
+	ColumnParser(const std::vector<type_t>& schema);
+
+	// Returns the size of the parsed lines. With last=true, a final line
+	// without '\n' is parsed too.
+	size_t parse(std::string_view chunk, bool last=false);
+	void   clear(); // keeps the schema
+
+	size_t getColumns() const { return schema.size(); }
+	size_t getRows() const    { return rows; }
+	size_t getSkipped() const { return skipped; }
+	const std::vector<int64_t>&          getInt64(size_t column) const;
+	const std::vector<double>&           getDouble(size_t column) const;
+	const std::vector<std::string_view>& getString(size_t column) const;
+};
+
 ////////////////////////////////////////////////////////////////////////////////////
 extern bool debug_parse;
 
+// The value is stripped, validated and converted in a single pass, without
+// allocations (except for the error messages). Integers are -{0,1}[0-9]+
+// (no sign for unsigned types) and must fit in T. Doubles have no exponent.
+// An empty value is an error if required, or default_ otherwise.
 template<typename T>
-T parse(const std::string &value,
+T parse(std::string_view value,
         const bool required=true, const T default_=(T)0, const char* error_msg=nullptr,
         std::function<bool(T)> check_method=nullptr );
 
 #define DECLARE_PARSE(NAME, TYPE)                                                         \
     inline TYPE NAME(                                                                     \
-        const std::string &value, const bool required=true, const TYPE default_=(TYPE)0,  \
+        std::string_view value, const bool required=true, const TYPE default_=(TYPE)0,    \
         const char* error_msg=nullptr, std::function<bool(TYPE)> check_method=nullptr )   \
     {                                                                                     \
         return parse<TYPE>(value, required, default_, error_msg, check_method);           \
@@ -59,11 +176,12 @@ DECLARE_PARSE(parseDouble, double);
 ////////////////////////////////////////////////////////////////////////////////////
 extern bool debug_parseSuffix;
 
+// <number>[ ]<suffix>, e.g. "10 m" with suffixes {{"s",1},{"m",60}} gives 600
 template <typename T>
-T parseSuffix(const std::string& value, const std::map<std::string, T>& suffixes);
+T parseSuffix(std::string_view value, const std::map<std::string, T>& suffixes);
 
 #define DECLARE_PARSE_SUFFIX(NAME, TYPE)                                                    \
-    inline TYPE NAME(const std::string& value, const std::map<std::string, TYPE>& suffixes) \
+    inline TYPE NAME(std::string_view value, const std::map<std::string, TYPE>& suffixes)   \
     {                                                                                       \
         return parseSuffix<TYPE>(value, suffixes);                                          \
     }
@@ -77,10 +195,245 @@ DECLARE_PARSE_SUFFIX(parseDoubleSuffix, double  );
 #undef DECLARE_PARSE_SUFFIX
 
 ////////////////////////////////////////////////////////////////////////////////////
-std::string vsprintf(const char* format, va_list args);
-std::string sprintf(const char* format, ...);
+// Values with units: <number>[ ]<unit>, parsed in a single from_chars pass
+// with compile-time unit tables, without allocations (except for the error
+// messages). Integer numbers are scaled exactly and fractional numbers are
+// rounded to the base unit. Errors throw std::invalid_argument.
+
+// Bytes. Units: B, K/KB, M/MB, G/GB, T/TB (powers of 1000) and Ki/KiB,
+// Mi/MiB, Gi/GiB, Ti/TiB (powers of 1024). No unit: bytes.
+//   parseSize("4Ki") == 4096, parseSize("1.5 GB") == 1500000000
+uint64_t parseSize(std::string_view value);
+
+// Units: ns, us, ms, s, m/min and h. No unit: default_unit.
+//   parseDuration("1.5s") == parseDuration("1500ms")
+std::chrono::nanoseconds parseDuration(std::string_view value,
+                                       std::chrono::nanoseconds default_unit=std::chrono::seconds(1));
+
+// Units per second of <number>[ ][size unit][ops][/<duration unit>], where
+// the size units are those of parseSize (as multipliers of ops too) and the
+// duration unit defaults to s.
+//   parseRate("100MB/s") == 1e8, parseRate("5K ops/s") == 5000, parseRate("10/ms") == 10000
+double parseRate(std::string_view value);
+
+////////////////////////////////////////////////////////////////////////////////////
+// printf-compatible shims, checked by the compiler (-Wformat). The message is
+// formatted into a thread-local buffer and copied once into the result.
+std::string vsprintf(const char* format, va_list args) __attribute__((format(printf, 1, 0)));
+std::string sprintf(const char* format, ...) __attribute__((format(printf, 1, 2)));
+
+// As vsprintf, but the result views a thread-local buffer that is reused by
+// the next call in the same thread (no allocations once the buffer has grown).
+std::string_view vsprintf_view(const char* format, va_list args) __attribute__((format(printf, 1, 0)));
+
+////////////////////////////////////////////////////////////////////////////////////
+// Type-safe formatter with "{}" placeholders ("{{" and "}}" are literal braces).
+// A placeholder can take a spec after ':' of the form [.precision][type]:
+//   integers: x (hex)
+//   floating: f, e, g (precision defaults to the shortest representation)
+// Numbers are written with std::to_chars. Supported arguments are integers,
+// floating point numbers, bool, char, strings (const char*, std::string and
+// std::string_view) and pointers.
+//
+//   char buf[64];
+//   size_t n = format_to(buf, sizeof(buf), "key={} ops={:.2f}", key, ops);
+//   throw std::invalid_argument(format_str("invalid key: {}", key));
+//
+// The PRINT_* macros format their message themselves, so they keep taking
+// printf-style arguments rather than a preformatted string.
+//
+// Invalid specs and placeholder/argument count mismatches throw
+// std::invalid_argument. The ALUTILS_FORMAT* macros do the same checks at
+// compile time, including the spec types (format must be a string literal).
+
+struct FormatArg {
+	typedef enum { NONE, INT, UINT, DOUBLE, BOOL, CHAR, STRING, POINTER } type_t;
+	type_t type;
+	union {
+		int64_t     i;
+		uint64_t    u;
+		double      d;
+		bool        b;
+		char        c;
+		const void* p;
+		struct { const char* data; size_t size; } s;
+	};
+
+	FormatArg() : type(NONE), u(0) {}
+	FormatArg(bool value) : type(BOOL), b(value) {}
+	FormatArg(char value) : type(CHAR), c(value) {}
+	template <typename T, typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value, int>::type = 0>
+	FormatArg(T value) : type(INT), i(value) {}
+	template <typename T, typename std::enable_if<std::is_integral<T>::value && std::is_unsigned<T>::value, int>::type = 0>
+	FormatArg(T value) : type(UINT), u(value) {}
+	FormatArg(float value) : type(DOUBLE), d(value) {}
+	FormatArg(double value) : type(DOUBLE), d(value) {}
+	FormatArg(const char* value) : type(STRING), s{value ? value : "(null)", value ? strlen(value) : 6} {}
+	FormatArg(char* value) : FormatArg((const char*)value) {}
+	FormatArg(std::string_view value) : type(STRING), s{value.data(), value.size()} {}
+	FormatArg(const std::string& value) : type(STRING), s{value.data(), value.size()} {}
+	FormatArg(const void* value) : type(POINTER), p(value) {}
+};
+
+// Writes at most size-1 characters and the null terminator (if size > 0).
+// Returns the length of the whole formatted text, as snprintf.
+size_t vformat_to(char* buffer, size_t size, const char* format, const FormatArg* args, size_t count);
+// The result views a thread-local buffer (null-terminated), valid until the
+// next format() call in the same thread. It can be an argument of that call.
+std::string_view vformat(const char* format, const FormatArg* args, size_t count);
+// Does not use the buffer of vformat()
+std::string vformat_str(const char* format, const FormatArg* args, size_t count);
+
+template <typename... Args>
+size_t format_to(char* buffer, size_t size, const char* format, const Args&... args) {
+	const FormatArg list[] = {FormatArg(args)..., FormatArg()};
+	return vformat_to(buffer, size, format, list, sizeof...(Args));
+}
+
+template <typename... Args>
+std::string_view format(const char* format, const Args&... args) {
+	const FormatArg list[] = {FormatArg(args)..., FormatArg()};
+	return vformat(format, list, sizeof...(Args));
+}
+
+template <typename... Args>
+std::string format_str(const char* format, const Args&... args) {
+	const FormatArg list[] = {FormatArg(args)..., FormatArg()};
+	return vformat_str(format, list, sizeof...(Args));
+}
+
+// FormatArg type of an argument of type T (NONE if not supported)
+template <typename T>
+constexpr FormatArg::type_t format_arg_type() {
+	typedef typename std::decay<T>::type U;
+	if constexpr (std::is_same<U, bool>::value)
+		return FormatArg::BOOL;
+	else if constexpr (std::is_same<U, char>::value)
+		return FormatArg::CHAR;
+	else if constexpr (std::is_integral<U>::value)
+		return std::is_signed<U>::value ? FormatArg::INT : FormatArg::UINT;
+	else if constexpr (std::is_floating_point<U>::value)
+		return FormatArg::DOUBLE;
+	else if constexpr (std::is_convertible<U, std::string_view>::value)
+		return FormatArg::STRING;
+	else if constexpr (std::is_pointer<U>::value)
+		return FormatArg::POINTER;
+	else
+		return FormatArg::NONE;
+}
+
+typedef enum { FORMAT_OK, FORMAT_SYNTAX, FORMAT_SPEC, FORMAT_COUNT, FORMAT_TYPE } format_error_t;
+
+// Same grammar and type rules as vformat_to(), for the compile-time checks
+constexpr format_error_t format_check(const char* format, const FormatArg::type_t* types, size_t count) {
+	size_t arg = 0;
+	for (const char* p = format; *p; p++) {
+		if ((p[0] == '{' || p[0] == '}') && p[1] == p[0]) {
+			p++;
+			continue;
+		}
+		if (*p == '}')
+			return FORMAT_SYNTAX;
+		if (*p != '{')
+			continue;
+
+		p++;
+		bool precision = false;
+		char type = 0;
+		if (*p == ':') {
+			p++;
+			if (*p == '.') {
+				p++;
+				int digits = 0;
+				for (; digits < 3 && *p >= '0' && *p <= '9'; digits++)
+					p++;
+				if (digits == 0)
+					return FORMAT_SPEC;
+				precision = true;
+			}
+			if (*p == 'x' || *p == 'f' || *p == 'e' || *p == 'g')
+				type = *p++;
+		}
+		if (*p == '\0')
+			return FORMAT_SYNTAX;
+		if (*p != '}')
+			return FORMAT_SPEC;
+
+		if (arg >= count)
+			return FORMAT_COUNT;
+		auto t = types[arg++];
+		bool integer = (t == FormatArg::INT || t == FormatArg::UINT);
+		bool floating = (t == FormatArg::DOUBLE);
+		if ( t == FormatArg::NONE || (type == 'x' && !integer) ||
+		     ((type == 'f' || type == 'e' || type == 'g' || precision) && !floating) )
+			return FORMAT_TYPE;
+	}
+	return arg == count ? FORMAT_OK : FORMAT_COUNT;
+}
+
+template <typename... Args>
+struct FormatChecker {
+	static constexpr FormatArg::type_t types[] = {format_arg_type<Args>()..., FormatArg::NONE};
+	static constexpr format_error_t check(const char* format) { return format_check(format, types, sizeof...(Args)); }
+};
+
+template <typename... Args>
+FormatChecker<Args...> format_checker(const Args&...); // only for decltype
+
+#define ALUTILS_FORMAT_CHECK(format_, ...)                                                    \
+	constexpr alutils::format_error_t format_error_ =                                         \
+		decltype(alutils::format_checker(__VA_ARGS__))::check(format_);                       \
+	static_assert(format_error_ != alutils::FORMAT_SYNTAX, "unmatched brace in the format");  \
+	static_assert(format_error_ != alutils::FORMAT_SPEC,   "invalid placeholder spec");       \
+	static_assert(format_error_ != alutils::FORMAT_COUNT,  "number of format placeholders and arguments differ"); \
+	static_assert(format_error_ != alutils::FORMAT_TYPE,   "placeholder spec invalid for the argument type")
+
+#define ALUTILS_FORMAT(format_, ...)                                             \
+	([&]() { ALUTILS_FORMAT_CHECK(format_, ##__VA_ARGS__);                       \
+	         return alutils::format(format_, ##__VA_ARGS__); }())
+
+#define ALUTILS_FORMAT_TO(buffer_, size_, format_, ...)                          \
+	([&]() { ALUTILS_FORMAT_CHECK(format_, ##__VA_ARGS__);                       \
+	         return alutils::format_to(buffer_, size_, format_, ##__VA_ARGS__); }())
 
 ////////////////////////////////////////////////////////////////////////////////////
+// Regular expression compiled once, e.g. outside the loops over the lines of
+// a process output, and passed to ParseRE
+class Pattern {
+	std::string pattern;
+	std::regex  regex_;
+
+	public:
+	Pattern(const std::string& pattern);
+	const std::string& str() const { return pattern; }
+	const std::regex&  regex() const { return regex_; }
+};
+
+// Bounded LRU cache of compiled patterns, keyed by the pattern string.
+// Thread-safe. The returned patterns stay valid after their eviction.
+class PatternCache {
+	typedef std::list<std::shared_ptr<const Pattern>> list_t;
+
+	std::mutex                                             mutex;
+	size_t                                                 capacity;
+	list_t                                                 lru; // most recent first
+	std::unordered_map<std::string_view, list_t::iterator> index; // keys view Pattern::str()
+	uint64_t                                               hits = 0;
+	uint64_t                                               misses = 0;
+
+	public:
+	PatternCache(size_t capacity=128);
+	std::shared_ptr<const Pattern> get(const std::string& pattern);
+	void     setCapacity(size_t capacity);
+	size_t   size();
+	uint64_t getHits();
+	uint64_t getMisses();
+	void     clear();
+};
+
+// used by the ParseRE constructors that take pattern strings and by split_columns
+extern PatternCache pattern_cache;
+
 struct ParseRE {
 	bool        valid = false;
 	std::string value;
@@ -88,6 +441,60 @@ struct ParseRE {
 	ParseRE();
 	ParseRE(const std::string& source, const std::string& pattern);
 	ParseRE(const std::string& source, const std::string& pattern, std::string& dest);
+	ParseRE(const std::string& source, const Pattern& pattern);
+	ParseRE(const std::string& source, const Pattern& pattern, std::string& dest);
+};
+
+// Matcher for the common "<prefix>\s*(-?[0-9]+(\.[0-9]+)?)" shape, without
+// std::regex: the number after the first occurrence of prefix that is
+// followed by one. E.g.:
+//   PrefixNumberMatcher m("MemFree:"); uint64_t kb;
+//   if (m.match(line, kb)) ...
+class PrefixNumberMatcher {
+	std::string prefix;
+
+	public:
+	PrefixNumberMatcher(std::string_view prefix) : prefix(prefix) {}
+	bool match(std::string_view source, std::string_view& number) const; // number views source
+	template <typename T>
+	bool match(std::string_view source, T& value) const; // false if no number or it does not fit in T
+};
+
+////////////////////////////////////////////////////////////////////////////////////
+
+// FNV-1a hash of the 8 bytes of value (least significant first), as used by
+// YCSB to spread the key numbers
+uint64_t fnv1a64(uint64_t value);
+
+// Keys of storage benchmarks written from integers into caller buffers,
+// without allocations or format parsing:
+//   DECIMAL: prefix + key zero-padded to width digits ("user%012lu")
+//   BINARY:  prefix + last width bytes of the key in big-endian (width=0:
+//            8), so the keys sort like the integers
+// With hash=true, the key is replaced by fnv1a64(key) before the encoding.
+// Keys are encoded as unsigned integers.
+class KeyFormatter {
+	public:
+	typedef enum { DECIMAL, BINARY } encoding_t;
+
+	private:
+	std::string prefix;
+	uint32_t    width;
+	encoding_t  encoding;
+	bool        hash;
+	size_t      max_size;
+
+	public:
+	KeyFormatter(const std::string& prefix="", uint32_t width=0, encoding_t encoding=DECIMAL, bool hash=false);
+	size_t maxSize() const { return max_size; } // buffer size required by one key
+
+	size_t format(uint64_t key, char* buffer) const; // returns the key size (not null-terminated)
+	std::string_view format_view(uint64_t key, char* buffer) const { return std::string_view(buffer, format(key, buffer)); }
+	std::string str(uint64_t key) const;
+
+	// keys[i] is written at arena + i*maxSize() and out[i] views it
+	template <typename T>
+	void format_batch(const T* keys, size_t count, char* arena, std::string_view* out) const;
 };
 
 } // namespace alutils
@@ -0,0 +1,146 @@
+// Copyright (c) 2020-present, Adriano Lange.  All rights reserved.
+// This source code is licensed under both the GPLv2 (found in the
+// LICENSE.GPLv2 file in the root directory) and Apache 2.0 License
+// (found in the LICENSE.Apache file in the root directory).
+
+#include "alutils/arrival.h"
+
+#include "alutils/print.h"
+#include "alutils/internal.h"
+#include "alutils/string.h"
+#include "alutils/io.h"
+
+#include <stdexcept>
+#include <cmath>
+#include <cerrno>
+
+#include <time.h>
+#include <sys/prctl.h>
+
+namespace alutils {
+
+////////////////////////////////////////////////////////////////////////////////////
+#undef __CLASS__
+#define __CLASS__ "ArrivalProcess::"
+
+static inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__)
+	asm volatile("yield");
+#endif
+}
+
+// (0, 1]
+static inline double uniform_01_open(RandEngine* rand_engine) {
+	return (static_cast<double>(randUint64(rand_engine) >> 11) + 1.0) * 0x1.0p-53;
+}
+
+ArrivalProcess::ArrivalProcess(double rate, arrival_t type, MMPPParams mmpp, uint64_t spin_ns, RandEngine::type_t engine_type):
+	type(type), mmpp(mmpp), spin_ns(spin_ns)
+{
+	PRINT_DEBUG("rate = %s, type = %s, spin_ns = %s", v2s(rate), v2s(type), v2s(spin_ns));
+	setRate(rate);
+	if (type == ARRIVAL_MMPP) {
+		PRINT_DEBUG("burst_factor = %s, burst_fraction = %s, burst_duration = %s",
+		            v2s(mmpp.burst_factor), v2s(mmpp.burst_fraction), v2s(mmpp.burst_duration));
+		if (mmpp.burst_factor < 1 || mmpp.burst_fraction <= 0 || mmpp.burst_fraction >= 1 || mmpp.burst_duration <= 0)
+			throw std::invalid_argument("invalid MMPP parameters");
+	}
+	rand_engine = newRandEngine(engine_type);
+	start();
+}
+
+uint64_t ArrivalProcess::now() {
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+void ArrivalProcess::setTimerSlack(uint64_t slack_ns) {
+	PRINT_DEBUG("slack_ns = %s", v2s(slack_ns));
+	if (prctl(PR_SET_TIMERSLACK, static_cast<unsigned long>(slack_ns)) != 0)
+		throw std::runtime_error(sprintf("prctl(PR_SET_TIMERSLACK, %lu) failed: %s", slack_ns, strerror2(errno).c_str()));
+}
+
+void ArrivalProcess::setRate(double rate_) {
+	if (!(rate_ > 0) || std::isinf(rate_))
+		throw std::invalid_argument(sprintf("invalid arrival rate: %f", rate_));
+	rate.store(rate_, std::memory_order_relaxed);
+}
+
+double ArrivalProcess::getRate() {
+	return rate.load(std::memory_order_relaxed);
+}
+
+void ArrivalProcess::start(uint64_t start_ns) {
+	deadline = start_ns;
+}
+
+double ArrivalProcess::nextGapSeconds() {
+	const double r = rate.load(std::memory_order_relaxed);
+	switch (type) {
+		case ARRIVAL_UNIFORM:
+			return 2.0 * uniform_01_open(rand_engine.get()) / r;
+
+		case ARRIVAL_MMPP: {
+			// Exponential gaps are memoryless: when a gap crosses the end of
+			// the current state, the rest of it is drawn again in the new state.
+			const double normal_rate = r / (1.0 - mmpp.burst_fraction + mmpp.burst_fraction * mmpp.burst_factor);
+			const double normal_duration = mmpp.burst_duration * (1.0 - mmpp.burst_fraction) / mmpp.burst_fraction;
+			double gap = 0;
+			while (true) {
+				if (state_left <= 0) {
+					burst = !burst;
+					state_left = -std::log(uniform_01_open(rand_engine.get())) * (burst ? mmpp.burst_duration : normal_duration);
+				}
+				double state_rate = burst ? normal_rate * mmpp.burst_factor : normal_rate;
+				double g = -std::log(uniform_01_open(rand_engine.get())) / state_rate;
+				if (g <= state_left) {
+					state_left -= g;
+					return gap + g;
+				}
+				gap += state_left;
+				state_left = 0;
+			}
+		}
+
+		default:
+			return -std::log(uniform_01_open(rand_engine.get())) / r;
+	}
+}
+
+uint64_t ArrivalProcess::nextGap() {
+	return static_cast<uint64_t>(nextGapSeconds() * 1e9 + 0.5);
+}
+
+uint64_t ArrivalProcess::nextDeadline() {
+	deadline += nextGap();
+	return deadline;
+}
+
+void ArrivalProcess::next_batch(uint64_t* deadlines, size_t count) {
+	for (size_t i = 0; i < count; i++)
+		deadlines[i] = nextDeadline();
+}
+
+int64_t ArrivalProcess::wait(uint64_t* deadline_) {
+	const uint64_t d = nextDeadline();
+	if (deadline_ != nullptr)
+		*deadline_ = d;
+
+	uint64_t t = now();
+	if (t >= d)
+		return static_cast<int64_t>(t - d);
+
+	if (d - t > spin_ns) {
+		uint64_t wake = d - spin_ns;
+		timespec ts { static_cast<time_t>(wake / 1000000000ULL), static_cast<long>(wake % 1000000000ULL) };
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR);
+	}
+	while ((t = now()) < d)
+		cpu_relax();
+	return static_cast<int64_t>(t - d);
+}
+
+} // namespace alutils
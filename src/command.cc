@@ -9,6 +9,8 @@
 #include "alutils/print.h"
 
 #include <type_traits>
+#include <algorithm>
+#include <stdexcept>
 
 namespace alutils {
 
@@ -41,13 +43,22 @@ CmdTemplate<T>::~CmdTemplate(){
 template <typename T>
 void CmdTemplate<T>::test(const std::string& value) {
 	PRINT_DEBUG("test command=\"%s\", value=\"%s\"", name.c_str(), value.c_str());
-	parse<T>(value, required, default_, sprintf("test failed for the command \"%s\" value \"%s\"", name.c_str(), value.c_str()).c_str(), checker);
+	try {
+		parse<T>(value, required, default_, nullptr, checker);
+	} catch (const std::invalid_argument& e) { // message built only on errors
+		throw std::invalid_argument(sprintf("test failed for the command \"%s\" value \"%s\"", name.c_str(), value.c_str()));
+	}
 }
 
 template <typename T>
 void CmdTemplate<T>::set(const std::string& value) {
 	PRINT_DEBUG("set command=\"%s\", value=\"%s\"", name.c_str(), value.c_str());
-	T aux = parse<T>(value, required, default_, sprintf("invalid value for the command \"%s\": \"%s\"", name.c_str(), value.c_str()).c_str(), checker);
+	T aux;
+	try {
+		aux = parse<T>(value, required, default_, nullptr, checker);
+	} catch (const std::invalid_argument& e) {
+		throw std::invalid_argument(sprintf("invalid value for the command \"%s\": \"%s\"", name.c_str(), value.c_str()));
+	}
 	if (address)
 		*address = aux;
 	if (handler)
@@ -67,21 +78,23 @@ template class CmdTemplate<std::string>;
 #define __CLASS__ "ScriptCommand::"
 
 ScriptCommand::ScriptCommand(const std::string& str) {
-	const std::map<std::string, uint64_t> time_suffixes { {"s",1}, {"m",60} };
-
-	auto c2 = split_str(str, ":");
-	if (c2.size() > 2)
+	std::string_view src(str);
+	auto colon = src.find(':');
+	if (colon != std::string_view::npos && src.find(':', colon + 1) != std::string_view::npos)
 		throw std::runtime_error(sprintf("invalid command format: \"%s\"", str.c_str()));
 
-	if (c2.size() > 1) {
+	if (colon != std::string_view::npos) {
+		auto time_str = strip_view(src.substr(0, colon));
 		try {
-			time = parseUint64Suffix(c2[0], time_suffixes);
+			time = parseDuration(time_str);
 		} catch (const std::exception& e) {
-			throw std::runtime_error(sprintf("failed to parse time \"%s\": %s", c2[0].c_str(), e.what()));
+			throw std::runtime_error(sprintf("failed to parse time \"%.*s\": %s", (int)time_str.size(), time_str.data(), e.what()));
 		}
-		command = c2[1];
+		if (time.count() < 0)
+			throw std::runtime_error(sprintf("negative time \"%.*s\"", (int)time_str.size(), time_str.data()));
+		command = strip_view(src.substr(colon + 1));
 	} else {
-		command = c2[0];
+		command = strip_view(src);
 	}
 }
 
@@ -90,7 +103,7 @@ ScriptCommand::ScriptCommand(const std::string& str) {
 #define __CLASS__ "Commands::"
 
 Commands::Commands() {
-	time_ini = std::chrono::system_clock::now();
+	time_ini = std::chrono::steady_clock::now();
 }
 
 Commands::~Commands() {
@@ -124,26 +137,24 @@ void Commands::monitorScript(const std::string& script, bool reset_time) {
 	}
 
 	if (reset_time)
-		time_ini = std::chrono::system_clock::now();
+		time_ini = std::chrono::steady_clock::now();
 
 	// launch monitor thread
 	PRINT_DEBUG("launch monitor thread");
 	script_thread.reset(new ThreadController( [this](ThreadController::stop_t stop) {
 		auto time_ini = this->time_ini;
 
-		uint64_t time_elapsed;
-
-		for (auto c : this->parsed_script) {
-			// whait until stop or time_command <= time_elapsed
+		for (auto& c : this->parsed_script) {
+			// sleep until stop or the command time, checking stop at least every 100 ms
 			while (!stop()) {
-				time_elapsed = std::chrono::duration_cast<std::chrono::seconds>(
-						std::chrono::system_clock::now() - time_ini ).count();
+				auto time_elapsed = std::chrono::steady_clock::now() - time_ini;
 				if (c.time <= time_elapsed) {
-					PRINT_DEBUG("time_command=%s, time_elapsed=%s, executind command \"%s\"", std::to_string(c.time).c_str(), std::to_string(time_elapsed).c_str(), c.command.c_str());
+					PRINT_DEBUG("time_command=%.3fs, time_elapsed=%.3fs, executing command \"%s\"",
+					            std::chrono::duration<double>(c.time).count(), std::chrono::duration<double>(time_elapsed).count(), c.command.c_str());
 					this->parseCommand(c.command);
 					break;
 				}
-				std::this_thread::sleep_for(std::chrono::milliseconds(250));
+				std::this_thread::sleep_for(std::min<std::chrono::nanoseconds>(c.time - time_elapsed, std::chrono::milliseconds(100)));
 			}
 		}
 	} ) );
@@ -157,29 +168,30 @@ bool Commands::isScriptActive(bool throw_exception) {
 
 void Commands::parseCommand(const std::string& str, bool set_value) {
 	PRINT_DEBUG("str=\"%s\", set_value=%s", str.c_str(), std::to_string(set_value).c_str());
-	auto key_val = split_str(str, "=");
-	if (key_val.size() > 2)
+	std::string_view src(str);
+	auto equal = src.find('=');
+	if (equal != std::string_view::npos && src.find('=', equal + 1) != std::string_view::npos)
 		throw std::runtime_error(sprintf("invalid command format \"%s\"", str.c_str()));
 
-	std::string key = key_val[0];
-	std::string value = "";
-	if (key_val.size() >= 2)
-		value = key_val[1];
+	auto key = strip_view(src.substr(0, equal));
+	std::string value; // a std::string for CmdBase, without allocation for short values
+	if (equal != std::string_view::npos)
+		value = strip_view(src.substr(equal + 1));
 
-	PRINT_DEBUG("command=\"%s\", value=\"%s\"", key.c_str(), value.c_str());
+	PRINT_DEBUG("command=\"%.*s\", value=\"%s\"", (int)key.size(), key.data(), value.c_str());
 	for (auto i : cmd_list) {
 		if (i->name == key) {
 			if (set_value) {
 				i->set(value);
 				if (afterChange != nullptr)
-					afterChange(this, key, value);
+					afterChange(this, i->name, value);
 			} else {
 				i->test(value);
 			}
 			return;
 		}
 	}
-	throw std::runtime_error(sprintf("invalid command \"%s\"", key.c_str()));
+	throw std::runtime_error(sprintf("invalid command \"%.*s\"", (int)key.size(), key.data()));
 }
 
 void Commands::registerCmd( CmdBase* cmd ) {
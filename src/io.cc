@@ -11,6 +11,11 @@
 
 #include <stdexcept>
 
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 namespace alutils {
 
 ////////////////////////////////////////////////////////////////////////////////////
@@ -58,7 +63,7 @@ Poll::Poll(int fd_, uint32_t timeout_ms, bool throw_except) : fd(fd_) {
 		if (errno != EAGAIN && errno != EINTR) {
 			exception = true;
 			if (throw_except)
-				throw std::runtime_error(sprintf("poll syscall returned an error for file descriptor %d: %s", fd, strerror2(errno)).c_str());
+				throw std::runtime_error(sprintf("poll syscall returned an error for file descriptor %d: %s", fd, strerror2(errno).c_str()).c_str());
 		}
 	}
 }
@@ -87,4 +92,49 @@ bool Poll::is_error() {
 	return revents & error_events;
 }
 
+////////////////////////////////////////////////////////////////////////////////////
+#undef __CLASS__
+#define __CLASS__ "MMapFile::"
+
+MMapFile::MMapFile(const std::string& filename, bool populate) : filename(filename) {
+	int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		throw std::runtime_error(sprintf("error opening file \"%s\": %s", filename.c_str(), strerror2(errno).c_str()));
+
+	struct stat st;
+	if (fstat(fd, &st) == -1) {
+		int errno_ = errno;
+		close(fd);
+		throw std::runtime_error(sprintf("error reading the size of file \"%s\": %s", filename.c_str(), strerror2(errno_).c_str()));
+	}
+	length = st.st_size;
+
+	if (length > 0) { // mmap does not accept length 0
+		addr = mmap(nullptr, length, PROT_READ, MAP_PRIVATE | (populate ? MAP_POPULATE : 0), fd, 0);
+		if (addr == MAP_FAILED) {
+			int errno_ = errno;
+			addr = nullptr;
+			close(fd);
+			throw std::runtime_error(sprintf("error mapping file \"%s\": %s", filename.c_str(), strerror2(errno_).c_str()));
+		}
+	}
+	close(fd); // the mapping remains valid
+	PRINT_DEBUG("filename = %s, length = %lu", filename.c_str(), length);
+}
+
+MMapFile::~MMapFile() {
+	if (addr != nullptr && munmap(addr, length) == -1)
+		PRINT_ERROR("error unmapping file \"%s\": %s", filename.c_str(), strerror2(errno).c_str());
+}
+
+void MMapFile::adviseSequential() {
+	if (addr != nullptr)
+		madvise(addr, length, MADV_SEQUENTIAL);
+}
+
+void MMapFile::adviseRandom() {
+	if (addr != nullptr)
+		madvise(addr, length, MADV_RANDOM);
+}
+
 } // namespace alutils
@@ -0,0 +1,126 @@
+// Copyright (c) 2020-present, Adriano Lange.  All rights reserved.
+// This source code is licensed under both the GPLv2 (found in the
+// LICENSE.GPLv2 file in the root directory) and Apache 2.0 License
+// (found in the LICENSE.Apache file in the root directory).
+
+#include "alutils/payload.h"
+
+#include "alutils/print.h"
+#include "alutils/internal.h"
+#include "alutils/string.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include <cassert>
+
+namespace alutils {
+
+////////////////////////////////////////////////////////////////////////////////////
+#undef __CLASS__
+#define __CLASS__ "PayloadGenerator::"
+
+static const size_t payload_segment = 100;
+
+// offset in [0, range)
+static inline size_t fastrange(uint64_t r, size_t range) {
+	return static_cast<size_t>((static_cast<__uint128_t>(r) * range) >> 64);
+}
+
+PayloadGenerator::PayloadGenerator(payload_size_t size_type, size_t min_size, size_t max_size,
+                                   double compression_ratio, double theta, size_t pool_size):
+	size_type(size_type), min_size(min_size), max_size(max_size), compression_ratio(compression_ratio)
+{
+	PRINT_DEBUG("size_type         = %s", v2s(size_type));
+	PRINT_DEBUG("min_size          = %s", v2s(min_size));
+	PRINT_DEBUG("max_size          = %s", v2s(max_size));
+	PRINT_DEBUG("compression_ratio = %s", v2s(compression_ratio));
+
+	if (size_type == SIZE_FIXED)
+		this->min_size = min_size = max_size;
+	if (max_size == 0 || min_size > max_size)
+		throw std::invalid_argument(sprintf("invalid value sizes: min = %lu, max = %lu", min_size, max_size));
+	if (compression_ratio <= 0 || compression_ratio > 1)
+		throw std::invalid_argument(sprintf("invalid compression ratio: %f", compression_ratio));
+
+	if (size_type == SIZE_ZIPF && max_size > min_size)
+		zipf.reset(new RejectionInversionZipfDistribution<int64_t>(max_size - min_size + 1, theta));
+
+	pool_size = std::max(pool_size, std::max<size_t>(1 << 20, 2 * max_size));
+	PRINT_DEBUG("pool_size         = %s", v2s(pool_size));
+	pool.resize(pool_size);
+
+	auto rand_engine = newRandEngine();
+	const size_t raw_size = std::max<size_t>(1, static_cast<size_t>(payload_segment * compression_ratio));
+	char raw[payload_segment];
+	for (size_t pos = 0; pos < pool_size; pos += payload_segment) {
+		for (size_t i = 0; i < raw_size; i++)
+			raw[i] = ' ' + static_cast<char>(fastrange(randUint64(rand_engine.get()), 95)); // printable
+		size_t seg = std::min(payload_segment, pool_size - pos);
+		for (size_t i = 0; i < seg; i += raw_size)
+			std::memcpy(&pool[pos + i], raw, std::min(raw_size, seg - i));
+	}
+}
+
+PayloadGenerator::PayloadGenerator(size_t size, double compression_ratio):
+	PayloadGenerator(SIZE_FIXED, size, size, compression_ratio) {}
+
+size_t PayloadGenerator::nextSize(RandEngine* rand_engine) {
+	switch (size_type) {
+		case SIZE_UNIFORM:
+			if (rand_engine == nullptr)
+				rand_engine = default_rand_engines.get();
+			return min_size + fastrange(randUint64(rand_engine), max_size - min_size + 1);
+		case SIZE_ZIPF:
+			if (!zipf)
+				return min_size;
+			if (rand_engine == nullptr)
+				rand_engine = default_rand_engines.get();
+			return min_size + zipf->next(rand_engine) - 1;
+		default:
+			return max_size;
+	}
+}
+
+inline std::string_view PayloadGenerator::view(size_t size, RandEngine* rand_engine) {
+	size_t offset = fastrange(randUint64(rand_engine), pool.size() - size + 1);
+	return std::string_view(pool.data() + offset, size);
+}
+
+std::string_view PayloadGenerator::next(RandEngine* rand_engine) {
+	if (rand_engine == nullptr)
+		rand_engine = default_rand_engines.get();
+	return view(nextSize(rand_engine), rand_engine);
+}
+
+std::string_view PayloadGenerator::next(size_t size, RandEngine* rand_engine) {
+	if (size > max_size)
+		throw std::invalid_argument(sprintf("value size %lu above the maximum %lu", size, max_size));
+	if (rand_engine == nullptr)
+		rand_engine = default_rand_engines.get();
+	return view(size, rand_engine);
+}
+
+void PayloadGenerator::next_batch(std::string_view* out, size_t count, RandEngine* rand_engine) {
+	if (rand_engine == nullptr)
+		rand_engine = default_rand_engines.get();
+	for (size_t i = 0; i < count; i++)
+		out[i] = view(nextSize(rand_engine), rand_engine);
+}
+
+size_t PayloadGenerator::fill(char* buffer, size_t size, RandEngine* rand_engine) {
+	if (rand_engine == nullptr)
+		rand_engine = default_rand_engines.get();
+	for (size_t done = 0; done < size; ) {
+		auto v = view(std::min(size - done, max_size), rand_engine);
+		std::memcpy(buffer + done, v.data(), v.size());
+		done += v.size();
+	}
+	return size;
+}
+
+std::unique_ptr<RandEngine> PayloadGenerator::newEngine(RandEngine::type_t type) {
+	return newRandEngine(type);
+}
+
+} // namespace alutils
@@ -8,11 +8,43 @@
 
 #include <stdio.h>
 #include <stdarg.h>
+#include <vector>
+#include <memory>
 
 namespace alutils {
 
 void default_print_none(const char* format, ...) {}
 
+static thread_local std::vector<std::unique_ptr<std::vector<char>>> print_buffers;
+static thread_local size_t print_depth = 0;
+
+PrintMessage::PrintMessage(const char* format, va_list args) {
+	if (print_depth == print_buffers.size())
+		print_buffers.emplace_back(new std::vector<char>(1024));
+	auto& buffer = *print_buffers[print_depth++];
+
+	va_list args_copy;
+	va_copy(args_copy, args);
+	auto r = vsnprintf(buffer.data(), buffer.size(), format, args_copy);
+	va_end(args_copy);
+	if (r >= 0 && (size_t)r >= buffer.size()) {
+		buffer.resize(r + 1);
+		va_copy(args_copy, args);
+		r = vsnprintf(buffer.data(), buffer.size(), format, args_copy);
+		va_end(args_copy);
+	}
+	if (r < 0) {
+		buffer[0] = '\0';
+		r = 0;
+	}
+	data = buffer.data();
+	length = r;
+}
+
+PrintMessage::~PrintMessage() {
+	print_depth--;
+}
+
 ALUTILS_PRINT_WRAPPER(default_print_debug_out, fprintf(stderr, "OUTPUT: %s\n", msg.c_str()));
 ALUTILS_PRINT_WRAPPER(default_print_debug,     fprintf(stderr, "DEBUG: %s\n", msg.c_str()));
 ALUTILS_PRINT_WRAPPER(default_print_info,      fprintf(stderr, "INFO: %s\n", msg.c_str()));
@@ -73,14 +73,14 @@ std::string command_output(const char* cmd) {
 
 	auto exit_code = pclose(f);
 	if (exit_code != 0)
-		throw std::runtime_error(sprintf("command \"%s\" returned error %s", cmd, v2s(exit_code)));
+		throw std::runtime_error(format_str("command \"{}\" returned error {}", cmd, exit_code));
 
 	return ret;
 }
 
 std::vector<pid_t> get_children(pid_t pid, bool recursive) {
 	std::vector<pid_t> ret;
-	PRINT_DEBUG("parent pid: %s", v2s(pid));
+	PRINT_DEBUG("parent pid: %d", pid);
 
 	auto proc_tab = openproc(PROC_FILLSTAT);
 	while (auto proc_i = readproc(proc_tab, nullptr)) {
@@ -129,13 +129,13 @@ ProcessController::ProcessController(const char* name_, const char* cmd,
 	pid_t child_pid;
 	int pipe_stdin[2];
 	pipe(pipe_stdin);
-	PRINT_DEBUG("pipe_stdin=(%s, %s)", v2s(pipe_stdin[0]), v2s(pipe_stdin[1]));
+	PRINT_DEBUG("pipe_stdin=(%d, %d)", pipe_stdin[0], pipe_stdin[1]);
 	int pipe_stdout[2];
 	pipe(pipe_stdout);
-	PRINT_DEBUG("pipe_stdout=(%s, %s)", v2s(pipe_stdout[0]), v2s(pipe_stdout[1]));
+	PRINT_DEBUG("pipe_stdout=(%d, %d)", pipe_stdout[0], pipe_stdout[1]);
 	int pipe_stderr[2];
 	pipe(pipe_stderr);
-	PRINT_DEBUG("pipe_stderr=(%s, %s)", v2s(pipe_stderr[0]), v2s(pipe_stderr[1]));
+	PRINT_DEBUG("pipe_stderr=(%d, %d)", pipe_stderr[0], pipe_stderr[1]);
 
 	if ((child_pid = fork()) == -1)
 		throw std::runtime_error(std::string("fork error on process ")+name);
@@ -155,7 +155,7 @@ ProcessController::ProcessController(const char* name_, const char* cmd,
 
 	program_active = true;
 
-	PRINT_DEBUG("child pid=%s", v2s(child_pid));
+	PRINT_DEBUG("child pid=%d", child_pid);
 	pid   = child_pid;
 	close(pipe_stdin[0]);
 	if ((f_stdin  = fdopen(pipe_stdin[1], "w")) == NULL)
@@ -171,7 +171,7 @@ ProcessController::ProcessController(const char* name_, const char* cmd,
 	thread_stdout = std::thread( [this]{this->threadStdout();} );
 	thread_stderr_active = true;
 	thread_stderr = std::thread( [this]{this->threadStderr();} );
-	PRINT_DEBUG("constructor finished", name);
+	PRINT_DEBUG("constructor finished");
 }
 
 ProcessController::~ProcessController() {
@@ -179,12 +179,12 @@ ProcessController::~ProcessController() {
 
 	PRINT_DEBUG("check status");
 	if (checkStatus()) {
-		PRINT_WARN("process %s (pid %s) still active. kill it", name.c_str(), v2s(pid));
+		PRINT_WARN("process %s (pid %d) still active. kill it", name.c_str(), pid);
 		kill(pid, SIGTERM);
 		std::this_thread::sleep_for(std::chrono::milliseconds(100));
 		auto children = get_children(pid, true);
 		for (auto i: children) {
-			PRINT_WARN("child (pid %s) of process %s (pid %s) still active. kill it", v2s(i), name.c_str(), v2s(pid));
+			PRINT_WARN("child (pid %d) of process %s (pid %d) still active. kill it", i, name.c_str(), pid);
 			kill(i, SIGTERM);
 		}
 	}
@@ -208,7 +208,7 @@ ProcessController::~ProcessController() {
 	auto status_f_stdin = std::fclose(f_stdin);
 	auto status_f_stdout = std::fclose(f_stdout);
 	auto status_f_stderr = std::fclose(f_stderr);
-	PRINT_DEBUG("status_f_stdin=%s, status_f_stdout=%s, status_f_stderr=%s", v2s(status_f_stdin), v2s(status_f_stdout), v2s(status_f_stderr));
+	PRINT_DEBUG("status_f_stdin=%d, status_f_stdout=%d, status_f_stderr=%d", status_f_stdin, status_f_stdout, status_f_stderr);
 
 	PRINT_DEBUG("destructor finished");
 }
@@ -227,9 +227,9 @@ bool ProcessController::isActive(bool throwexcept) {
 	bool aux_status = checkStatus();
 	if (throwexcept && !aux_status) {
 		if (exit_code != 0)
-			throw std::runtime_error(sprintf("program %s exit code %s", name.c_str(), v2s(exit_code)));
+			throw std::runtime_error(format_str("program {} exit code {}", name, exit_code));
 		if (signal != 0)
-			throw std::runtime_error(sprintf("program %s exit with signal %s", name.c_str(), v2s(signal)));
+			throw std::runtime_error(format_str("program {} exit with signal {}", name, signal));
 	}
 	return thread_stdout_active && thread_stderr_active && aux_status;
 }
@@ -248,7 +248,7 @@ bool ProcessController::puts(const std::string value) noexcept {
 }
 
 void ProcessController::threadStdout() noexcept {
-	PRINT_DEBUG("initiated for process %s (pid %s)", name.c_str(), v2s(pid));
+	PRINT_DEBUG("initiated for process %s (pid %d)", name.c_str(), pid);
 	thread_stdout_active = true;
 
 	const uint buffer_size = 1024;
@@ -274,7 +274,7 @@ void ProcessController::threadStdout() noexcept {
 }
 
 void ProcessController::threadStderr() noexcept {
-	PRINT_DEBUG("initiated for process %s (pid %s)", name.c_str(), v2s(pid));
+	PRINT_DEBUG("initiated for process %s (pid %d)", name.c_str(), pid);
 	thread_stderr_active = true;
 
 	const uint buffer_size = 1024;
@@ -311,29 +311,29 @@ bool ProcessController::checkStatus() noexcept {
 		return true;
 	if (w == -1) {
 		program_active = false;
-		PRINT_CRITICAL("waitpid error for process %s (pid %s)", name.c_str(), v2s(pid));
+		PRINT_CRITICAL("waitpid error for process %s (pid %d)", name.c_str(), pid);
 		std::raise(SIGTERM);
 	}
 	if (WIFEXITED(status)) {
 		exit_code = WEXITSTATUS(status);
 		program_active = false;
-		std::string msg = sprintf("process %s (pid %s) exited, status=%s", name.c_str(), v2s(pid), v2s(exit_code));
-		if (exit_code != 0)
-			PRINT_WARN("%s", msg.c_str());
-		else
-			PRINT_DEBUG("%s", msg.c_str());
+		if (exit_code != 0) {
+			PRINT_WARN("process %s (pid %d) exited, status=%d", name.c_str(), pid, exit_code);
+		} else {
+			PRINT_DEBUG("process %s (pid %d) exited, status=%d", name.c_str(), pid, exit_code);
+		}
 		return false;
 	}
 	if (WIFSIGNALED(status)) {
 		signal = WTERMSIG(status);
 		program_active = false;
-		PRINT_WARN("process %s (pid %s) killed by signal %s", name.c_str(), v2s(pid), v2s(signal));
+		PRINT_WARN("process %s (pid %d) killed by signal %d", name.c_str(), pid, signal);
 		return false;
 	}
 	if (WIFSTOPPED(status)) {
 		signal = WSTOPSIG(status);
 		program_active = false;
-		PRINT_WARN("process %s (pid %s) stopped by signal %s", name.c_str(), v2s(pid), v2s(signal));
+		PRINT_WARN("process %s (pid %d) stopped by signal %d", name.c_str(), pid, signal);
 		return false;
 	}
 	program_active = (!WIFEXITED(status) && !WIFSIGNALED(status));
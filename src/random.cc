@@ -4,116 +4,771 @@
 // (found in the LICENSE.Apache file in the root directory).
 
 #include "alutils/print.h"
+#include "alutils/string.h"
 #include "alutils/internal.h"
 #include "alutils/random.h"
+#include "alutils/io.h"
+#include "alutils/command.h"
 
-#include <set>
 #include <algorithm>
 #include <chrono>
+#include <thread>
+#include <unordered_map>
+#include <limits>
+#include <functional>
+#include <vector>
+#include <cmath>
+#include <cfloat>
+#include <cstring>
 #include <cassert>
 
+#include <time.h>
+
 namespace alutils {
 
 ////////////////////////////////////////////////////////////////////////////////////
 #undef __CLASS__
 #define __CLASS__ ""
 
+// number of leading terms summed explicitly by zeta() before switching to the
+// Euler-Maclaurin approximation of the tail
+static const uint64_t zeta_explicit_terms = 1000;
+
+static double zeta_loop(uint64_t first, uint64_t last, double theta) {
+	double ans = 0;
+	for (double i=first; i<=last; i++)
+		ans += std::pow(1.0/i, theta);
+	return ans;
+}
+
+// Euler-Maclaurin approximation of sum_{i=a}^{b} i^-theta, a >= 2:
+//   integral_a^b f(x) dx + (f(a) + f(b))/2 + sum_k B_2k/(2k)! (f^(2k-1)(b) - f^(2k-1)(a))
+// using three correction terms. With a ~ 1000 the truncation error is far
+// below the double precision.
+static double zeta_em(uint64_t a_, uint64_t b_, double theta) {
+	const double a = a_, b = b_;
+	const double la = std::log(a), lb = std::log(b);
+	const double s = 1.0 - theta;
+
+	// integral of x^-theta, written with expm1 to stay accurate near theta == 1
+	double integral = (s == 0.0) ? lb - la
+	                : std::exp(s * la) * std::expm1(s * (lb - la)) / s;
+
+	auto f = [theta](double lx, double k) { return std::exp(-(theta + k) * lx); };
+	const double t1 = theta;
+	const double t3 = t1 * (theta + 1.0) * (theta + 2.0);
+	const double t5 = t3 * (theta + 3.0) * (theta + 4.0);
+
+	// f^(2k-1)(x) = -theta(theta+1)...(theta+2k-2) x^-(theta+2k-1)
+	double ans = integral + (f(la, 0) + f(lb, 0)) / 2.0;
+	ans += ( 1.0 /    12.0) * -t1 * (f(lb, 1) - f(la, 1));
+	ans += (-1.0 /   720.0) * -t3 * (f(lb, 3) - f(la, 3));
+	ans += ( 1.0 / 30240.0) * -t5 * (f(lb, 5) - f(la, 5));
+	return ans;
+}
+
+double zeta(uint64_t n, double theta) {
+	if (n <= zeta_explicit_terms)
+		return zeta_loop(1, n, theta);
+	return zeta_loop(1, zeta_explicit_terms - 1, theta) + zeta_em(zeta_explicit_terms, n, theta);
+}
+
+double zeta_range(uint64_t first, uint64_t last, double theta) {
+	if (first > last)
+		return 0;
+	if (last < zeta_explicit_terms || last - first < zeta_explicit_terms)
+		return zeta_loop(first, last, theta);
+	if (first < zeta_explicit_terms)
+		return zeta_loop(first, zeta_explicit_terms - 1, theta) + zeta_em(zeta_explicit_terms, last, theta);
+	return zeta_em(first, last, theta);
+}
+
+double zeta_exact(uint64_t n, double theta, uint32_t threads) {
+	if (threads == 0)
+		threads = std::max(std::thread::hardware_concurrency(), 1U);
+	if (n < 100000 || threads == 1)
+		return zeta_loop(1, n, theta);
+
+	std::vector<double>      partial(threads, 0.0);
+	std::vector<std::thread> workers;
+	const uint64_t chunk = n / threads;
+	for (uint32_t t = 0; t < threads; t++) {
+		uint64_t first = t * chunk + 1;
+		uint64_t last  = (t == threads - 1) ? n : (t + 1) * chunk;
+		workers.emplace_back([&partial, t, first, last, theta]{
+			partial[t] = zeta_loop(first, last, theta);
+		});
+	}
+	for (auto& w : workers)
+		w.join();
+
+	// add the smallest terms first
+	double ans = 0;
+	for (auto i = partial.rbegin(); i != partial.rend(); i++)
+		ans += *i;
+	return ans;
+}
+
+// Branch-free exp() and log() used by the batch sampling paths. They only
+// use arithmetic, bit operations and selects, so the compiler can vectorize
+// the loops that call them (std::exp and std::log cannot be). Both are
+// accurate to about one ulp. Clamping is done on the integer representation:
+// a floating point select followed by arithmetic prevents the vectorization.
+// The polynomials use Estrin's scheme: the vector loops are bound by the
+// latency of the longest dependency chain, which is 4 steps instead of the
+// 13 of Horner's scheme. With fma, a * b + c is one fused step.
+static const double ln2_hi = 6.93147180369123816490e-01;
+static const double ln2_lo = 1.90821492927058770002e-10;
+
+template <bool fma>
+static inline __attribute__((always_inline)) double madd(double a, double b, double c) {
+	return fma ? __builtin_fma(a, b, c) : a * b + c;
+}
+
+template <bool fma>
+static inline __attribute__((always_inline)) double batch_exp(double x) {
+	const double   round_magic = 6755399441055744.0;  // 1.5 * 2^52
+	const uint64_t round_bits  = 0x4338000000000000ULL;
+
+	double kd = madd<fma>(x, 1.44269504088896338700, round_magic); // x / ln(2), rounded
+	uint64_t ki;
+	std::memcpy(&ki, &kd, sizeof(ki));
+	kd -= round_magic;
+	double r = madd<fma>(-kd, ln2_lo, madd<fma>(-kd, ln2_hi, x)); // |r| <= ln(2)/2
+
+	// sum of r^i / i!, i <= 13
+	double r2 = r * r, r4 = r2 * r2, r8 = r4 * r4;
+	double a0 = 1.0 + r;
+	double a1 = madd<fma>(r, 1.0 / 6.0, 0.5);
+	double a2 = madd<fma>(r, 1.0 / 120.0, 1.0 / 24.0);
+	double a3 = madd<fma>(r, 1.0 / 5040.0, 1.0 / 720.0);
+	double a4 = madd<fma>(r, 1.0 / 362880.0, 1.0 / 40320.0);
+	double a5 = madd<fma>(r, 1.0 / 39916800.0, 1.0 / 3628800.0);
+	double a6 = madd<fma>(r, 1.0 / 6227020800.0, 1.0 / 479001600.0);
+	double b0 = madd<fma>(a1, r2, a0);
+	double b1 = madd<fma>(a3, r2, a2);
+	double b2 = madd<fma>(a5, r2, a4);
+	double p = madd<fma>(madd<fma>(a6, r4, b2), r8, madd<fma>(b1, r4, b0));
+
+	uint64_t scale_bits = (ki + 1023) << 52;  // 2^k
+	scale_bits = ki < round_bits - 1022 ? 0 : scale_bits;  // underflow to 0
+	scale_bits = ki > round_bits + 1023 ? 0x7ff0000000000000ULL : scale_bits; // overflow to inf
+	double scale;
+	std::memcpy(&scale, &scale_bits, sizeof(scale));
+	return p * scale;
+}
+
+// x must be positive; values below DBL_MIN are treated as DBL_MIN
+template <bool fma>
+static inline __attribute__((always_inline)) double batch_log(double x) {
+	const double   two_52       = 4503599627370496.0;
+	const uint64_t dbl_min_bits = 0x0010000000000000ULL;
+
+	const uint64_t sqrt2_bits   = 0x0006a09e667f3bcdULL; // mantissa of sqrt(2)
+
+	uint64_t bits, e_bits;
+	std::memcpy(&bits, &x, sizeof(bits));
+	bits = bits < dbl_min_bits ? dbl_min_bits : bits;
+
+	// x = m * 2^e, m in [sqrt(1/2), sqrt(2))
+	uint64_t mantissa = bits & 0x000fffffffffffffULL;
+	uint64_t adjust = mantissa > sqrt2_bits ? 1 : 0;
+	e_bits = ((bits >> 52) + adjust) | 0x4330000000000000ULL; // 2^52 + biased exponent
+	bits = mantissa | ((1023 - adjust) << 52);
+	double m, ed;
+	std::memcpy(&m, &bits, sizeof(m));
+	std::memcpy(&ed, &e_bits, sizeof(ed));
+	ed -= two_52 + 1023.0;
+
+	// log(m) = 2 atanh(s) = 2 (s + s^3/3 + s^5/5 + ...), |s| < 0.172
+	double s = (m - 1.0) / (m + 1.0);
+	double s2 = s * s;
+	// sum of s2^i / (2i + 1), i <= 10
+	double s4 = s2 * s2, s8 = s4 * s4;
+	double a0 = madd<fma>(s2, 1.0 / 3.0, 1.0);
+	double a1 = madd<fma>(s2, 1.0 / 7.0, 1.0 / 5.0);
+	double a2 = madd<fma>(s2, 1.0 / 11.0, 1.0 / 9.0);
+	double a3 = madd<fma>(s2, 1.0 / 15.0, 1.0 / 13.0);
+	double a4 = madd<fma>(s2, 1.0 / 19.0, 1.0 / 17.0);
+	double b2 = madd<fma>(madd<fma>(s4, 1.0 / 21.0, a4), s8, madd<fma>(a3, s4, a2));
+	double p = madd<fma>(b2, s8, madd<fma>(a1, s4, a0));
+	return madd<fma>(ed, ln2_hi, madd<fma>(2.0 * s, p, ed * ln2_lo));
+}
+
+// number of values generated per step by the batch sampling paths
+static const size_t batch_chunk = 256;
+
+// The kernels above need 64-bit integer compares (SSE4.2 or newer) to be
+// vectorized; otherwise std::pow and std::log are faster. Without -msse4.2
+// the batch paths select a kernel compiled for the running CPU once, at
+// their first call.
+struct BatchArgs {
+	double a, b;   // of the argument: a * x + b
+	double y;      // exponent (batch_pow)
+	double scale;  // of the result
+};
+
+typedef enum {
+	BATCH_LIBM,       // std::pow and std::log
+	BATCH_VECTOR,     // batch_exp and batch_log
+	BATCH_VECTOR_FMA  // batch_exp and batch_log with fused multiply-add
+} batch_math_t;
+
+// out[i] = scale * (a * x[i] + b)^y, or scale * log(a * x[i] + b) if ln
+template <bool ln, batch_math_t math>
+static inline __attribute__((always_inline)) void batch_loop(const double* __restrict x, size_t count, BatchArgs p, double* __restrict out) {
+	const bool fma = math == BATCH_VECTOR_FMA;
+	for (size_t i = 0; i < count; i++) {
+		double v = p.a * x[i] + p.b;
+		if (math == BATCH_LIBM)
+			out[i] = p.scale * (ln ? std::log(v) : std::pow(v, p.y));
+		else
+			out[i] = p.scale * (ln ? batch_log<fma>(v) : batch_exp<fma>(p.y * batch_log<fma>(v)));
+	}
+}
+
+// a constant trip count for full chunks lets the compiler vectorize the
+// loop also at -O2
+template <bool ln, batch_math_t math>
+static inline __attribute__((always_inline)) void batch_kernel(const double* __restrict x, size_t count, BatchArgs p, double* __restrict out) {
+	if (count == batch_chunk)
+		batch_loop<ln, math>(x, batch_chunk, p, out);
+	else
+		batch_loop<ln, math>(x, count, p, out);
+}
+
+template <bool ln>
+static void batch_kernel_default(const double* x, size_t count, BatchArgs p, double* out) {
+#if defined(__SSE4_2__) && defined(__FMA__)
+	batch_kernel<ln, BATCH_VECTOR_FMA>(x, count, p, out);
+#elif defined(__SSE4_2__)
+	batch_kernel<ln, BATCH_VECTOR>(x, count, p, out);
+#else
+	batch_kernel<ln, BATCH_LIBM>(x, count, p, out);
+#endif
+}
+
+#if (defined(__x86_64__) || defined(__i386__)) && !(defined(__AVX2__) && defined(__FMA__))
+template <bool ln>
+__attribute__((target("sse4.2")))
+static void batch_kernel_sse42(const double* x, size_t count, BatchArgs p, double* out) {
+	batch_kernel<ln, BATCH_VECTOR>(x, count, p, out);
+}
+
+template <bool ln>
+__attribute__((target("avx2,fma")))
+static void batch_kernel_avx2(const double* x, size_t count, BatchArgs p, double* out) {
+	batch_kernel<ln, BATCH_VECTOR_FMA>(x, count, p, out);
+}
+#define ALUTILS_BATCH_DISPATCH
+#endif
+
+typedef void (*batch_kernel_t)(const double* x, size_t count, BatchArgs p, double* out);
+
+template <bool ln>
+static batch_kernel_t select_batch_kernel() {
+#if defined(ALUTILS_BATCH_DISPATCH)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+		return batch_kernel_avx2<ln>;
+#if !defined(__SSE4_2__)
+	if (__builtin_cpu_supports("sse4.2"))
+		return batch_kernel_sse42<ln>;
+#endif
+#endif
+	return batch_kernel_default<ln>;
+}
+
+// out[i] = scale * (a * x[i] + b)^y, count <= batch_chunk, x and out must not overlap
+static void batch_pow(const double* x, size_t count, double a, double b, double y, double scale, double* out) {
+	static const batch_kernel_t kernel = select_batch_kernel<false>();
+	kernel(x, count, BatchArgs{a, b, y, scale}, out);
+}
+
+// out[i] = scale * log(a * x[i] + b), count <= batch_chunk, x and out must not overlap
+static void batch_ln(const double* x, size_t count, double a, double b, double scale, double* out) {
+	static const batch_kernel_t kernel = select_batch_kernel<true>();
+	kernel(x, count, BatchArgs{a, b, 0.0, scale}, out);
+}
+
 ////////////////////////////////////////////////////////////////////////////////////
 #undef __CLASS__
 #define __CLASS__ "RandEnginesImpl::"
 
-template <typename T>
+RandEngine::~RandEngine() {}
+
+RandEngine::type_t default_rand_engine_type = RandEngine::tXoshiro256ss;
+
+// splitmix64 finalizer
+static inline uint64_t mix64(uint64_t z) {
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+static inline uint64_t rotl(uint64_t x, int k) {
+	return (x << k) | (x >> (64 - k));
+}
+
+// https://prng.di.unimi.it/splitmix64.c
+struct SplitMix64 {
+	uint64_t s = 0;
+	void seed(uint64_t seed) { s = seed; }
+	uint64_t operator()() {
+		uint64_t z = (s += 0x9e3779b97f4a7c15ULL);
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+		return z ^ (z >> 31);
+	}
+};
+
+// https://prng.di.unimi.it/xoshiro256starstar.c
+struct Xoshiro256ss {
+	uint64_t s[4] = {0, 0, 0, 0};
+	void seed(uint64_t seed) {
+		SplitMix64 sm; sm.seed(seed);
+		for (auto& i : s)
+			i = sm();
+	}
+	uint64_t operator()() {
+		const uint64_t result = rotl(s[1] * 5, 7) * 9;
+		const uint64_t t = s[1] << 17;
+		s[2] ^= s[0];
+		s[3] ^= s[1];
+		s[1] ^= s[2];
+		s[0] ^= s[3];
+		s[2] ^= t;
+		s[3] = rotl(s[3], 45);
+		return result;
+	}
+};
+
+// PCG XSL-RR 128/64 (pcg64), https://www.pcg-random.org
+struct Pcg64 {
+	__uint128_t state = 0;
+	__uint128_t inc   = 1;
+	static constexpr __uint128_t mult = (static_cast<__uint128_t>(0x2360ed051fc65da4ULL) << 64) | 0x4385df649fccf645ULL;
+	void seed(uint64_t seed, uint64_t stream=0) {
+		SplitMix64 sm; sm.seed(seed);
+		inc = ((static_cast<__uint128_t>(stream) << 64 | sm()) << 1) | 1;
+		state = 0;
+		(*this)();
+		state += (static_cast<__uint128_t>(sm()) << 64) | sm();
+		(*this)();
+	}
+	uint64_t operator()() {
+		state = state * mult + inc;
+		uint64_t x = static_cast<uint64_t>(state >> 64) ^ static_cast<uint64_t>(state);
+		int rot = static_cast<int>(state >> 122);
+		return (x >> rot) | (x << ((-rot) & 63));
+	}
+};
+
+// Philox4x32-10 counter-based generator:
+// J. K. Salmon, et al. “Parallel random numbers: as easy as 1, 2, 3,” in
+// Proceedings of SC 2011.
+// The 128-bit counter is (block, substream), so output j of a substream is a
+// function of (key, substream, j) only, and seek() costs O(1). Each block
+// gives two 64-bit outputs.
+struct Philox4x32 {
+	uint32_t key[2] = {0, 0};
+	uint64_t substream = 0;
+	uint64_t block = 0;    // next block
+	uint64_t buf[2];
+	int      used = 2;     // outputs of buf already returned
+
+	void seed(uint64_t seed, uint64_t substream_=0) {
+		key[0] = static_cast<uint32_t>(seed);
+		key[1] = static_cast<uint32_t>(seed >> 32);
+		seek(substream_);
+	}
+	void seek(uint64_t substream_) {
+		substream = substream_;
+		block = 0;
+		used = 2;
+	}
+	void generate() {
+		uint32_t c[4] = { static_cast<uint32_t>(block), static_cast<uint32_t>(block >> 32),
+		                  static_cast<uint32_t>(substream), static_cast<uint32_t>(substream >> 32) };
+		uint32_t k[2] = { key[0], key[1] };
+		for (int r = 0; r < 10; r++) {
+			if (r > 0) {
+				k[0] += 0x9e3779b9U;
+				k[1] += 0xbb67ae85U;
+			}
+			uint64_t p0 = static_cast<uint64_t>(0xd2511f53U) * c[0];
+			uint64_t p1 = static_cast<uint64_t>(0xcd9e8d57U) * c[2];
+			uint32_t c1 = c[1], c3 = c[3];
+			c[0] = static_cast<uint32_t>(p1 >> 32) ^ c1 ^ k[0];
+			c[1] = static_cast<uint32_t>(p1);
+			c[2] = static_cast<uint32_t>(p0 >> 32) ^ c3 ^ k[1];
+			c[3] = static_cast<uint32_t>(p0);
+		}
+		buf[0] = static_cast<uint64_t>(c[1]) << 32 | c[0];
+		buf[1] = static_cast<uint64_t>(c[3]) << 32 | c[2];
+		block++;
+		used = 0;
+	}
+	uint64_t operator()() {
+		if (used == 2)
+			generate();
+		return buf[used++];
+	}
+};
+
+// All engines share the conversions of 64-bit outputs to doubles in [0, 1)
+// and to keys in [1, n]. Each engine stores only its own generator
+// (RandEngineGen<G>), and the batch methods run their loops in the concrete
+// class, so there is one virtual call per batch and not one per output.
 class RandEngineImpl : public RandEngine {
-	T n;
-	std::uniform_real_distribution<double> uniform_01_;    // both classes
-	std::uniform_int_distribution<T>       uniform_keys_;  // class ScrambledZipfDistribution
+	protected:
+	static inline double to_01(uint64_t x) {
+		return static_cast<double>(x >> 11) * 0x1.0p-53;
+	}
+
+	// Lemire's nearly divisionless method: x in [1, n]
+	template <typename G>
+	static inline uint64_t to_key(G& g, uint64_t range) {
+		__uint128_t m = static_cast<__uint128_t>(g()) * range;
+		uint64_t l = static_cast<uint64_t>(m);
+		if (l < range) {
+			uint64_t t = (-range) % range;
+			while (l < t) {
+				m = static_cast<__uint128_t>(g()) * range;
+				l = static_cast<uint64_t>(m);
+			}
+		}
+		return static_cast<uint64_t>(m >> 64) + 1;
+	}
+
+	public:
+	// UniformRandomBitGenerator requirements (used by std::shuffle)
+	typedef uint64_t result_type;
+	static constexpr result_type min() { return 0; }
+	static constexpr result_type max() { return UINT64_MAX; }
+
+	virtual void setSeed(uint64_t seed, uint64_t stream) = 0;
+	virtual bool seek(uint64_t /*substream*/) { return false; }
 
-	void setSeed() {
-		auto seed = static_cast<uint64_t>(std::chrono::system_clock::to_time_t(std::chrono::system_clock::now()));
-		seed += seed * 1000000;
-		PRINT_DEBUG("seed       = %s", v2s(seed));
-		reng.seed(seed);
+	virtual uint64_t operator()() = 0;
+	virtual double uniform_01() = 0;
+	virtual void uniform_01(double* out, size_t count) = 0;
+	virtual void uniform_64(uint64_t* out, size_t count) = 0;
+	virtual uint64_t uniform_key(uint64_t n) = 0;
+	virtual void uniform_keys(uint64_t* out, size_t count, uint64_t n) = 0;
+
+	template <typename T>
+	T uniform_keys(T n) {
+		assert( n > 0 );
+		return static_cast<T>(uniform_key(static_cast<uint64_t>(n)));
 	}
+};
 
+template <typename G>
+class alignas(64) RandEngineGen final : public RandEngineImpl {
 	public:
-	std::mt19937_64 reng;
-	RandEngineImpl() {
-		n = 0;
-		setSeed();
-	}
-	RandEngineImpl(T n): n(n) {
-		assert( n > 1 );
-		setSeed();
-		uniform_keys_ = std::uniform_int_distribution<T>(1, n);
-	}
-	double uniform_01()   { return uniform_01_(reng); }
-	double uniform_keys() {
+	G gen;
+
+	void setSeed(uint64_t seed, uint64_t stream) override;
+	bool seek(uint64_t /*substream*/) override { return false; }
+
+	uint64_t operator()() override { return gen(); }
+
+	double uniform_01() override { return to_01(gen()); }
+
+	void uniform_01(double* out, size_t count) override {
+		for (size_t i = 0; i < count; i++)
+			out[i] = to_01(gen());
+	}
+
+	void uniform_64(uint64_t* out, size_t count) override {
+		for (size_t i = 0; i < count; i++)
+			out[i] = gen();
+	}
+
+	uint64_t uniform_key(uint64_t n) override { return to_key(gen, n); }
+
+	void uniform_keys(uint64_t* out, size_t count, uint64_t n) override {
 		assert( n > 0 );
-		return uniform_keys_(reng);
+		for (size_t i = 0; i < count; i++)
+			out[i] = to_key(gen, n);
 	}
 };
 
+// 64-bit seed of a stream for the engines seeded by splitmix64: distinct
+// streams give distinct seeds (mix64 is a bijection)
+static inline uint64_t stream_seed(uint64_t seed, uint64_t stream) {
+	return seed ^ mix64(stream + 0x9e3779b97f4a7c15ULL);
+}
+
+template <>
+void RandEngineGen<Xoshiro256ss>::setSeed(uint64_t seed, uint64_t stream) {
+	gen.seed(stream_seed(seed, stream));
+}
+
+template <>
+void RandEngineGen<Pcg64>::setSeed(uint64_t seed, uint64_t stream) {
+	gen.seed(seed, stream);
+}
+
+template <>
+void RandEngineGen<SplitMix64>::setSeed(uint64_t seed, uint64_t stream) {
+	gen.seed(stream_seed(seed, stream));
+}
+
+template <>
+void RandEngineGen<Philox4x32>::setSeed(uint64_t seed, uint64_t stream) {
+	gen.seed(seed, stream);
+}
+
+template <>
+bool RandEngineGen<Philox4x32>::seek(uint64_t substream) {
+	gen.seek(substream);
+	return true;
+}
+
+template <>
+void RandEngineGen<std::mt19937_64>::setSeed(uint64_t seed, uint64_t stream) {
+	std::seed_seq seq { static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32),
+	                    static_cast<uint32_t>(stream), static_cast<uint32_t>(stream >> 32) };
+	gen.seed(seq);
+}
+
+static RandEngineImpl* newRandEngineImpl(RandEngine::type_t type) {
+	switch (type) {
+		case RandEngine::tXoshiro256ss: return new RandEngineGen<Xoshiro256ss>;
+		case RandEngine::tPCG64:        return new RandEngineGen<Pcg64>;
+		case RandEngine::tSplitMix64:   return new RandEngineGen<SplitMix64>;
+		case RandEngine::tMT19937_64:   return new RandEngineGen<std::mt19937_64>;
+		case RandEngine::tPhilox4x32:   return new RandEngineGen<Philox4x32>;
+	}
+	throw std::invalid_argument(alutils::sprintf("invalid engine type: %d", static_cast<int>(type)));
+}
+
 ////////////////////////////////////////////////////////////////////////////////////
 #undef __CLASS__
-#define __CLASS__ "ZipfDistribution::"
+#define __CLASS__ ""
 
-template <typename T>
-double ZipfDistribution<T>::zeta(T n, double theta) {
-	double ans = 0;
-	for (double i=1; i<=n; i++)
-		ans += std::pow(1.0/i, theta);
-	return ans;
+static std::mutex   rand_seed_mutex;
+static bool         rand_seed_set = false;
+static uint64_t     rand_seed     = 0;
+static uint64_t     rand_stream   = 0;          // next stream
+
+static void init_rand_seed() { // rand_seed_mutex must be locked
+	if (rand_seed_set)
+		return;
+	std::random_device rd;
+	rand_seed = (static_cast<uint64_t>(rd()) << 32) ^ rd()
+	          ^ static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+	rand_seed_set = true;
+	rand_stream = 0;
+	PRINT_DEBUG("master seed = %s", v2s(rand_seed));
+}
+
+void setRandSeed(uint64_t seed) {
+	std::lock_guard<std::mutex> lock(rand_seed_mutex);
+	PRINT_DEBUG("master seed = %s", v2s(seed));
+	rand_seed = seed;
+	rand_seed_set = true;
+	rand_stream = 0;
+}
+
+uint64_t getRandSeed() {
+	std::lock_guard<std::mutex> lock(rand_seed_mutex);
+	init_rand_seed();
+	return rand_seed;
+}
+
+std::unique_ptr<RandEngine> newRandEngine(RandEngine::type_t type) {
+	std::lock_guard<std::mutex> lock(rand_seed_mutex);
+	init_rand_seed();
+	PRINT_DEBUG("type = %s, stream = %s", v2s(type), v2s(rand_stream));
+	std::unique_ptr<RandEngineImpl> ret(newRandEngineImpl(type));
+	ret->setSeed(rand_seed, rand_stream);
+	rand_stream++;
+	return ret;
+}
+
+std::unique_ptr<RandEngine> newRandEngine(uint64_t stream, RandEngine::type_t type) {
+	uint64_t seed;
+	{
+		std::lock_guard<std::mutex> lock(rand_seed_mutex);
+		init_rand_seed();
+		seed = rand_seed;
+	}
+	PRINT_DEBUG("type = %s, stream = %s", v2s(type), v2s(stream));
+	std::unique_ptr<RandEngineImpl> ret(newRandEngineImpl(type));
+	ret->setSeed(seed, stream);
+	return ret;
+}
+
+uint64_t randUint64(RandEngine* rand_engine) {
+	return (*static_cast<RandEngineImpl*>(rand_engine))();
+}
+
+void randUint64(RandEngine* rand_engine, uint64_t* out, size_t count) {
+	static_cast<RandEngineImpl*>(rand_engine)->uniform_64(out, count);
+}
+
+std::unique_ptr<RandEngine> newCounterRandEngine(uint64_t seed, uint64_t substream) {
+	std::unique_ptr<RandEngineImpl> ret(new RandEngineGen<Philox4x32>);
+	ret->setSeed(seed, substream);
+	return ret;
+}
+
+void seekRandEngine(RandEngine* rand_engine, uint64_t substream) {
+	if (!static_cast<RandEngineImpl*>(rand_engine)->seek(substream))
+		throw std::invalid_argument("seekRandEngine() requires an engine of type tPhilox4x32");
 }
 
+////////////////////////////////////////////////////////////////////////////////////
+#undef __CLASS__
+#define __CLASS__ "PerThread::"
+
+static std::atomic<uint64_t> per_thread_id {0};
+
+uint64_t newPerThreadId() {
+	return ++per_thread_id;
+}
+
+////////////////////////////////////////////////////////////////////////////////////
+#undef __CLASS__
+#define __CLASS__ "ZipfDistribution::"
+
 template <typename T>
-ZipfDistribution<T>::ZipfDistribution(T n, double theta): n(n), theta(theta) {
+ZipfDistribution<T>::ZipfDistribution(T n, double theta, bool exact_zeta): theta(theta), exact_zeta(exact_zeta), n(n) {
 	PRINT_DEBUG("n          = %s", v2s(n));
 	PRINT_DEBUG("theta      = %s", v2s(theta));
+	PRINT_DEBUG("exact_zeta = %s", v2s(exact_zeta));
 	assert(n > 1);
 	assert(theta > 0);
 
-	default_rand_engine.reset(new RandEngineImpl<T>);
-
 	alpha = 1.0 / (1.0 - theta);
 	PRINT_DEBUG("alpha      = %s", v2s(alpha));
 
-	zeta_n = zeta(n, theta);
-	PRINT_DEBUG("zeta_n     = %s", v2s(zeta_n));
+	half_pow_theta = std::pow(0.5, theta);
+
+	double zeta_n_ = exact_zeta ? zeta_exact(n, theta) : zeta(n, theta);
+	zeta_n.store(zeta_n_);
+	PRINT_DEBUG("zeta_n     = %s", v2s(zeta_n_));
 
 	zeta_theta = zeta(2, theta);
 	PRINT_DEBUG("zeta_theta = %s", v2s(zeta_theta));
 
-	eta = (1.0 - std::pow(2.0 / static_cast<double>(n), 1.0 - theta))
-	    / (1.0 - zeta_theta / zeta_n);
-	PRINT_DEBUG("eta        = %s", v2s(eta));
+	double eta_ = calcEta(n, zeta_n_);
+	eta.store(eta_);
+	PRINT_DEBUG("eta        = %s", v2s(eta_));
+}
+
+template <typename T>
+double ZipfDistribution<T>::calcEta(T n, double zeta_n) {
+	return (1.0 - std::pow(2.0 / static_cast<double>(n), 1.0 - theta))
+	     / (1.0 - zeta_theta / zeta_n);
+}
+
+template <typename T>
+void ZipfDistribution<T>::load(T& n_, double& zeta_n_, double& eta_) {
+	uint64_t v1, v2;
+	do {
+		v1 = version.load(std::memory_order_acquire);
+		n_      = n.load(std::memory_order_relaxed);
+		zeta_n_ = zeta_n.load(std::memory_order_relaxed);
+		eta_    = eta.load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		v2 = version.load(std::memory_order_relaxed);
+	} while (v1 != v2 || (v1 & 1) != 0);
+}
+
+template <typename T>
+void ZipfDistribution<T>::grow(T new_n) {
+	if (new_n <= n.load(std::memory_order_relaxed))
+		return;
+	std::lock_guard<std::mutex> lock(grow_mutex);
+	T old_n = n.load(std::memory_order_relaxed);
+	if (new_n <= old_n)
+		return;
+
+	double old_zeta_n = zeta_n.load(std::memory_order_relaxed);
+	double new_zeta_n = old_zeta_n + (exact_zeta ? zeta_loop(old_n + 1, new_n, theta)
+	                                             : zeta_range(old_n + 1, new_n, theta));
+	double new_eta = calcEta(new_n, new_zeta_n);
+
+	auto v = version.load(std::memory_order_relaxed);
+	version.store(v + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	n.store(new_n, std::memory_order_relaxed);
+	zeta_n.store(new_zeta_n, std::memory_order_relaxed);
+	eta.store(new_eta, std::memory_order_relaxed);
+	version.store(v + 2, std::memory_order_release);
+}
+
+template <typename T>
+T ZipfDistribution<T>::getN() {
+	return n.load();
+}
+
+template <typename T>
+double ZipfDistribution<T>::getZetaN() {
+	return zeta_n.load();
 }
 
 template <typename T>
 T ZipfDistribution<T>::next(RandEngine* rand_engine) {
 	T ret;
 	double u;
+	T n_; double zeta_n_, eta_;
+	load(n_, zeta_n_, eta_);
 
 	if (rand_engine != nullptr)
-		u = reinterpret_cast<RandEngineImpl<T>*>(rand_engine)->uniform_01();
+		u = static_cast<RandEngineImpl*>(rand_engine)->uniform_01();
 	else
-		u = reinterpret_cast<RandEngineImpl<T>*>(default_rand_engine.get())->uniform_01();
+		u = static_cast<RandEngineImpl*>(default_rand_engines.get())->uniform_01();
 
-	double uz = u * zeta_n;
+	double uz = u * zeta_n_;
 
 	if (uz < 1.0)
 		ret = 1;
-	else if (uz < 1.0 + std::pow(0.5, theta))
+	else if (uz < 1.0 + half_pow_theta)
 		ret = 2;
 	else
-		ret = 1 + static_cast<T>(static_cast<double>(n) * std::pow(eta*u - eta +1.0, alpha));
+		ret = 1 + static_cast<T>(static_cast<double>(n_) * std::pow(eta_*u - eta_ +1.0, alpha));
 
-	assert( ret >= 1 && ret <= n );
+	assert( ret >= 1 && ret <= n_ );
 	return ret;
 }
 
 template <typename T>
-RandEngine* ZipfDistribution<T>::newEngine() {
-	return new RandEngineImpl<T>();
+void ZipfDistribution<T>::next_batch(T* out, size_t count, RandEngine* rand_engine) {
+	auto rand_engine_impl = static_cast<RandEngineImpl*>(
+			rand_engine != nullptr ? rand_engine : default_rand_engines.get());
+	T n_; double zeta_n_, eta_;
+	load(n_, zeta_n_, eta_);
+
+	const double n_d = static_cast<double>(n_);
+	const double limit_2 = 1.0 + half_pow_theta;
+	double u[batch_chunk];
+	double v[batch_chunk];
+
+	for (size_t done = 0; done < count; ) {
+		size_t c = std::min(count - done, batch_chunk);
+		rand_engine_impl->uniform_01(u, c);
+
+		batch_pow(u, c, eta_, 1.0 - eta_, alpha, n_d, v);
+
+		T* o = out + done;
+		for (size_t i = 0; i < c; i++) {
+			double uz = u[i] * zeta_n_;
+			double r = v[i] < n_d - 1.0 ? v[i] : n_d - 1.0;
+			r = uz < 1.0 ? 0.0 : (uz < limit_2 ? 1.0 : r);
+			o[i] = 1 + static_cast<T>(r);
+		}
+		done += c;
+	}
+}
+
+template <typename T>
+std::unique_ptr<RandEngine> ZipfDistribution<T>::newEngine(RandEngine::type_t type) {
+	return newRandEngine(type);
 }
 
 
@@ -122,56 +777,2117 @@ template class ZipfDistribution<int64_t>;
 
 ////////////////////////////////////////////////////////////////////////////////////
 #undef __CLASS__
-#define __CLASS__ "ScrambledZipfDistribution::"
+#define __CLASS__ "RejectionInversionZipfDistribution::"
+
+// log1p(x)/x, accurate also for x near 0
+static inline double helper1(double x) {
+	if (std::fabs(x) > 1e-8)
+		return std::log1p(x) / x;
+	return 1.0 - x * (0.5 - x * (1.0/3.0 - 0.25 * x));
+}
+
+// expm1(x)/x, accurate also for x near 0
+static inline double helper2(double x) {
+	if (std::fabs(x) > 1e-8)
+		return std::expm1(x) / x;
+	return 1.0 + x * 0.5 * (1.0 + x * (1.0/3.0) * (1.0 + 0.25 * x));
+}
+
+// h(x) = 1/x^theta
+static inline double ri_h(double theta, double x) {
+	return std::exp(-theta * std::log(x));
+}
+
+// H(x) = (x^(1-theta) - 1)/(1 - theta), or log(x) when theta == 1
+static inline double ri_hIntegral(double theta, double x) {
+	double log_x = std::log(x);
+	return helper2((1.0 - theta) * log_x) * log_x;
+}
+
+static inline double ri_hIntegralInverse(double theta, double x) {
+	double t = x * (1.0 - theta);
+	if (t < -1.0)
+		t = -1.0; // limit the value to the domain of log1p, due to rounding
+	return std::exp(helper1(t) * x);
+}
 
 template <typename T>
-ScrambledZipfDistribution<T>::ScrambledZipfDistribution(T n, T sample_size, double theta): n(n), sample_size(sample_size) {
-	PRINT_DEBUG("n           = %s", v2s(n));
-	PRINT_DEBUG("sample_size = %s", v2s(sample_size));
-	PRINT_DEBUG("theta       = %s", v2s(theta));
-	assert(sample_size > 0 && sample_size <= n);
+RejectionInversionZipfDistribution<T>::RejectionInversionZipfDistribution(T n, double theta): n(n), theta(theta) {
+	PRINT_DEBUG("n             = %s", v2s(n));
+	PRINT_DEBUG("theta         = %s", v2s(theta));
+	assert(n > 1);
+	assert(theta > 0);
+
+	h_integral_x1 = hIntegral(1.5) - 1.0;
+	h_integral_n  = hIntegral(static_cast<double>(n) + 0.5);
+	s = 2.0 - hIntegralInverse(hIntegral(2.5) - h(2.0));
+	PRINT_DEBUG("h_integral_x1 = %s", v2s(h_integral_x1));
+	PRINT_DEBUG("h_integral_n  = %s", v2s(h_integral_n));
+	PRINT_DEBUG("s             = %s", v2s(s));
+}
 
-	auto rand_engine_impl = new RandEngineImpl<T>(n);
-	default_rand_engine.reset(rand_engine_impl);
+template <typename T>
+inline double RejectionInversionZipfDistribution<T>::h(double x) {
+	return ri_h(theta, x);
+}
 
-	zipf.reset(new ZipfDistribution<T>(n, theta));
+template <typename T>
+inline double RejectionInversionZipfDistribution<T>::hIntegral(double x) {
+	return ri_hIntegral(theta, x);
+}
 
-	if (sample_size <= (T)((double)n*0.8)) {
-		std::set<T> used_keys;
-		while (used_keys.size() <= sample_size) {
-			auto key = rand_engine_impl->uniform_keys();
-			if (used_keys.count(key) == 0) {
-				used_keys.insert(key);
-				sample_list.push_back(key);
-			}
+template <typename T>
+inline double RejectionInversionZipfDistribution<T>::hIntegralInverse(double x) {
+	return ri_hIntegralInverse(theta, x);
+}
+
+template <typename T>
+T RejectionInversionZipfDistribution<T>::next(RandEngine* rand_engine) {
+	auto rand_engine_impl = static_cast<RandEngineImpl*>(
+			rand_engine != nullptr ? rand_engine : default_rand_engines.get());
+
+	while (true) {
+		double u = h_integral_n + rand_engine_impl->uniform_01() * (h_integral_x1 - h_integral_n);
+		double x = hIntegralInverse(u);
+		T k = static_cast<T>(x + 0.5);
+
+		if (k < 1)
+			k = 1;
+		else if (k > n)
+			k = n;
+
+		if (k - x <= s || u >= hIntegral(k + 0.5) - h(k))
+			return k;
+	}
+}
+
+template <typename T>
+void RejectionInversionZipfDistribution<T>::next_batch(T* out, size_t count, RandEngine* rand_engine) {
+	auto rand_engine_impl = static_cast<RandEngineImpl*>(
+			rand_engine != nullptr ? rand_engine : default_rand_engines.get());
+	double u[batch_chunk];
+	size_t used = batch_chunk;
+
+	for (size_t i = 0; i < count; ) {
+		if (used == batch_chunk) {
+			rand_engine_impl->uniform_01(u, batch_chunk);
+			used = 0;
 		}
-	} else {
-		for ( T i = 1; i<=n; i++)
-			sample_list.push_back(i);
-		std::shuffle(sample_list.begin(), sample_list.end(), rand_engine_impl->reng);
+		double v = h_integral_n + u[used++] * (h_integral_x1 - h_integral_n);
+		double x = hIntegralInverse(v);
+		T k = static_cast<T>(x + 0.5);
+
+		if (k < 1)
+			k = 1;
+		else if (k > n)
+			k = n;
+
+		if (k - x <= s || v >= hIntegral(k + 0.5) - h(k))
+			out[i++] = k;
 	}
+}
+
+template <typename T>
+std::unique_ptr<RandEngine> RejectionInversionZipfDistribution<T>::newEngine(RandEngine::type_t type) {
+	return newRandEngine(type);
+}
+
+template class RejectionInversionZipfDistribution<int32_t>;
+template class RejectionInversionZipfDistribution<int64_t>;
+
+////////////////////////////////////////////////////////////////////////////////////
+#undef __CLASS__
+#define __CLASS__ "CdfZipfDistribution::"
+
+// The CDF values are P(key <= i) * (2^32 - 1), for i in [1, n-1], padded
+// with UINT32_MAX. Samples are in [0, 2^32 - 2], so a sample u gives the key
+// 1 + (number of CDF values <= u).
+static const size_t   cdf_group_size  = 16;
+static const uint32_t cdf_version     = 1;
+static const char     cdf_magic[8]    = "ALZCDF";
+
+struct CdfHeader {        // 64 bytes, so the groups are aligned to cache lines
+	char     magic[8];
+	uint32_t version;
+	uint32_t height;
+	uint64_t n;
+	uint64_t groups;
+	double   theta;
+	uint8_t  reserved[24];
+};
+static_assert(sizeof(CdfHeader) == 64, "unexpected padding in CdfHeader");
 
-	PRINT_DEBUG("sample_list size: %s", v2s(sample_size * sizeof(sample_size)));
+// storage with its data aligned to 64 bytes
+static uint32_t* cdf_alloc(std::vector<uint32_t>& storage, size_t count) {
+	storage.assign(count + cdf_group_size, UINT32_MAX);
+	uintptr_t addr = reinterpret_cast<uintptr_t>(storage.data());
+	return storage.data() + ((64 - addr % 64) % 64) / sizeof(uint32_t);
 }
 
 template <typename T>
-T ScrambledZipfDistribution<T>::next(RandEngine* rand_engine) {
-	auto r = zipf->next(rand_engine);
-	if (r <= sample_size)
-		return sample_list[r-1];
+CdfZipfDistribution<T>::CdfZipfDistribution(T n, double theta, uint32_t threads): n(n), theta(theta) {
+	PRINT_DEBUG("n      = %s", v2s(n));
+	PRINT_DEBUG("theta  = %s", v2s(theta));
+	assert(n > 1);
+	assert(theta > 0);
 
-	if (rand_engine != nullptr)
-		return reinterpret_cast<RandEngineImpl<T>*>(rand_engine)->uniform_keys();
-	else
-		return reinterpret_cast<RandEngineImpl<T>*>(default_rand_engine.get())->uniform_keys();
+	const uint64_t values = static_cast<uint64_t>(n) - 1;
+	groups = (values + cdf_group_size - 1) / cdf_group_size;
+	height = 0;
+	while ((1ULL << height) - 1 < groups - 1)
+		height++;
+	PRINT_DEBUG("groups = %s, height = %s", v2s(groups), v2s(height));
+
+	uint32_t* data = cdf_alloc(storage, groups * cdf_group_size + (1ULL << height));
+	uint32_t* cdf_ = data;
+	uint32_t* tree_ = data + groups * cdf_group_size;
+
+	const long double scale = 4294967295.0L / zeta_exact(n, theta, threads);
+	long double sum = 0;
+	for (uint64_t i = 1; i <= values; i++) {
+		sum += std::pow(static_cast<double>(i), -theta);
+		long double v = sum * scale + 0.5L;
+		cdf_[i-1] = v >= 4294967295.0L ? UINT32_MAX : static_cast<uint32_t>(v);
+	}
+
+	// in-order fill of the tree with the first values of groups 1..groups-1
+	uint64_t next_group = 1;
+	std::function<void(uint64_t)> fill = [&](uint64_t k) {
+		if (k >= (1ULL << height))
+			return;
+		fill(2 * k);
+		tree_[k] = next_group < groups ? cdf_[next_group * cdf_group_size] : UINT32_MAX;
+		next_group++;
+		fill(2 * k + 1);
+	};
+	fill(1);
+
+	cdf = cdf_;
+	tree = tree_;
 }
 
 template <typename T>
-RandEngine* ScrambledZipfDistribution<T>::newEngine() {
-	return new RandEngineImpl<T>(n);
+CdfZipfDistribution<T>::CdfZipfDistribution(const std::string& cdf_file) {
+	PRINT_DEBUG("cdf_file = %s", cdf_file.c_str());
+	file.reset(new MMapFile(cdf_file));
+	auto invalid = [&cdf_file](const char* reason) {
+		return std::runtime_error(sprintf("invalid CDF file \"%s\": %s", cdf_file.c_str(), reason));
+	};
+
+	CdfHeader header;
+	if (file->size() < sizeof(header))
+		throw invalid("bad header");
+	std::memcpy(&header, file->data(), sizeof(header));
+	if (std::memcmp(header.magic, cdf_magic, sizeof(cdf_magic)) != 0 || header.version != cdf_version)
+		throw invalid("bad header");
+	if (header.n < 2 || header.n > static_cast<uint64_t>(std::numeric_limits<T>::max()) || header.height > 40 ||
+	    header.groups != (header.n - 1 + cdf_group_size - 1) / cdf_group_size ||
+	    file->size() != sizeof(header) + (header.groups * cdf_group_size + (1ULL << header.height)) * sizeof(uint32_t))
+		throw invalid("bad size");
+
+	n      = static_cast<T>(header.n);
+	theta  = header.theta;
+	groups = header.groups;
+	height = header.height;
+	cdf    = file->data<uint32_t>() + sizeof(header) / sizeof(uint32_t);
+	tree   = cdf + groups * cdf_group_size;
+	file->adviseRandom();
+	PRINT_DEBUG("n = %s, theta = %s, groups = %s, height = %s", v2s(n), v2s(theta), v2s(groups), v2s(height));
 }
 
-template class ScrambledZipfDistribution<int32_t>;
-template class ScrambledZipfDistribution<int64_t>;
+template <typename T>
+CdfZipfDistribution<T>::~CdfZipfDistribution() {}
+
+template <typename T>
+void CdfZipfDistribution<T>::save(const std::string& cdf_file) {
+	PRINT_DEBUG("cdf_file = %s", cdf_file.c_str());
+	CdfHeader header {};
+	std::memcpy(header.magic, cdf_magic, sizeof(cdf_magic));
+	header.version = cdf_version;
+	header.height  = height;
+	header.n       = static_cast<uint64_t>(n);
+	header.groups  = groups;
+	header.theta   = theta;
+
+	FILE* f = fopen(cdf_file.c_str(), "w");
+	if (f == nullptr)
+		throw std::runtime_error(sprintf("error opening CDF file \"%s\": %s", cdf_file.c_str(), strerror2(errno).c_str()));
+	size_t count = groups * cdf_group_size + (1ULL << height); // tree follows the groups
+	bool ok = fwrite(&header, sizeof(header), 1, f) == 1
+	       && fwrite(cdf, sizeof(uint32_t), count, f) == count;
+	int errno_ = errno;
+	ok = (fclose(f) == 0) && ok;
+	if (!ok)
+		throw std::runtime_error(sprintf("error writing CDF file \"%s\": %s", cdf_file.c_str(), strerror2(errno_).c_str()));
+}
+
+// the tree has exactly height levels (padded with UINT32_MAX), so the
+// final node index is the number of groups whose first value is <= u
+template <typename T>
+inline T CdfZipfDistribution<T>::search(uint32_t u) const {
+	uint64_t k = 1;
+	for (uint32_t l = 0; l < height; l++)
+		k = 2 * k + (tree[k] <= u);
+	const uint32_t* group = cdf + (k - (1ULL << height)) * cdf_group_size;
+	uint32_t c = 0;
+	for (size_t i = 0; i < cdf_group_size; i++)
+		c += group[i] <= u;
+	return static_cast<T>((k - (1ULL << height)) * cdf_group_size + c + 1);
+}
+
+static inline uint32_t cdf_sample(uint64_t r) { // [0, 2^32 - 2]
+	return static_cast<uint32_t>(((r >> 32) * 0xffffffffULL) >> 32);
+}
+
+template <typename T>
+T CdfZipfDistribution<T>::next(RandEngine* rand_engine) {
+	auto rand_engine_impl = static_cast<RandEngineImpl*>(
+			rand_engine != nullptr ? rand_engine : default_rand_engines.get());
+	return search(cdf_sample((*rand_engine_impl)()));
+}
+
+// The searches of a chunk advance together, one tree level at a time: the
+// loads of each level are independent, so their cache misses overlap.
+template <typename T>
+void CdfZipfDistribution<T>::next_batch(T* out, size_t count, RandEngine* rand_engine) {
+	auto rand_engine_impl = static_cast<RandEngineImpl*>(
+			rand_engine != nullptr ? rand_engine : default_rand_engines.get());
+	const uint64_t leaves = 1ULL << height;
+	uint64_t r[batch_chunk];
+	uint32_t u[batch_chunk];
+	uint64_t k[batch_chunk];
+
+	for (size_t done = 0; done < count; ) {
+		size_t c = std::min(count - done, batch_chunk);
+		rand_engine_impl->uniform_64(r, c);
+		for (size_t i = 0; i < c; i++) {
+			u[i] = cdf_sample(r[i]);
+			k[i] = 1;
+		}
+		for (uint32_t l = 0; l < height; l++)
+			for (size_t i = 0; i < c; i++)
+				k[i] = 2 * k[i] + (tree[k[i]] <= u[i]);
+
+		T* o = out + done;
+		for (size_t i = 0; i < c; i++) {
+			const uint32_t* group = cdf + (k[i] - leaves) * cdf_group_size;
+			uint32_t n_le = 0;
+			for (size_t j = 0; j < cdf_group_size; j++)
+				n_le += group[j] <= u[i];
+			o[i] = static_cast<T>((k[i] - leaves) * cdf_group_size + n_le + 1);
+		}
+		done += c;
+	}
+}
+
+template <typename T>
+std::unique_ptr<RandEngine> CdfZipfDistribution<T>::newEngine(RandEngine::type_t type) {
+	return newRandEngine(type);
+}
+
+template <typename T>
+T CdfZipfDistribution<T>::getN() {
+	return n;
+}
+
+template <typename T>
+double CdfZipfDistribution<T>::getTheta() {
+	return theta;
+}
+
+template class CdfZipfDistribution<int32_t>;
+template class CdfZipfDistribution<int64_t>;
+
+////////////////////////////////////////////////////////////////////////////////////
+#undef __CLASS__
+#define __CLASS__ "KeyPermutation::"
+
+template <typename T>
+KeyPermutation<T>::KeyPermutation(T n, uint64_t seed): n(n) {
+	assert(n > 0);
+	uint32_t bits = 1;
+	while (bits < 64 && (1ULL << bits) < static_cast<uint64_t>(n))
+		bits++;
+	half_bits = (bits + 1) / 2;
+	half_mask = (1ULL << half_bits) - 1;
+
+	SplitMix64 sm; sm.seed(seed);
+	for (auto& k : round_keys)
+		k = sm();
+	PRINT_DEBUG("n = %s, seed = %s, half_bits = %s", v2s(n), v2s(seed), v2s(half_bits));
+}
+
+template <typename T>
+T KeyPermutation<T>::operator()(T key) const {
+	assert(key >= 1 && static_cast<uint64_t>(key) <= n);
+	uint64_t x = static_cast<uint64_t>(key) - 1;
+	// cycle-walking: the domain has less than 4n values, so less than 4
+	// iterations are expected (less than 2 when n needs an even number of bits)
+	do {
+		uint64_t l = x >> half_bits;
+		uint64_t r = x & half_mask;
+		for (int i = 0; i < rounds; i++) {
+			uint64_t f = mix64(r ^ round_keys[i]) & half_mask;
+			uint64_t aux = l ^ f;
+			l = r;
+			r = aux;
+		}
+		x = (l << half_bits) | r;
+	} while (x >= n);
+	return static_cast<T>(x + 1);
+}
+
+template class KeyPermutation<int32_t>;
+template class KeyPermutation<int64_t>;
+
+////////////////////////////////////////////////////////////////////////////////////
+#undef __CLASS__
+#define __CLASS__ "ScrambledZipfDistribution::"
+
+template <typename T, typename Zipf>
+ScrambledZipfDistribution<T, Zipf>::ScrambledZipfDistribution(T n, T sample_size, double theta, scramble_t scramble, uint64_t seed, uint32_t threads):
+	n(n), sample_size(sample_size), scramble(scramble)
+{
+	PRINT_DEBUG("n           = %s", v2s(n));
+	PRINT_DEBUG("sample_size = %s", v2s(sample_size));
+	PRINT_DEBUG("theta       = %s", v2s(theta));
+	PRINT_DEBUG("scramble    = %s", v2s(scramble));
+	assert(sample_size > 0 && sample_size <= n);
+
+	zipf.reset(new Zipf(n, theta));
+
+	if (scramble == SCRAMBLE_PERMUTATION)
+		permutation.reset(new KeyPermutation<T>(n, seed));
+	else
+		buildSampleList(std::max(threads, 1U));
+}
+
+// keys per stratum of the sample list (see buildSampleList())
+static const uint64_t scramble_stratum_keys = 1 << 16;
+
+// Floyd's algorithm: inserts k distinct keys of [first, last] into the open
+// addressing table tab[0..cap) (0 = empty slot), in O(k).
+template <typename T>
+static void floyd_sample(T* tab, uint64_t cap, T first, T last, uint64_t k, uint64_t seed) {
+	Xoshiro256ss g; g.seed(seed);
+	auto insert = [tab, cap](T key) -> bool {
+		uint64_t i = static_cast<uint64_t>((static_cast<__uint128_t>(mix64(key)) * cap) >> 64);
+		while (tab[i] != 0) {
+			if (tab[i] == key)
+				return false;
+			if (++i == cap)
+				i = 0;
+		}
+		tab[i] = key;
+		return true;
+	};
+
+	const uint64_t range = static_cast<uint64_t>(last - first) + 1;
+	for (uint64_t j = range - k + 1; j <= range; j++) {
+		uint64_t t = static_cast<uint64_t>((static_cast<__uint128_t>(g()) * j) >> 64) + 1; // [1, j]
+		if (!insert(static_cast<T>(first + t - 1)))
+			insert(static_cast<T>(first + j - 1));
+	}
+}
+
+template <typename T, typename Zipf>
+void ScrambledZipfDistribution<T, Zipf>::buildSampleList(uint32_t threads) {
+	auto rand_engine_impl = static_cast<RandEngineImpl*>(default_rand_engines.get());
+	const uint64_t k = static_cast<uint64_t>(sample_size);
+
+	if (sample_size <= (T)((double)n*0.8)) {
+		// Stratified sampling: [1, n] is split into strata (their number
+		// depends only on k, so the list does not depend on the number of
+		// threads), and each stratum takes its share of k with Floyd's
+		// algorithm into a small table with 30% of free slots, which is then
+		// compacted into its slice of sample_list. The threads take strata in
+		// turn, so the peak memory is k keys plus one small table per thread.
+		const uint64_t strata = std::max<uint64_t>(k / scramble_stratum_keys, 1);
+		std::vector<uint64_t> seeds(strata);
+		for (auto& seed : seeds)
+			seed = (*rand_engine_impl)();
+		sample_list.resize(k);
+
+		std::atomic<uint64_t> next_stratum {0};
+		auto worker = [&]{
+			std::vector<T> tab;
+			uint64_t i;
+			while ((i = next_stratum.fetch_add(1, std::memory_order_relaxed)) < strata) {
+				T first = static_cast<T>(1 + static_cast<__uint128_t>(n) * i / strata);
+				T last  = static_cast<T>(static_cast<__uint128_t>(n) * (i + 1) / strata);
+				uint64_t offset = static_cast<uint64_t>(static_cast<__uint128_t>(k) * i / strata);
+				uint64_t k_i = static_cast<uint64_t>(static_cast<__uint128_t>(k) * (i + 1) / strata) - offset;
+				uint64_t cap = k_i + k_i * 3 / 10 + 1;
+				tab.assign(cap, 0);
+				floyd_sample(tab.data(), cap, first, last, k_i, seeds[i]);
+				T* o = sample_list.data() + offset;
+				for (T key : tab) {
+					if (key != 0)
+						*o++ = key;
+				}
+				assert(o == sample_list.data() + offset + k_i);
+			}
+		};
+		threads = static_cast<uint32_t>(std::min<uint64_t>(threads, strata));
+		std::vector<std::thread> workers;
+		for (uint32_t t = 1; t < threads; t++)
+			workers.emplace_back(worker);
+		worker();
+		for (auto& w : workers)
+			w.join();
+
+		std::shuffle(sample_list.begin(), sample_list.end(), *rand_engine_impl);
+
+	} else {
+		sample_list.resize(n);
+		for (T i = 1; i <= n; i++)
+			sample_list[i-1] = i;
+		// partial Fisher-Yates: only the first k positions are used
+		for (uint64_t i = 0; i < k; i++) {
+			uint64_t j = i + rand_engine_impl->uniform_keys(static_cast<uint64_t>(n) - i) - 1;
+			std::swap(sample_list[i], sample_list[j]);
+		}
+		sample_list.resize(k); // keeps the capacity of n keys, at most 1.25 k
+	}
+
+	PRINT_DEBUG("sample_list size: %s", v2s(sample_list.capacity() * sizeof(T)));
+}
+
+template <typename T, typename Zipf>
+T ScrambledZipfDistribution<T, Zipf>::next(RandEngine* rand_engine) {
+	auto rand_engine_impl = static_cast<RandEngineImpl*>(
+			rand_engine != nullptr ? rand_engine : default_rand_engines.get());
+
+	auto r = zipf->next(rand_engine_impl);
+	if (r <= sample_size)
+		return (scramble == SCRAMBLE_PERMUTATION) ? (*permutation)(r) : sample_list[r-1];
+
+	return rand_engine_impl->uniform_keys(n);
+}
+
+template <typename T, typename Zipf>
+void ScrambledZipfDistribution<T, Zipf>::next_batch(T* out, size_t count, RandEngine* rand_engine) {
+	auto rand_engine_impl = static_cast<RandEngineImpl*>(
+			rand_engine != nullptr ? rand_engine : default_rand_engines.get());
+
+	zipf->next_batch(out, count, rand_engine_impl);
+	if (scramble == SCRAMBLE_PERMUTATION) {
+		const auto& perm = *permutation;
+		for (size_t i = 0; i < count; i++) {
+			T r = out[i];
+			out[i] = (r <= sample_size) ? perm(r) : rand_engine_impl->uniform_keys(n);
+		}
+	} else {
+		const T* list = sample_list.data();
+		for (size_t i = 0; i < count; i++) {
+			T r = out[i];
+			out[i] = (r <= sample_size) ? list[r-1] : rand_engine_impl->uniform_keys(n);
+		}
+	}
+}
+
+template <typename T, typename Zipf>
+std::unique_ptr<RandEngine> ScrambledZipfDistribution<T, Zipf>::newEngine(RandEngine::type_t type) {
+	return newRandEngine(type);
+}
+
+template class ScrambledZipfDistribution<int32_t>;
+template class ScrambledZipfDistribution<int64_t>;
+template class ScrambledZipfDistribution<int32_t, RejectionInversionZipfDistribution<int32_t>>;
+template class ScrambledZipfDistribution<int64_t, RejectionInversionZipfDistribution<int64_t>>;
+template class ScrambledZipfDistribution<int32_t, CdfZipfDistribution<int32_t>>;
+template class ScrambledZipfDistribution<int64_t, CdfZipfDistribution<int64_t>>;
+
+////////////////////////////////////////////////////////////////////////////////////
+#undef __CLASS__
+#define __CLASS__ "DriftingZipfDistribution::"
+
+// interval of the updates of theta during a ramp
+static const uint64_t drift_update_ns = 10000000;
+
+// coarse monotonic clock: resolution of a few ms, but cheap enough to be read
+// once per sample (or per chunk in next_batch) while rotating or ramping
+static inline uint64_t drift_now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+	return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+template <typename T>
+static bool drift_valid_key_shift(T n, int64_t key_shift) {
+	return key_shift >= static_cast<int64_t>(std::numeric_limits<T>::min()) &&
+	       key_shift <= static_cast<int64_t>(std::numeric_limits<T>::max() - n);
+}
+
+template <typename T>
+DriftingZipfDistribution<T>::DriftingZipfDistribution(T n, double theta): n(n), theta_from(theta), theta_to(theta) {
+	PRINT_DEBUG("n     = %s", v2s(n));
+	PRINT_DEBUG("theta = %s", v2s(theta));
+	if (n < 2)
+		throw std::invalid_argument(sprintf("invalid number of keys: %s", v2s(n)));
+	if (!(theta > 0))
+		throw std::invalid_argument(sprintf("invalid theta: %f", theta));
+
+	Snapshot snap;
+	snap.shift        = 0;
+	snap.rotate       = 0;
+	snap.rotate_begin = drift_now();
+	snap.key_shift    = 0;
+	updateTheta(snap, snap.rotate_begin);
+	publish(snap);
+}
+
+template <typename T>
+void DriftingZipfDistribution<T>::load(Snapshot& snap) {
+	uint64_t v1, v2;
+	do {
+		v1 = version.load(std::memory_order_acquire);
+		snap.theta         = theta.load(std::memory_order_relaxed);
+		snap.h_integral_x1 = h_integral_x1.load(std::memory_order_relaxed);
+		snap.h_integral_n  = h_integral_n.load(std::memory_order_relaxed);
+		snap.s             = s.load(std::memory_order_relaxed);
+		snap.shift         = shift.load(std::memory_order_relaxed);
+		snap.rotate        = rotate.load(std::memory_order_relaxed);
+		snap.rotate_begin  = rotate_begin.load(std::memory_order_relaxed);
+		snap.key_shift     = key_shift.load(std::memory_order_relaxed);
+		snap.next_update   = next_update.load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		v2 = version.load(std::memory_order_relaxed);
+	} while (v1 != v2 || (v1 & 1) != 0);
+}
+
+// must hold mutex
+template <typename T>
+void DriftingZipfDistribution<T>::publish(const Snapshot& snap) {
+	auto v = version.load(std::memory_order_relaxed);
+	version.store(v + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	theta.store(snap.theta, std::memory_order_relaxed);
+	h_integral_x1.store(snap.h_integral_x1, std::memory_order_relaxed);
+	h_integral_n.store(snap.h_integral_n, std::memory_order_relaxed);
+	s.store(snap.s, std::memory_order_relaxed);
+	shift.store(snap.shift, std::memory_order_relaxed);
+	rotate.store(snap.rotate, std::memory_order_relaxed);
+	rotate_begin.store(snap.rotate_begin, std::memory_order_relaxed);
+	key_shift.store(snap.key_shift, std::memory_order_relaxed);
+	next_update.store(snap.next_update, std::memory_order_relaxed);
+	version.store(v + 2, std::memory_order_release);
+}
+
+// must hold mutex
+template <typename T>
+void DriftingZipfDistribution<T>::updateTheta(Snapshot& snap, uint64_t now) {
+	double t = theta_to;
+	snap.next_update = UINT64_MAX;
+	if (now < ramp_begin)
+		now = ramp_begin;
+	if (ramp_ns > 0 && now - ramp_begin < ramp_ns) {
+		t = theta_from + (theta_to - theta_from) * static_cast<double>(now - ramp_begin) / static_cast<double>(ramp_ns);
+		snap.next_update = now + drift_update_ns;
+	}
+
+	snap.theta         = t;
+	snap.h_integral_x1 = ri_hIntegral(t, 1.5) - 1.0;
+	snap.h_integral_n  = ri_hIntegral(t, static_cast<double>(n) + 0.5);
+	snap.s             = 2.0 - ri_hIntegralInverse(t, ri_hIntegral(t, 2.5) - ri_h(t, 2.0));
+}
+
+template <typename T>
+uint64_t DriftingZipfDistribution<T>::current(Snapshot& snap) {
+	load(snap);
+	if (snap.next_update == UINT64_MAX && snap.rotate == 0)
+		return 0;
+
+	uint64_t now = drift_now();
+	if (now >= snap.next_update) {
+		// only one thread updates the ramp, the others keep the old theta
+		std::unique_lock<std::mutex> lock(mutex, std::try_to_lock);
+		if (lock.owns_lock()) {
+			load(snap);
+			if (now >= snap.next_update) {
+				updateTheta(snap, now);
+				publish(snap);
+			}
+		}
+	}
+	return now;
+}
+
+template <typename T>
+int64_t DriftingZipfDistribution<T>::currentShift(const Snapshot& snap, uint64_t now) {
+	if (snap.rotate == 0)
+		return snap.shift;
+	double elapsed = static_cast<double>(static_cast<int64_t>(now - snap.rotate_begin)) * 1e-9;
+	int64_t delta = static_cast<int64_t>(std::fmod(std::floor(snap.rotate * elapsed), static_cast<double>(n)));
+	int64_t ans = (snap.shift + delta) % static_cast<int64_t>(n);
+	return ans < 0 ? ans + n : ans;
+}
+
+template <typename T>
+inline bool DriftingZipfDistribution<T>::sampleRank(const Snapshot& snap, double u, T& rank) {
+	double v = snap.h_integral_n + u * (snap.h_integral_x1 - snap.h_integral_n);
+	double x = ri_hIntegralInverse(snap.theta, v);
+	T k = static_cast<T>(x + 0.5);
+
+	if (k < 1)
+		k = 1;
+	else if (k > n)
+		k = n;
+
+	rank = k;
+	return k - x <= snap.s || v >= ri_hIntegral(snap.theta, k + 0.5) - ri_h(snap.theta, k);
+}
+
+template <typename T>
+inline T DriftingZipfDistribution<T>::toKey(const Snapshot& snap, int64_t shift, T rank) {
+	int64_t r = static_cast<int64_t>(rank) - 1 + shift;
+	if (r >= static_cast<int64_t>(n))
+		r -= n;
+	return static_cast<T>(r + 1 + snap.key_shift);
+}
+
+template <typename T>
+T DriftingZipfDistribution<T>::next(RandEngine* rand_engine) {
+	auto rand_engine_impl = static_cast<RandEngineImpl*>(
+			rand_engine != nullptr ? rand_engine : default_rand_engines.get());
+	Snapshot snap;
+	uint64_t now = current(snap);
+	T rank;
+	while (!sampleRank(snap, rand_engine_impl->uniform_01(), rank));
+	return toKey(snap, currentShift(snap, now), rank);
+}
+
+template <typename T>
+void DriftingZipfDistribution<T>::next_batch(T* out, size_t count, RandEngine* rand_engine) {
+	auto rand_engine_impl = static_cast<RandEngineImpl*>(
+			rand_engine != nullptr ? rand_engine : default_rand_engines.get());
+	double u[batch_chunk];
+	Snapshot snap;
+	T rank;
+
+	for (size_t i = 0; i < count; ) {
+		// the parameters are reloaded per chunk, so long batches follow changes
+		uint64_t now = current(snap);
+		int64_t shift_ = currentShift(snap, now);
+		rand_engine_impl->uniform_01(u, batch_chunk);
+		for (size_t j = 0; j < batch_chunk && i < count; j++) {
+			if (sampleRank(snap, u[j], rank))
+				out[i++] = toKey(snap, shift_, rank);
+		}
+	}
+}
+
+template <typename T>
+std::unique_ptr<RandEngine> DriftingZipfDistribution<T>::newEngine(RandEngine::type_t type) {
+	return newRandEngine(type);
+}
+
+template <typename T>
+void DriftingZipfDistribution<T>::setTheta(double new_theta, double ramp_seconds) {
+	PRINT_DEBUG("theta = %s, ramp_seconds = %s", v2s(new_theta), v2s(ramp_seconds));
+	if (!(new_theta > 0))
+		throw std::invalid_argument(sprintf("invalid theta: %f", new_theta));
+	if (!(ramp_seconds >= 0))
+		throw std::invalid_argument(sprintf("invalid ramp period: %f", ramp_seconds));
+
+	std::lock_guard<std::mutex> lock(mutex);
+	Snapshot snap;
+	load(snap);
+	uint64_t now = drift_now();
+	updateTheta(snap, now);
+	theta_from = snap.theta; // a ramp in progress continues from its current value
+	theta_to   = new_theta;
+	ramp_begin = now;
+	ramp_ns    = static_cast<uint64_t>(ramp_seconds * 1e9);
+	updateTheta(snap, now);
+	publish(snap);
+}
+
+template <typename T>
+void DriftingZipfDistribution<T>::setHotShift(int64_t hot_shift) {
+	PRINT_DEBUG("hot_shift = %s", v2s(hot_shift));
+	std::lock_guard<std::mutex> lock(mutex);
+	Snapshot snap;
+	load(snap);
+	int64_t aux = hot_shift % static_cast<int64_t>(n);
+	snap.shift        = aux < 0 ? aux + n : aux;
+	snap.rotate_begin = drift_now();
+	publish(snap);
+}
+
+template <typename T>
+void DriftingZipfDistribution<T>::setRotate(double keys_per_second) {
+	PRINT_DEBUG("keys_per_second = %s", v2s(keys_per_second));
+	if (!std::isfinite(keys_per_second))
+		throw std::invalid_argument(sprintf("invalid rotation rate: %f", keys_per_second));
+	std::lock_guard<std::mutex> lock(mutex);
+	Snapshot snap;
+	load(snap);
+	uint64_t now = drift_now();
+	snap.shift        = currentShift(snap, now);
+	snap.rotate       = keys_per_second;
+	snap.rotate_begin = now;
+	publish(snap);
+}
+
+template <typename T>
+void DriftingZipfDistribution<T>::setKeyShift(int64_t key_shift_) {
+	PRINT_DEBUG("key_shift = %s", v2s(key_shift_));
+	if (!drift_valid_key_shift(n, key_shift_))
+		throw std::invalid_argument(sprintf("key shift out of range: %s", v2s(key_shift_)));
+	std::lock_guard<std::mutex> lock(mutex);
+	Snapshot snap;
+	load(snap);
+	snap.key_shift = key_shift_;
+	publish(snap);
+}
+
+template <typename T>
+T DriftingZipfDistribution<T>::getN() {
+	return n;
+}
+
+template <typename T>
+double DriftingZipfDistribution<T>::getTheta() {
+	Snapshot snap;
+	current(snap);
+	return snap.theta;
+}
+
+template <typename T>
+int64_t DriftingZipfDistribution<T>::getHotShift() {
+	Snapshot snap;
+	load(snap);
+	return currentShift(snap, drift_now());
+}
+
+template <typename T>
+int64_t DriftingZipfDistribution<T>::getKeyShift() {
+	return key_shift.load();
+}
+
+template <typename T>
+void DriftingZipfDistribution<T>::registerCommands(Commands& commands, const std::string& prefix) {
+	commands.registerCmd( new CmdDouble(prefix + "theta", true, 0, nullptr,
+		[](double v)->bool { return v > 0; },
+		[this](double v) {
+			double ramp;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				ramp = theta_ramp;
+			}
+			setTheta(v, ramp);
+		}) );
+	commands.registerCmd( new CmdDouble(prefix + "theta_ramp", true, 0, nullptr,
+		[](double v)->bool { return v >= 0; },
+		[this](double v) {
+			std::lock_guard<std::mutex> lock(mutex);
+			theta_ramp = v;
+		}) );
+	commands.registerCmd( new CmdInt64(prefix + "hot_shift", true, 0, nullptr, nullptr,
+		[this](int64_t v) { setHotShift(v); }) );
+	commands.registerCmd( new CmdDouble(prefix + "rotate", true, 0, nullptr,
+		[](double v)->bool { return std::isfinite(v); },
+		[this](double v) { setRotate(v); }) );
+	commands.registerCmd( new CmdInt64(prefix + "key_shift", true, 0, nullptr,
+		[this](int64_t v)->bool { return drift_valid_key_shift(n, v); },
+		[this](int64_t v) { setKeyShift(v); }) );
+}
+
+template class DriftingZipfDistribution<int32_t>;
+template class DriftingZipfDistribution<int64_t>;
+
+////////////////////////////////////////////////////////////////////////////////////
+#undef __CLASS__
+#define __CLASS__ "UniformDistribution::"
+
+template <typename T>
+UniformDistribution<T>::UniformDistribution(T min, T max): min(min), max(max) {
+	PRINT_DEBUG("min = %s, max = %s", v2s(min), v2s(max));
+	assert(min <= max);
+}
+
+template <typename T>
+T UniformDistribution<T>::next(RandEngine* rand_engine) {
+	auto rand_engine_impl = static_cast<RandEngineImpl*>(
+			rand_engine != nullptr ? rand_engine : default_rand_engines.get());
+	return min - 1 + static_cast<T>(rand_engine_impl->uniform_keys(static_cast<uint64_t>(max - min) + 1));
+}
+
+template <typename T>
+void UniformDistribution<T>::next_batch(T* out, size_t count, RandEngine* rand_engine) {
+	auto rand_engine_impl = static_cast<RandEngineImpl*>(
+			rand_engine != nullptr ? rand_engine : default_rand_engines.get());
+	const uint64_t range = static_cast<uint64_t>(max - min) + 1;
+	uint64_t k[batch_chunk];
+	for (size_t done = 0; done < count; ) {
+		size_t c = std::min(count - done, batch_chunk);
+		rand_engine_impl->uniform_keys(k, c, range);
+		T* o = out + done;
+		for (size_t i = 0; i < c; i++)
+			o[i] = min - 1 + static_cast<T>(k[i]);
+		done += c;
+	}
+}
+
+template <typename T>
+std::unique_ptr<RandEngine> UniformDistribution<T>::newEngine(RandEngine::type_t type) {
+	return newRandEngine(type);
+}
+
+template class UniformDistribution<int32_t>;
+template class UniformDistribution<int64_t>;
+
+////////////////////////////////////////////////////////////////////////////////////
+#undef __CLASS__
+#define __CLASS__ "HotspotDistribution::"
+
+template <typename T>
+HotspotDistribution<T>::HotspotDistribution(T n, double hot_set_fraction, double hot_op_fraction):
+	n(n), hot_op_fraction(hot_op_fraction)
+{
+	PRINT_DEBUG("n                = %s", v2s(n));
+	PRINT_DEBUG("hot_set_fraction = %s", v2s(hot_set_fraction));
+	PRINT_DEBUG("hot_op_fraction  = %s", v2s(hot_op_fraction));
+	assert(n > 0);
+	if (hot_set_fraction < 0 || hot_set_fraction > 1)
+		throw std::invalid_argument(sprintf("invalid hot set fraction: %f", hot_set_fraction));
+	if (hot_op_fraction < 0 || hot_op_fraction > 1)
+		throw std::invalid_argument(sprintf("invalid hot operation fraction: %f", hot_op_fraction));
+
+	hot_n = static_cast<T>(static_cast<double>(n) * hot_set_fraction);
+	hot_n = std::max<T>(hot_n, 1);
+	if (hot_n == n)
+		this->hot_op_fraction = 1.0; // no cold keys
+}
+
+template <typename T>
+T HotspotDistribution<T>::next(RandEngine* rand_engine) {
+	auto rand_engine_impl = static_cast<RandEngineImpl*>(
+			rand_engine != nullptr ? rand_engine : default_rand_engines.get());
+	if (rand_engine_impl->uniform_01() < hot_op_fraction)
+		return rand_engine_impl->uniform_keys(hot_n);
+	return hot_n + rand_engine_impl->uniform_keys(n - hot_n);
+}
+
+template <typename T>
+void HotspotDistribution<T>::next_batch(T* out, size_t count, RandEngine* rand_engine) {
+	auto rand_engine_impl = static_cast<RandEngineImpl*>(
+			rand_engine != nullptr ? rand_engine : default_rand_engines.get());
+	double u[batch_chunk];
+
+	for (size_t done = 0; done < count; ) {
+		size_t c = std::min(count - done, batch_chunk);
+		rand_engine_impl->uniform_01(u, c);
+		T* o = out + done;
+		for (size_t i = 0; i < c; i++)
+			o[i] = u[i] < hot_op_fraction ? rand_engine_impl->uniform_keys(hot_n)
+			                              : hot_n + rand_engine_impl->uniform_keys(n - hot_n);
+		done += c;
+	}
+}
+
+template <typename T>
+std::unique_ptr<RandEngine> HotspotDistribution<T>::newEngine(RandEngine::type_t type) {
+	return newRandEngine(type);
+}
+
+template class HotspotDistribution<int32_t>;
+template class HotspotDistribution<int64_t>;
+
+////////////////////////////////////////////////////////////////////////////////////
+#undef __CLASS__
+#define __CLASS__ "ExponentialDistribution::"
+
+template <typename T>
+ExponentialDistribution<T>::ExponentialDistribution(T n, double percentile, double fraction): n(n) {
+	PRINT_DEBUG("n          = %s", v2s(n));
+	PRINT_DEBUG("percentile = %s", v2s(percentile));
+	PRINT_DEBUG("fraction   = %s", v2s(fraction));
+	assert(n > 0);
+	if (percentile <= 0 || percentile >= 100)
+		throw std::invalid_argument(sprintf("invalid percentile: %f", percentile));
+	if (fraction <= 0)
+		throw std::invalid_argument(sprintf("invalid fraction: %f", fraction));
+
+	gamma = -std::log(1.0 - percentile / 100.0) / (fraction * static_cast<double>(n));
+	PRINT_DEBUG("gamma      = %s", v2s(gamma));
+}
+
+template <typename T>
+T ExponentialDistribution<T>::next(RandEngine* rand_engine) {
+	auto rand_engine_impl = static_cast<RandEngineImpl*>(
+			rand_engine != nullptr ? rand_engine : default_rand_engines.get());
+	while (true) { // rejection of the values above n
+		double x = -std::log(1.0 - rand_engine_impl->uniform_01()) / gamma;
+		if (x < static_cast<double>(n))
+			return 1 + static_cast<T>(x);
+	}
+}
+
+template <typename T>
+void ExponentialDistribution<T>::next_batch(T* out, size_t count, RandEngine* rand_engine) {
+	auto rand_engine_impl = static_cast<RandEngineImpl*>(
+			rand_engine != nullptr ? rand_engine : default_rand_engines.get());
+	const double n_d = static_cast<double>(n);
+	const double inv_gamma = 1.0 / gamma;
+	double u[batch_chunk];
+	double v[batch_chunk];
+
+	for (size_t done = 0; done < count; ) {
+		size_t c = std::min(count - done, batch_chunk);
+		rand_engine_impl->uniform_01(u, c);
+
+		batch_ln(u, c, -1.0, 1.0, -inv_gamma, v);
+
+		T* o = out + done;
+		for (size_t i = 0; i < c; i++)
+			o[i] = v[i] < n_d ? 1 + static_cast<T>(v[i]) : next(rand_engine_impl);
+		done += c;
+	}
+}
+
+template <typename T>
+std::unique_ptr<RandEngine> ExponentialDistribution<T>::newEngine(RandEngine::type_t type) {
+	return newRandEngine(type);
+}
+
+template class ExponentialDistribution<int32_t>;
+template class ExponentialDistribution<int64_t>;
+
+////////////////////////////////////////////////////////////////////////////////////
+#undef __CLASS__
+#define __CLASS__ "CounterDistribution::"
+
+template <typename T>
+CounterDistribution<T>::CounterDistribution(T start): counter(start) {
+	PRINT_DEBUG("start = %s", v2s(start));
+}
+
+template <typename T>
+T CounterDistribution<T>::next(RandEngine* /*rand_engine*/) {
+	return counter.fetch_add(1, std::memory_order_relaxed);
+}
+
+template <typename T>
+void CounterDistribution<T>::next_batch(T* out, size_t count, RandEngine* /*rand_engine*/) {
+	T first = counter.fetch_add(static_cast<T>(count), std::memory_order_relaxed);
+	for (size_t i = 0; i < count; i++)
+		out[i] = first + static_cast<T>(i);
+}
+
+template <typename T>
+std::unique_ptr<RandEngine> CounterDistribution<T>::newEngine(RandEngine::type_t type) {
+	return newRandEngine(type);
+}
+
+template <typename T>
+T CounterDistribution<T>::lastValue() {
+	return counter.load(std::memory_order_relaxed) - 1;
+}
+
+template class CounterDistribution<int32_t>;
+template class CounterDistribution<int64_t>;
+
+////////////////////////////////////////////////////////////////////////////////////
+#undef __CLASS__
+#define __CLASS__ "AcknowledgedCounterDistribution::"
+
+template <typename T>
+AcknowledgedCounterDistribution<T>::AcknowledgedCounterDistribution(T start):
+	CounterDistribution<T>(start), window(new std::atomic<bool>[window_size]), limit(start - 1)
+{
+	for (uint64_t i = 0; i < window_size; i++)
+		window[i].store(false, std::memory_order_relaxed);
+}
+
+template <typename T>
+void AcknowledgedCounterDistribution<T>::acknowledge(T value) {
+	uint64_t slot = static_cast<uint64_t>(value) & window_mask;
+	if (window[slot].exchange(true))
+		throw std::runtime_error(sprintf("too many unacknowledged values (window size = %lu)", window_size));
+
+	// Only one thread advances the limit; the others do not wait. After
+	// releasing the flag the advancing thread checks again the slot where it
+	// stopped, so a value set while the flag was taken is never left behind
+	// (all operations are seq_cst: either the other thread takes the flag or
+	// the advancing thread sees its slot).
+	while (true) {
+		if (advancing.exchange(true))
+			return;
+
+		T l = limit.load(std::memory_order_relaxed);
+		const T end = l + static_cast<T>(window_size);
+		for (T v = l + 1; v != end; v++) {
+			uint64_t s = static_cast<uint64_t>(v) & window_mask;
+			if (!window[s].load())
+				break;
+			window[s].store(false, std::memory_order_relaxed);
+			l = v;
+		}
+		limit.store(l, std::memory_order_release);
+		advancing.store(false);
+
+		if (!window[static_cast<uint64_t>(l + 1) & window_mask].load())
+			return;
+	}
+}
+
+template <typename T>
+T AcknowledgedCounterDistribution<T>::lastValue() {
+	return limit.load(std::memory_order_acquire);
+}
+
+template class AcknowledgedCounterDistribution<int32_t>;
+template class AcknowledgedCounterDistribution<int64_t>;
+
+////////////////////////////////////////////////////////////////////////////////////
+#undef __CLASS__
+#define __CLASS__ "SequentialDistribution::"
+
+template <typename T>
+SequentialDistribution<T>::SequentialDistribution(T first, T last): first(first), last(last) {
+	PRINT_DEBUG("first = %s, last = %s", v2s(first), v2s(last));
+	assert(first <= last);
+}
+
+template <typename T>
+T SequentialDistribution<T>::next(RandEngine* /*rand_engine*/) {
+	uint64_t c = counter.fetch_add(1, std::memory_order_relaxed);
+	return first + static_cast<T>(c % (static_cast<uint64_t>(last - first) + 1));
+}
+
+template <typename T>
+void SequentialDistribution<T>::next_batch(T* out, size_t count, RandEngine* /*rand_engine*/) {
+	const uint64_t range = static_cast<uint64_t>(last - first) + 1;
+	uint64_t c = counter.fetch_add(count, std::memory_order_relaxed) % range;
+	for (size_t i = 0; i < count; i++) {
+		out[i] = first + static_cast<T>(c);
+		if (++c == range)
+			c = 0;
+	}
+}
+
+template <typename T>
+std::unique_ptr<RandEngine> SequentialDistribution<T>::newEngine(RandEngine::type_t type) {
+	return newRandEngine(type);
+}
+
+template class SequentialDistribution<int32_t>;
+template class SequentialDistribution<int64_t>;
+
+////////////////////////////////////////////////////////////////////////////////////
+#undef __CLASS__
+#define __CLASS__ "LatestDistribution::"
+
+template <typename T, typename Counter>
+LatestDistribution<T, Counter>::LatestDistribution(Counter* basis, double theta): basis(basis) {
+	T last = basis->lastValue();
+	PRINT_DEBUG("last  = %s", v2s(last));
+	PRINT_DEBUG("theta = %s", v2s(theta));
+	zipf.reset(new ZipfDistribution<T>(std::max<T>(last, 2), theta));
+}
+
+// last key of the basis, growing the Zipf distribution if necessary
+template <typename T, typename Counter>
+inline T LatestDistribution<T, Counter>::getLast() {
+	T last = basis->lastValue();
+	if (last < 1) // nothing to return (and no Zipf value would be accepted)
+		throw std::runtime_error(sprintf("the basis counter has not issued any key yet (last value = %s)", v2s(last)));
+	if (last > zipf->getN())
+		zipf->grow(last);
+	return last;
+}
+
+template <typename T, typename Counter>
+T LatestDistribution<T, Counter>::next(RandEngine* rand_engine) {
+	auto rand_engine_impl = static_cast<RandEngineImpl*>(
+			rand_engine != nullptr ? rand_engine : default_rand_engines.get());
+	T last = getLast();
+	while (true) { // another thread may have grown zipf beyond our last
+		T z = zipf->next(rand_engine_impl);
+		if (z <= last)
+			return last - z + 1;
+	}
+}
+
+template <typename T, typename Counter>
+void LatestDistribution<T, Counter>::next_batch(T* out, size_t count, RandEngine* rand_engine) {
+	auto rand_engine_impl = static_cast<RandEngineImpl*>(
+			rand_engine != nullptr ? rand_engine : default_rand_engines.get());
+	T last = getLast();
+	zipf->next_batch(out, count, rand_engine_impl);
+	for (size_t i = 0; i < count; i++) {
+		T z = out[i];
+		while (z > last)
+			z = zipf->next(rand_engine_impl);
+		out[i] = last - z + 1;
+	}
+}
+
+template <typename T, typename Counter>
+std::unique_ptr<RandEngine> LatestDistribution<T, Counter>::newEngine(RandEngine::type_t type) {
+	return newRandEngine(type);
+}
+
+template class LatestDistribution<int32_t>;
+template class LatestDistribution<int64_t>;
+template class LatestDistribution<int32_t, AcknowledgedCounterDistribution<int32_t>>;
+template class LatestDistribution<int64_t, AcknowledgedCounterDistribution<int64_t>>;
+
+////////////////////////////////////////////////////////////////////////////////////
+#undef __CLASS__
+#define __CLASS__ "AliasDistribution::"
+
+template <typename T>
+AliasDistribution<T>::AliasDistribution(const std::vector<double>& weights) {
+	build(weights.data(), weights.size());
+}
+
+template <typename T>
+AliasDistribution<T>::AliasDistribution(const double* weights, size_t count) {
+	build(weights, count);
+}
+
+template <typename T>
+AliasDistribution<T>::AliasDistribution(const std::string& weight_file) {
+	PRINT_DEBUG("weight_file = %s", weight_file.c_str());
+	MMapFile file(weight_file);
+	if (file.size() % sizeof(double) != 0)
+		throw std::invalid_argument(sprintf("the size of the weight file \"%s\" is not a multiple of %lu", weight_file.c_str(), sizeof(double)));
+	file.adviseSequential();
+	build(file.data<double>(), file.count<double>());
+}
+
+template <typename T>
+void AliasDistribution<T>::build(const double* weights, size_t count) {
+	PRINT_DEBUG("count = %s", v2s(count));
+	if (count == 0 || count > static_cast<size_t>(std::numeric_limits<T>::max()))
+		throw std::invalid_argument(sprintf("invalid number of weights: %lu", count));
+	n = static_cast<T>(count);
+
+	long double sum = 0;
+	for (size_t i = 0; i < count; i++) {
+		if (!(weights[i] >= 0) || std::isinf(weights[i]))
+			throw std::invalid_argument(sprintf("invalid weight for key %lu: %f", i + 1, weights[i]));
+		sum += weights[i];
+	}
+	if (sum <= 0)
+		throw std::invalid_argument("the sum of the weights must be positive");
+
+	// Vose: pairs each bucket with probability below the average ("small")
+	// with one above it ("large"), which donates the rest of the bucket.
+	std::vector<double> prob(count);
+	std::vector<T> small, large;
+	const long double scale = static_cast<long double>(count) / sum;
+	for (size_t i = 0; i < count; i++) {
+		prob[i] = static_cast<double>(weights[i] * scale);
+		(prob[i] < 1.0 ? small : large).push_back(static_cast<T>(i));
+	}
+
+	auto threshold = [](double p) -> uint64_t {
+		return p >= 1.0 ? UINT64_MAX : static_cast<uint64_t>(p * 0x1.0p64);
+	};
+	table.resize(count);
+	while (!small.empty() && !large.empty()) {
+		T l = small.back(); small.pop_back();
+		T g = large.back(); large.pop_back();
+		table[l] = Bucket{threshold(prob[l]), g + 1};
+		prob[g] = (prob[g] + prob[l]) - 1.0;
+		(prob[g] < 1.0 ? small : large).push_back(g);
+	}
+	// the remaining buckets are full (up to rounding errors)
+	for (auto i : large)
+		table[i] = Bucket{UINT64_MAX, i + 1};
+	for (auto i : small)
+		table[i] = Bucket{UINT64_MAX, i + 1};
+
+	PRINT_DEBUG("table size: %s", v2s(table.size() * sizeof(Bucket)));
+}
+
+// One 64-bit random value per sample: the high part of r*n selects the
+// bucket and the low part is the uniform value compared with its threshold.
+template <typename T>
+T AliasDistribution<T>::next(RandEngine* rand_engine) {
+	auto rand_engine_impl = static_cast<RandEngineImpl*>(
+			rand_engine != nullptr ? rand_engine : default_rand_engines.get());
+	__uint128_t m = static_cast<__uint128_t>((*rand_engine_impl)()) * static_cast<uint64_t>(n);
+	uint64_t i = static_cast<uint64_t>(m >> 64);
+	const Bucket& b = table[i];
+	return static_cast<uint64_t>(m) < b.threshold ? static_cast<T>(i + 1) : b.alias;
+}
+
+template <typename T>
+void AliasDistribution<T>::next_batch(T* out, size_t count, RandEngine* rand_engine) {
+	auto rand_engine_impl = static_cast<RandEngineImpl*>(
+			rand_engine != nullptr ? rand_engine : default_rand_engines.get());
+	const uint64_t n_ = static_cast<uint64_t>(n);
+	const Bucket* tab = table.data();
+	uint64_t r[batch_chunk];
+
+	for (size_t done = 0; done < count; ) {
+		size_t c = std::min(count - done, batch_chunk);
+		rand_engine_impl->uniform_64(r, c);
+		// the table lookups are independent: their cache misses overlap
+		T* o = out + done;
+		for (size_t i = 0; i < c; i++) {
+			__uint128_t m = static_cast<__uint128_t>(r[i]) * n_;
+			uint64_t k = static_cast<uint64_t>(m >> 64);
+			const Bucket& b = tab[k];
+			o[i] = static_cast<uint64_t>(m) < b.threshold ? static_cast<T>(k + 1) : b.alias;
+		}
+		done += c;
+	}
+}
+
+template <typename T>
+std::unique_ptr<RandEngine> AliasDistribution<T>::newEngine(RandEngine::type_t type) {
+	return newRandEngine(type);
+}
+
+template <typename T>
+T AliasDistribution<T>::getN() {
+	return n;
+}
+
+template class AliasDistribution<int32_t>;
+template class AliasDistribution<int64_t>;
+
+////////////////////////////////////////////////////////////////////////////////////
+#undef __CLASS__
+#define __CLASS__ "KeyDistribution::"
+
+template <typename T>
+KeyDistribution<T>::KeyDistribution(const std::string& config) {
+	PRINT_DEBUG("config = %s", config.c_str());
+
+	std::map<std::string, std::string> args;
+	for (const auto& item : split_str(config, ",")) {
+		auto kv = strip(item);
+		if (kv.empty())
+			continue;
+		auto pos = kv.find('=');
+		if (pos == std::string::npos)
+			throw std::invalid_argument(sprintf("invalid parameter \"%s\" in the key distribution \"%s\"", kv.c_str(), config.c_str()));
+		args[strip(kv.substr(0, pos))] = strip(kv.substr(pos + 1));
+	}
+
+	auto get_arg = [&args](const char* name) -> std::string {
+		auto it = args.find(name);
+		if (it == args.end())
+			return "";
+		std::string ret = it->second;
+		args.erase(it);
+		return ret;
+	};
+	auto arg_t = [&](const char* name, bool required, T default_) {
+		return parse<T>(get_arg(name), required, default_, sprintf("invalid %s in the key distribution", name).c_str());
+	};
+	auto arg_double = [&](const char* name, double default_) {
+		return parseDouble(get_arg(name), false, default_, sprintf("invalid %s in the key distribution", name).c_str());
+	};
+
+	std::string type = get_arg("type");
+	if (type == "uniform") {
+		dist = std::unique_ptr<UniformDistribution<T>>(new UniformDistribution<T>(1, arg_t("n", true, 0)));
+	} else if (type == "zipf") {
+		T n = arg_t("n", true, 0);
+		dist = std::unique_ptr<ZipfDistribution<T>>(new ZipfDistribution<T>(n, arg_double("theta", 0.99)));
+	} else if (type == "zipf_ri") {
+		T n = arg_t("n", true, 0);
+		dist = std::unique_ptr<RejectionInversionZipfDistribution<T>>(new RejectionInversionZipfDistribution<T>(n, arg_double("theta", 0.99)));
+	} else if (type == "zipf_cdf") {
+		std::string file = get_arg("file");
+		if (file.empty()) {
+			T n = arg_t("n", true, 0);
+			dist = std::unique_ptr<CdfZipfDistribution<T>>(new CdfZipfDistribution<T>(n, arg_double("theta", 0.99)));
+		} else {
+			dist = std::unique_ptr<CdfZipfDistribution<T>>(new CdfZipfDistribution<T>(file));
+		}
+	} else if (type == "scrambled") {
+		T n = arg_t("n", true, 0);
+		T sample_size = arg_t("sample_size", false, n);
+		double theta = arg_double("theta", 0.99);
+		bool permutation = parseBool(get_arg("permutation"), false, false, "invalid permutation in the key distribution");
+		uint64_t seed = parseUint64(get_arg("seed"), false, 0, "invalid seed in the key distribution");
+		dist = std::unique_ptr<ScrambledZipfDistribution<T>>(new ScrambledZipfDistribution<T>(n, sample_size, theta,
+				permutation ? SCRAMBLE_PERMUTATION : SCRAMBLE_LIST, seed));
+	} else if (type == "hotspot") {
+		T n = arg_t("n", true, 0);
+		double hot_set = arg_double("hot_set", 0.2);
+		dist = std::unique_ptr<HotspotDistribution<T>>(new HotspotDistribution<T>(n, hot_set, arg_double("hot_ops", 0.8)));
+	} else if (type == "exponential") {
+		T n = arg_t("n", true, 0);
+		double percentile = arg_double("percentile", 95);
+		dist = std::unique_ptr<ExponentialDistribution<T>>(new ExponentialDistribution<T>(n, percentile, arg_double("fraction", 0.8571428571)));
+	} else if (type == "sequential") {
+		dist = std::unique_ptr<SequentialDistribution<T>>(new SequentialDistribution<T>(1, arg_t("n", true, 0)));
+	} else if (type == "counter") {
+		dist = std::unique_ptr<CounterDistribution<T>>(new CounterDistribution<T>(arg_t("start", false, 1)));
+	} else if (type == "latest" || type == "skewed_latest") {
+		T n = arg_t("n", true, 0);
+		double theta = arg_double("theta", 0.99);
+		insert_counter.reset(new AcknowledgedCounterDistribution<T>(n + 1));
+		if (type == "latest")
+			dist = std::unique_ptr<LatestDistribution<T>>(new LatestDistribution<T>(insert_counter.get(), theta));
+		else
+			dist = std::unique_ptr<SkewedLatestDistribution<T>>(new SkewedLatestDistribution<T>(insert_counter.get(), theta));
+	} else if (type == "alias") {
+		std::string file = get_arg("file");
+		if (file.empty())
+			throw std::invalid_argument(sprintf("missing file in the key distribution \"%s\"", config.c_str()));
+		dist = std::unique_ptr<AliasDistribution<T>>(new AliasDistribution<T>(file));
+	} else {
+		throw std::invalid_argument(sprintf("invalid type \"%s\" in the key distribution \"%s\"", type.c_str(), config.c_str()));
+	}
+
+	if (args.size() > 0)
+		throw std::invalid_argument(sprintf("invalid parameter \"%s\" for the key distribution \"%s\"", args.begin()->first.c_str(), config.c_str()));
+}
+
+template <typename T>
+T KeyDistribution<T>::next(RandEngine* rand_engine) {
+	return std::visit([rand_engine](auto& d) -> T { return d->next(rand_engine); }, dist);
+}
+
+template <typename T>
+void KeyDistribution<T>::next_batch(T* out, size_t count, RandEngine* rand_engine) {
+	std::visit([=](auto& d) { d->next_batch(out, count, rand_engine); }, dist);
+}
+
+template <typename T>
+std::unique_ptr<RandEngine> KeyDistribution<T>::newEngine(RandEngine::type_t type) {
+	return newRandEngine(type);
+}
+
+template <typename T>
+AcknowledgedCounterDistribution<T>* KeyDistribution<T>::insertCounter() {
+	return insert_counter.get();
+}
+
+template class KeyDistribution<int32_t>;
+template class KeyDistribution<int64_t>;
+
+////////////////////////////////////////////////////////////////////////////////////
+#undef __CLASS__
+#define __CLASS__ "PartitionedKeyStream::"
+
+template <typename T, typename Dist>
+PartitionedKeyStream<T, Dist>::PartitionedKeyStream(Dist& dist, uint64_t seed, uint64_t count, uint64_t part, uint64_t parts):
+	dist(dist), count(count)
+{
+	PRINT_DEBUG("seed = %s, count = %s, part = %s, parts = %s", v2s(seed), v2s(count), v2s(part), v2s(parts));
+	if (parts == 0 || part >= parts)
+		throw std::invalid_argument(sprintf("invalid part %s of %s", v2s(part), v2s(parts)));
+
+	first = static_cast<uint64_t>(static_cast<__uint128_t>(count) * part / parts);
+	last  = static_cast<uint64_t>(static_cast<__uint128_t>(count) * (part + 1) / parts);
+	pos   = first;
+	rand_engine = newCounterRandEngine(seed);
+}
+
+template <typename T, typename Dist>
+inline T PartitionedKeyStream<T, Dist>::at(uint64_t index) {
+	assert(index < count);
+	static_cast<RandEngineImpl*>(rand_engine.get())->seek(index);
+	return dist.next(rand_engine.get());
+}
+
+template <typename T, typename Dist>
+bool PartitionedKeyStream<T, Dist>::next(T& key) {
+	if (pos >= last)
+		return false;
+	key = at(pos++);
+	return true;
+}
+
+template <typename T, typename Dist>
+size_t PartitionedKeyStream<T, Dist>::next_batch(T* out, size_t count) {
+	size_t ret = static_cast<size_t>(std::min<uint64_t>(count, last - pos));
+	for (size_t i = 0; i < ret; i++)
+		out[i] = at(pos++);
+	return ret;
+}
+
+template <typename T, typename Dist>
+void PartitionedKeyStream<T, Dist>::seek(uint64_t index) {
+	if (index < first || index > last)
+		throw std::out_of_range(sprintf("index %s out of the part [%s, %s)", v2s(index), v2s(first), v2s(last)));
+	pos = index;
+}
+
+template <typename T, typename Dist>
+uint64_t PartitionedKeyStream<T, Dist>::getFirst() {
+	return first;
+}
+
+template <typename T, typename Dist>
+uint64_t PartitionedKeyStream<T, Dist>::getLast() {
+	return last;
+}
+
+template <typename T, typename Dist>
+uint64_t PartitionedKeyStream<T, Dist>::getPosition() {
+	return pos;
+}
+
+template class PartitionedKeyStream<int32_t>;
+template class PartitionedKeyStream<int64_t>;
+template class PartitionedKeyStream<int32_t, RejectionInversionZipfDistribution<int32_t>>;
+template class PartitionedKeyStream<int64_t, RejectionInversionZipfDistribution<int64_t>>;
+template class PartitionedKeyStream<int32_t, CdfZipfDistribution<int32_t>>;
+template class PartitionedKeyStream<int64_t, CdfZipfDistribution<int64_t>>;
+template class PartitionedKeyStream<int32_t, ScrambledZipfDistribution<int32_t>>;
+template class PartitionedKeyStream<int64_t, ScrambledZipfDistribution<int64_t>>;
+template class PartitionedKeyStream<int32_t, ScrambledZipfDistribution<int32_t, RejectionInversionZipfDistribution<int32_t>>>;
+template class PartitionedKeyStream<int64_t, ScrambledZipfDistribution<int64_t, RejectionInversionZipfDistribution<int64_t>>>;
+template class PartitionedKeyStream<int32_t, KeyDistribution<int32_t>>;
+template class PartitionedKeyStream<int64_t, KeyDistribution<int64_t>>;
+
+////////////////////////////////////////////////////////////////////////////////////
+#undef __CLASS__
+#define __CLASS__ "TraceWriter::"
+
+static const char     trace_magic[8]    = "ALTRACE";
+static const uint32_t trace_version     = 1;
+static const size_t   trace_header_size = 16;
+static const size_t   trace_footer_size = 32;
+static const size_t   trace_block_header_size = 8;
+
+struct TraceFooter {
+	uint64_t index_offset;
+	uint64_t blocks;
+	uint64_t keys;
+	char     magic[8];
+};
+static_assert(sizeof(TraceFooter) == trace_footer_size, "unexpected padding in TraceFooter");
+
+template <typename T>
+TraceWriter<T>::TraceWriter(const std::string& filename, uint32_t keys_per_block):
+	filename(filename), keys_per_block(keys_per_block)
+{
+	PRINT_DEBUG("filename = %s, keys_per_block = %s", filename.c_str(), v2s(keys_per_block));
+	if (keys_per_block == 0 || keys_per_block > UINT32_MAX / 16)
+		throw std::invalid_argument(sprintf("invalid number of keys per block: %u", keys_per_block));
+	lengths.assign((keys_per_block + 1) / 2, 0);
+	bytes.resize(keys_per_block * sizeof(uint64_t));
+
+	file = fopen(filename.c_str(), "w");
+	if (file == nullptr)
+		throw std::runtime_error(sprintf("error opening trace file \"%s\": %s", filename.c_str(), strerror2(errno).c_str()));
+	setvbuf(file, nullptr, _IOFBF, 1 << 20);
+
+	uint32_t header[2] = {trace_version, 0};
+	writeRaw(trace_magic, sizeof(trace_magic));
+	writeRaw(header, sizeof(header));
+}
+
+template <typename T>
+TraceWriter<T>::~TraceWriter() {
+	try {
+		close();
+	} catch (std::exception& e) {
+		PRINT_ERROR("%s", e.what());
+	}
+}
+
+template <typename T>
+void TraceWriter<T>::writeRaw(const void* data, size_t size) {
+	if (fwrite(data, 1, size, file) != size)
+		throw std::runtime_error(sprintf("error writing trace file \"%s\": %s", filename.c_str(), strerror2(errno).c_str()));
+	offset += size;
+}
+
+template <typename T>
+void TraceWriter<T>::write(T key) {
+	if (block_count == 0 && file == nullptr)
+		throw std::runtime_error(sprintf("trace file \"%s\" is closed", filename.c_str()));
+	uint64_t delta = static_cast<uint64_t>(static_cast<int64_t>(key)) - static_cast<uint64_t>(static_cast<int64_t>(prev));
+	uint64_t v = (delta << 1) ^ static_cast<uint64_t>(static_cast<int64_t>(delta) >> 63); // zigzag
+	uint32_t len = v == 0 ? 0 : (71 - __builtin_clzll(v)) / 8;
+	std::memcpy(bytes.data() + bytes_size, &v, sizeof(v)); // little-endian, len bytes are kept
+	bytes_size += len;
+	lengths[block_count / 2] |= len << ((block_count % 2) * 4);
+	prev = key;
+	total_keys++;
+	if (++block_count == keys_per_block)
+		flushBlock();
+}
+
+template <typename T>
+void TraceWriter<T>::write(const T* keys, size_t count) {
+	for (size_t i = 0; i < count; i++)
+		write(keys[i]);
+}
+
+template <typename T>
+void TraceWriter<T>::flushBlock() {
+	if (block_count == 0)
+		return;
+	index.push_back(offset);
+	uint32_t lengths_size = (block_count + 1) / 2;
+	uint32_t header[2] = {block_count, lengths_size + bytes_size};
+	writeRaw(header, sizeof(header));
+	writeRaw(lengths.data(), lengths_size);
+	writeRaw(bytes.data(), bytes_size);
+	std::fill(lengths.begin(), lengths.begin() + lengths_size, 0);
+	block_count = 0;
+	bytes_size = 0;
+	prev = 0;
+}
+
+template <typename T>
+void TraceWriter<T>::close() {
+	if (file == nullptr)
+		return;
+	flushBlock();
+	const uint64_t zeros = 0; // aligns the index
+	writeRaw(&zeros, (sizeof(uint64_t) - offset % sizeof(uint64_t)) % sizeof(uint64_t));
+	TraceFooter footer {offset, index.size(), total_keys, {}};
+	std::memcpy(footer.magic, trace_magic, sizeof(trace_magic));
+	writeRaw(index.data(), index.size() * sizeof(uint64_t));
+	writeRaw(&footer, sizeof(footer));
+	PRINT_DEBUG("filename = %s, blocks = %s, keys = %s, size = %s",
+	            filename.c_str(), v2s(index.size()), v2s(total_keys), v2s(offset));
+
+	int ret = fclose(file);
+	file = nullptr;
+	if (ret != 0)
+		throw std::runtime_error(sprintf("error closing trace file \"%s\": %s", filename.c_str(), strerror2(errno).c_str()));
+}
+
+template class TraceWriter<int32_t>;
+template class TraceWriter<int64_t>;
+
+////////////////////////////////////////////////////////////////////////////////////
+#undef __CLASS__
+#define __CLASS__ "TraceReader::"
+
+template <typename T>
+TraceReader<T>::TraceReader(const std::string& filename, bool loop): loop(loop) {
+	PRINT_DEBUG("filename = %s, loop = %s", filename.c_str(), v2s(loop));
+	file.reset(new MMapFile(filename));
+	file->adviseSequential();
+	data = file->data<uint8_t>();
+	const uint64_t size = file->size();
+	auto invalid = [&filename](const char* reason) {
+		return std::runtime_error(sprintf("invalid trace file \"%s\": %s", filename.c_str(), reason));
+	};
+
+	if (size < trace_header_size + trace_footer_size || std::memcmp(data, trace_magic, sizeof(trace_magic)) != 0)
+		throw invalid("bad header");
+	uint32_t version;
+	std::memcpy(&version, data + sizeof(trace_magic), sizeof(version));
+	if (version != trace_version)
+		throw invalid("unsupported version");
+
+	TraceFooter footer;
+	std::memcpy(&footer, data + size - trace_footer_size, trace_footer_size);
+	if (std::memcmp(footer.magic, trace_magic, sizeof(trace_magic)) != 0 ||
+	    footer.index_offset < trace_header_size || footer.index_offset % sizeof(uint64_t) != 0 ||
+	    footer.blocks > size / sizeof(uint64_t) ||
+	    footer.index_offset + footer.blocks * sizeof(uint64_t) + trace_footer_size != size)
+		throw invalid("bad footer");
+	blocks = footer.blocks;
+	keys   = footer.keys;
+	index  = reinterpret_cast<const uint64_t*>(data + footer.index_offset);
+
+	uint64_t total = 0;
+	for (uint64_t b = 0; b < blocks; b++) {
+		uint64_t end = (b + 1 < blocks) ? index[b + 1] : footer.index_offset;
+		uint32_t header[2];
+		if (index[b] < trace_header_size || index[b] + trace_block_header_size > end)
+			throw invalid("bad block offset");
+		std::memcpy(header, data + index[b], sizeof(header));
+		// blocks are followed by the next block or by the alignment of the index
+		if (header[0] == 0 || index[b] + trace_block_header_size + header[1] > end
+		                   || end - (index[b] + trace_block_header_size + header[1]) >= sizeof(uint64_t))
+			throw invalid("bad block header");
+		total += header[0];
+	}
+	if (total != keys)
+		throw invalid("wrong number of keys");
+	PRINT_DEBUG("blocks = %s, keys = %s", v2s(blocks), v2s(keys));
+}
+
+template <typename T>
+TraceReader<T>::~TraceReader() {}
+
+template <typename T>
+typename TraceReader<T>::Cursor TraceReader<T>::getCursor(uint32_t part, uint32_t parts) {
+	assert(parts > 0 && part < parts);
+	Cursor cursor;
+	cursor.block     = blocks * part / parts;
+	cursor.end_block = blocks * (part + 1) / parts;
+	return cursor;
+}
+
+// sum of the two varint lengths of a byte of lengths, or 255 if invalid
+static const struct TraceLengths {
+	uint8_t sum[256];
+	TraceLengths() {
+		for (unsigned b = 0; b < 256; b++)
+			sum[b] = ((b & 15) > 8 || (b >> 4) > 8) ? 255 : (b & 15) + (b >> 4);
+	}
+} trace_lengths;
+
+static const uint64_t trace_len_mask[9] = {
+	0, 0xff, 0xffff, 0xffffff, 0xffffffffULL, 0xffffffffffULL, 0xffffffffffffULL,
+	0xffffffffffffffULL, 0xffffffffffffffffULL };
+
+template <typename T>
+bool TraceReader<T>::openBlock(Cursor& cursor) {
+	if (cursor.p != cursor.end)
+		throw std::runtime_error("corrupted trace block");
+	if (cursor.block >= cursor.end_block)
+		return false;
+	const uint8_t* b = data + index[cursor.block++];
+	uint32_t header[2];
+	std::memcpy(header, b, sizeof(header));
+	uint32_t lengths_size = (header[0] + 1) / 2;
+	if (lengths_size > header[1])
+		throw std::runtime_error("corrupted trace block");
+
+	// the sum of the lengths must match the size, so the decoding of a
+	// corrupted block does not read beyond it
+	cursor.lengths = b + trace_block_header_size;
+	uint64_t total = 0;
+	for (uint32_t i = 0; i < lengths_size; i++) {
+		uint8_t sum = trace_lengths.sum[cursor.lengths[i]];
+		if (sum == 255)
+			throw std::runtime_error("corrupted trace block");
+		total += sum;
+	}
+	if ((header[0] & 1) && (cursor.lengths[lengths_size - 1] >> 4) != 0)
+		throw std::runtime_error("corrupted trace block");
+	if (total != header[1] - lengths_size)
+		throw std::runtime_error("corrupted trace block");
+
+	cursor.pos  = 0;
+	cursor.left = header[0];
+	cursor.p    = cursor.lengths + lengths_size;
+	cursor.end  = cursor.p + total;
+	cursor.prev = 0;
+	return true;
+}
+
+// Varints are read as 8-byte words and masked to their lengths. The index,
+// the footer or another block always follow a block, so these reads do not
+// go beyond the mapping. The only dependency between consecutive keys is
+// the sum of the deltas.
+template <typename T>
+size_t TraceReader<T>::read(Cursor& cursor, T* out, size_t count) {
+	size_t done = 0;
+	while (done < count) {
+		if (cursor.left == 0 && !openBlock(cursor))
+			break;
+		size_t c = std::min<size_t>(count - done, cursor.left);
+		const uint8_t* lengths = cursor.lengths;
+		const uint8_t* p = cursor.p;
+		uint32_t pos = cursor.pos;
+		uint64_t prev = static_cast<uint64_t>(static_cast<int64_t>(cursor.prev));
+		T* o = out + done;
+		for (size_t i = 0; i < c; i++, pos++) {
+			unsigned len = (lengths[pos / 2] >> ((pos % 2) * 4)) & 15;
+			uint64_t v;
+			std::memcpy(&v, p, sizeof(v));
+			v &= trace_len_mask[len];
+			p += len;
+			prev += (v >> 1) ^ (0 - (v & 1)); // zigzag
+			o[i] = static_cast<T>(static_cast<int64_t>(prev));
+		}
+		cursor.p = p;
+		cursor.pos = pos;
+		cursor.prev = static_cast<T>(static_cast<int64_t>(prev));
+		cursor.left -= c;
+		done += c;
+	}
+	return done;
+}
+
+template <typename T>
+typename TraceReader<T>::Cursor* TraceReader<T>::threadCursor() {
+	return thread_cursors.get([]{ return std::unique_ptr<Cursor>(new Cursor{0, 0}); });
+}
+
+template <typename T>
+void TraceReader<T>::next_batch(T* out, size_t count, RandEngine* /*rand_engine*/) {
+	Cursor& cursor = *threadCursor();
+	size_t done = 0;
+	while (true) {
+		done += read(cursor, out + done, count - done);
+		if (done == count)
+			return;
+		uint64_t b = next_block.fetch_add(1, std::memory_order_relaxed);
+		if (b >= blocks) {
+			if (!loop || blocks == 0)
+				throw std::out_of_range("end of the trace");
+			b %= blocks;
+		}
+		cursor.block     = b;
+		cursor.end_block = b + 1;
+	}
+}
+
+template <typename T>
+T TraceReader<T>::next(RandEngine* /*rand_engine*/) {
+	T ret;
+	next_batch(&ret, 1);
+	return ret;
+}
+
+template <typename T>
+std::unique_ptr<RandEngine> TraceReader<T>::newEngine(RandEngine::type_t type) {
+	return newRandEngine(type);
+}
+
+template class TraceReader<int32_t>;
+template class TraceReader<int64_t>;
+
+////////////////////////////////////////////////////////////////////////////////////
+#undef __CLASS__
+#define __CLASS__ "CountMinSketch::"
+
+void CountMinSketch::checkArgs(uint32_t width, uint32_t depth) {
+	if (width == 0 || width > (1U << 30) || depth == 0)
+		throw std::invalid_argument(sprintf("invalid count-min sketch dimensions: width=%u, depth=%u", width, depth));
+}
+
+CountMinSketch::CountMinSketch(uint32_t width_, uint32_t depth): width(1), depth(depth) {
+	checkArgs(width_, depth);
+	while (width < width_)
+		width <<= 1;
+	PRINT_DEBUG("width = %s, depth = %s", v2s(width), v2s(depth));
+
+	size_t size = static_cast<size_t>(width) * depth;
+	counters.reset(new std::atomic<uint32_t>[size]);
+	for (size_t i = 0; i < size; i++)
+		counters[i].store(0, std::memory_order_relaxed);
+}
+
+// the rows use the hashes h1 + i * h2 (Kirsch and Mitzenmacher)
+uint64_t CountMinSketch::add(uint64_t key, uint32_t count) {
+	uint64_t h = mix64(key + 0x9e3779b97f4a7c15ULL);
+	uint32_t h1 = static_cast<uint32_t>(h), h2 = static_cast<uint32_t>(h >> 32) | 1;
+	const uint32_t mask = width - 1;
+	auto row = counters.get();
+	uint32_t ret = UINT32_MAX;
+	for (uint32_t i = 0; i < depth; i++, row += width) {
+		auto& c = row[(h1 + i * h2) & mask];
+		uint32_t v = c.load(std::memory_order_relaxed) + count; // single writer
+		v = v >= count ? v : UINT32_MAX;
+		c.store(v, std::memory_order_relaxed);
+		ret = std::min(ret, v);
+	}
+	return ret;
+}
+
+uint64_t CountMinSketch::estimate(uint64_t key) const {
+	uint64_t h = mix64(key + 0x9e3779b97f4a7c15ULL);
+	uint32_t h1 = static_cast<uint32_t>(h), h2 = static_cast<uint32_t>(h >> 32) | 1;
+	const uint32_t mask = width - 1;
+	auto row = counters.get();
+	uint32_t ret = UINT32_MAX;
+	for (uint32_t i = 0; i < depth; i++, row += width)
+		ret = std::min(ret, row[(h1 + i * h2) & mask].load(std::memory_order_relaxed));
+	return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////////
+#undef __CLASS__
+#define __CLASS__ "SpaceSaving::"
+
+void SpaceSaving::checkArgs(uint32_t k) {
+	if (k == 0 || k > (1U << 30))
+		throw std::invalid_argument(sprintf("invalid number of counters: %u", k));
+}
+
+SpaceSaving::SpaceSaving(uint32_t k): k(k) {
+	PRINT_DEBUG("k = %s", v2s(k));
+	checkArgs(k);
+	uint32_t size = 2;
+	while (size < 2 * k)
+		size <<= 1;
+	index.assign(size, 0);
+	index_mask = size - 1;
+	heap.reserve(k);
+}
+
+static inline uint32_t space_saving_home(uint64_t key, uint32_t mask) {
+	return static_cast<uint32_t>(mix64(key)) & mask;
+}
+
+inline uint32_t SpaceSaving::find(uint64_t key) const {
+	uint32_t slot = space_saving_home(key, index_mask);
+	while (index[slot] != 0 && heap[index[slot] - 1].key != key)
+		slot = (slot + 1) & index_mask;
+	return slot;
+}
+
+// linear probing deletion by backward shift (no tombstones)
+void SpaceSaving::erase(uint32_t slot) {
+	index[slot] = 0;
+	for (uint32_t j = (slot + 1) & index_mask; index[j] != 0; j = (j + 1) & index_mask) {
+		uint32_t home = space_saving_home(heap[index[j] - 1].key, index_mask);
+		// the entry at j can fill the hole if its home is not in (slot, j]
+		if (((j - home) & index_mask) >= ((j - slot) & index_mask)) {
+			index[slot] = index[j];
+			heap[index[slot] - 1].slot = slot;
+			index[j] = 0;
+			slot = j;
+		}
+	}
+}
+
+inline void SpaceSaving::place(uint32_t pos, const Counter& c) {
+	heap[pos] = c;
+	index[c.slot] = pos + 1;
+}
+
+void SpaceSaving::siftUp(uint32_t pos) {
+	Counter c = heap[pos];
+	while (pos > 0) {
+		uint32_t parent = (pos - 1) / 2;
+		if (heap[parent].count <= c.count)
+			break;
+		place(pos, heap[parent]);
+		pos = parent;
+	}
+	place(pos, c);
+}
+
+void SpaceSaving::siftDown(uint32_t pos) {
+	Counter c = heap[pos];
+	const uint32_t size = heap.size();
+	while (true) {
+		uint32_t child = 2 * pos + 1;
+		if (child >= size)
+			break;
+		if (child + 1 < size && heap[child + 1].count < heap[child].count)
+			child++;
+		if (c.count <= heap[child].count)
+			break;
+		place(pos, heap[child]);
+		pos = child;
+	}
+	place(pos, c);
+}
+
+void SpaceSaving::add(uint64_t key, uint64_t count, uint64_t upper_bound) {
+	uint32_t slot = find(key);
+	if (index[slot] != 0) {
+		uint32_t pos = index[slot] - 1;
+		heap[pos].count += count;
+		siftDown(pos);
+		return;
+	}
+	if (heap.size() == k && upper_bound <= heap[0].count)
+		return; // it would not rank above the evicted key
+
+	Counter c;
+	if (heap.size() < k) {
+		c.key   = key;
+		c.count = count;
+		c.error = 0;
+		c.slot  = slot;
+		heap.push_back(c);
+		siftUp(heap.size() - 1);
+		return;
+	}
+
+	// replaces the key with the minimum count
+	c = heap[0];
+	erase(c.slot);
+	c.key   = key;
+	c.error = c.count;
+	c.count += count;
+	c.slot  = find(key);
+	place(0, c);
+	siftDown(0);
+}
+
+uint64_t SpaceSaving::minCount() const {
+	return heap.size() < k ? 0 : heap[0].count;
+}
+
+std::vector<SpaceSaving::Item> SpaceSaving::items() const {
+	std::vector<Item> ret(heap.begin(), heap.end());
+	std::sort(ret.begin(), ret.end(), [](const Item& a, const Item& b) { return a.count > b.count; });
+	return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////////
+#undef __CLASS__
+#define __CLASS__ "SkewMonitor::"
+
+// keys buffered per thread by record()
+static const size_t skew_buffer_size = 256;
+
+struct SkewMonitor::Shard {
+	std::mutex            mutex;    // summary, taken by the writer when applying keys and by reports
+	CountMinSketch        sketch;   // written only by the owner thread
+	SpaceSaving           summary;
+	std::atomic<uint64_t> total {0};
+	uint64_t              seen = 0; // accessed only by the owner thread
+	uint32_t              skip = 0; // keys not sampled since the last sampled one
+	size_t                used = 0; // of buffer
+	uint64_t              buffer[skew_buffer_size];
+
+	Shard(uint32_t width, uint32_t depth, uint32_t k) : sketch(width, depth), summary(k) {}
+};
+
+SkewMonitor::SkewMonitor(uint32_t top_k, uint32_t width, uint32_t depth, uint32_t sample_every):
+	width(width), depth(depth), k(top_k), sample_every(sample_every), shards(true)
+{
+	PRINT_DEBUG("top_k = %s, width = %s, depth = %s, sample_every = %s", v2s(top_k), v2s(width), v2s(depth), v2s(sample_every));
+	if (sample_every == 0)
+		throw std::invalid_argument("invalid sampling interval: 0");
+	CountMinSketch::checkArgs(width, depth);
+	SpaceSaving::checkArgs(top_k);
+}
+
+SkewMonitor::~SkewMonitor() {}
+
+inline SkewMonitor::Shard* SkewMonitor::shard() {
+	return shards.get([this]{ return std::unique_ptr<Shard>(new Shard(width, depth, k)); });
+}
+
+void SkewMonitor::apply(Shard* s, const uint64_t* keys, size_t count) {
+	assert(count <= skew_buffer_size);
+	uint64_t bounds[skew_buffer_size];
+	for (size_t i = 0; i < count; i++)
+		bounds[i] = s->sketch.add(keys[i]);
+	{
+		std::lock_guard<std::mutex> lock(s->mutex);
+		for (size_t i = 0; i < count; i++)
+			s->summary.add(keys[i], 1, bounds[i]);
+	}
+	s->total.store(s->seen, std::memory_order_relaxed);
+}
+
+void SkewMonitor::record(uint64_t key) {
+	Shard* s = shard();
+	s->seen++;
+	if (++s->skip < sample_every)
+		return;
+	s->skip = 0;
+	s->buffer[s->used++] = key;
+	if (s->used == skew_buffer_size) {
+		apply(s, s->buffer, s->used);
+		s->used = 0;
+	}
+}
+
+template <typename T>
+void SkewMonitor::record_batch(const T* keys, size_t count) {
+	Shard* s = shard();
+	uint64_t aux[skew_buffer_size];
+	size_t c = 0;
+	s->seen += count;
+	for (size_t i = sample_every - 1 - s->skip; i < count; i += sample_every) {
+		aux[c++] = static_cast<uint64_t>(keys[i]);
+		if (c == skew_buffer_size) {
+			apply(s, aux, c);
+			c = 0;
+		}
+	}
+	if (c > 0)
+		apply(s, aux, c);
+	s->skip = static_cast<uint32_t>((s->skip + count) % sample_every);
+}
+
+template void SkewMonitor::record_batch<int32_t>(const int32_t* keys, size_t count);
+template void SkewMonitor::record_batch<int64_t>(const int64_t* keys, size_t count);
+template void SkewMonitor::record_batch<uint64_t>(const uint64_t* keys, size_t count);
+
+void SkewMonitor::flush() {
+	Shard* s = shard();
+	if (s->used > 0) {
+		apply(s, s->buffer, s->used);
+		s->used = 0;
+	}
+}
+
+uint64_t SkewMonitor::getTotal() {
+	uint64_t ret = 0;
+	for (auto s : shards.all())
+		ret += s->total.load(std::memory_order_relaxed);
+	return ret;
+}
+
+// sum of the shard estimates: each one is an upper bound of its shard's count
+uint64_t SkewMonitor::estimate(uint64_t key) {
+	uint64_t ret = 0;
+	for (auto s : shards.all())
+		ret += s->sketch.estimate(key);
+	return ret * sample_every;
+}
+
+std::vector<SpaceSaving::Item> SkewMonitor::topK() {
+	std::vector<Shard*> all = shards.all();
+
+	// A key missing from a shard's summary has at most the shard's minimum
+	// count there, so it adds that minimum to both the count and the error.
+	// Unsigned wrap-around in the partial sums is harmless.
+	std::vector<std::vector<SpaceSaving::Item>> items(all.size());
+	std::vector<uint64_t> mins(all.size());
+	uint64_t min_sum = 0;
+	for (size_t i = 0; i < all.size(); i++) {
+		std::lock_guard<std::mutex> lock(all[i]->mutex);
+		items[i] = all[i]->summary.items();
+		mins[i] = all[i]->summary.minCount();
+		min_sum += mins[i];
+	}
+	std::unordered_map<uint64_t, SpaceSaving::Item> merged;
+	for (size_t i = 0; i < all.size(); i++) {
+		for (auto& item : items[i]) {
+			auto it = merged.emplace(item.key, SpaceSaving::Item{item.key, min_sum, min_sum}).first;
+			it->second.count += item.count - mins[i];
+			it->second.error += item.error - mins[i];
+		}
+	}
+
+	// the sketches give another upper bound for the count
+	std::vector<SpaceSaving::Item> ret;
+	ret.reserve(merged.size());
+	for (auto& m : merged) {
+		auto item = m.second;
+		uint64_t lower = item.count - item.error;
+		uint64_t cms = 0;
+		for (auto s : all)
+			cms += s->sketch.estimate(item.key);
+		if (cms < item.count) {
+			item.count = std::max(cms, lower);
+			item.error = item.count - lower;
+		}
+		item.count *= sample_every;
+		item.error *= sample_every;
+		ret.push_back(item);
+	}
+	std::sort(ret.begin(), ret.end(), [](const SpaceSaving::Item& a, const SpaceSaving::Item& b) { return a.count > b.count; });
+	if (ret.size() > k)
+		ret.resize(k);
+	return ret;
+}
+
+double SkewMonitor::estimateTheta(uint32_t max_ranks) {
+	auto items = topK();
+	if (max_ranks == 0)
+		max_ranks = std::max<uint32_t>(k / 4, 2);
+
+	double sx = 0, sy = 0, sxx = 0, sxy = 0;
+	uint32_t m = 0;
+	for (auto& item : items) {
+		if (m >= max_ranks || item.count == 0 || item.error > item.count / 4)
+			break;
+		m++;
+		double x = std::log(static_cast<double>(m));
+		double y = std::log(static_cast<double>(item.count));
+		sx += x; sy += y; sxx += x * x; sxy += x * y;
+	}
+	if (m < 2)
+		return std::nan("");
+	return -(m * sxy - sx * sy) / (m * sxx - sx * sx);
+}
 
 } // namespace alutils
@@ -171,7 +171,7 @@ void Socket::thread_server_child(int fd) noexcept {
 				if (stop_ || !active) break;
 
 				if (r2 > 0){
-					PRINT_DEBUG("%s: r2 = %d", Type2Str, r2);
+					PRINT_DEBUG("%s: r2 = %ld", Type2Str, r2);
 					buffer.get()[r2] = '\0';
 					PRINT_DEBUG("%s: message received: %s", Type2Str, buffer.get());
 
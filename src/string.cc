@@ -11,9 +11,17 @@
 #include <stdexcept>
 #include <memory>
 #include <type_traits>
+#include <charconv>
+#include <cstring>
+#include <cmath>
+#include <limits>
 
 #include <stdarg.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 namespace alutils {
 
 ////////////////////////////////////////////////////////////////////////////////////
@@ -22,6 +30,13 @@ namespace alutils {
 
 const char* strip_default = " \t\n\r\f\v";
 
+std::string_view strip_view(std::string_view src, const char* to_strip) {
+	auto first = src.find_first_not_of(to_strip);
+	if (first == std::string_view::npos)
+		return src.substr(0, 0);
+	return src.substr(first, src.find_last_not_of(to_strip) - first + 1);
+}
+
 std::string& inplace_strip(std::string& src, const char* to_strip) {
 	src.erase(src.find_last_not_of(to_strip) +1);
 	src.erase(0, src.find_first_not_of(to_strip));
@@ -40,89 +55,372 @@ std::string& str_replace(std::string& dest, const std::string& src, const char f
 	return dest;
 }
 
-int split_columns(std::vector<std::string>& ret, const char* str, const char* prefix) {
-	std::cmatch cm;
-	auto flags = std::regex_constants::match_any;
-	std::string str_aux;
+std::string_view& inplace_strip(std::string_view& src, const char* to_strip) {
+	src = strip_view(src, to_strip);
+	return src;
+}
+
+////////////////////////////////////////////////////////////////////////////////////
+#undef __CLASS__
+#define __CLASS__ "Tokenizer::"
+
+// strip_default characters
+static inline bool is_space(char c) {
+	return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+static const uint64_t swar_ones   = 0x0101010101010101ULL;
+static const uint64_t swar_spaces = 0x2020202020202020ULL;
+
+static inline uint64_t load64(const char* p) {
+	uint64_t x;
+	std::memcpy(&x, p, sizeof(x));
+	return x;
+}
+
+static inline const char* skip_space(const char* p, const char* end) {
+	// aligned columns have long runs of ' '
+	while (end - p >= 8 && load64(p) == swar_spaces)
+		p += 8;
+	while (p != end && is_space(*p))
+		p++;
+	return p;
+}
+
+static inline const char* find_space(const char* p, const char* end) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	// whitespace bytes are <= 0x20: the first byte < 0x21 of the word is a
+	// candidate (borrows only cause false positives after the first one)
+	while (end - p >= 8) {
+		uint64_t x = load64(p);
+		uint64_t m = (x - swar_ones * 0x21) & ~x & (swar_ones * 0x80);
+		if (m == 0) {
+			p += 8;
+			continue;
+		}
+		p += __builtin_ctzll(m) / 8;
+		if (is_space(*p))
+			return p;
+		p++; // other control character
+	}
+#endif
+	while (p != end && !is_space(*p))
+		p++;
+	return p;
+}
+
+static inline const char* find_delimiter(const char* p, const char* end, std::string_view delimiter) {
+	const size_t size = delimiter.size();
+	while (static_cast<size_t>(end - p) >= size) {
+		auto q = static_cast<const char*>(std::memchr(p, delimiter[0], end - p - size + 1));
+		if (q == nullptr)
+			return nullptr;
+		if (std::memcmp(q + 1, delimiter.data() + 1, size - 1) == 0)
+			return q;
+		p = q + 1;
+	}
+	return nullptr;
+}
+
+bool Tokenizer::next(std::string_view& token) {
+	const char* p = src.data();
+	const char* end = p + src.size();
+
+	if (mode == WHITESPACE) {
+		p = skip_space(p, end);
+		if (p == end) {
+			src = std::string_view(end, 0);
+			return false;
+		}
+		const char* q = find_space(p, end);
+		token = std::string_view(p, q - p);
+		src = std::string_view(q, end - q);
+		return true;
+	}
+
+	if (done)
+		return false;
+
+	const char* q = nullptr;
+	size_t delimiter_size = 1;
+	if (src.size() > 0) {
+		if (mode == CHAR) {
+			q = static_cast<const char*>(std::memchr(p, delimiter_char, src.size()));
+		} else if (delimiter.size() > 0) {
+			q = find_delimiter(p, end, delimiter);
+			delimiter_size = delimiter.size();
+		}
+	}
+	if (q == nullptr) { // last token
+		token = src;
+		src = std::string_view(end, 0);
+		done = true;
+	} else {
+		token = std::string_view(p, q - p);
+		src = std::string_view(q + delimiter_size, end - q - delimiter_size);
+	}
+	if (strip)
+		token = strip_view(token);
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////
+#undef __CLASS__
+#define __CLASS__ ""
 
+int split_columns(std::vector<std::string>& ret, const char* str, const char* prefix) {
+	std::string_view src(str);
 	ret.clear();
 
 	if (prefix != nullptr) {
+		std::cmatch cm;
 		std::string aux = prefix; aux += "\\s+(.+)";
-		std::regex_search(str, cm, std::regex(aux.c_str()), flags);
+		std::regex_search(str, cm, pattern_cache.get(aux)->regex(), std::regex_constants::match_any);
 		if (cm.size() < 2)
 			return 0;
-
-		str_aux = cm[1].str();
-		str = str_aux.c_str();
+		src = std::string_view(cm[1].first, cm[1].length());
 	}
 
-	for (const char* i = str;;) {
-		std::regex_search(i, cm, std::regex("([^\\s]+)\\s*(.*)"), flags);
-		if (cm.size() >= 3) {
-			ret.push_back(cm[1].str());
-			i = cm[2].first;
-		} else {
-			break;
-		}
-	}
+	for (auto token : Tokenizer(src))
+		ret.emplace_back(token);
 
 	return ret.size();
 }
 
 std::vector<std::string> split_str(const std::string& str, const std::string& delimiter) {
 	std::vector<std::string> ret;
-	std::string aux = str;
-	auto pos = std::string::npos;
+	for (auto token : Tokenizer(str, delimiter, true))
+		ret.emplace_back(token);
+	return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////////
+#undef __CLASS__
+#define __CLASS__ "ColumnParser::"
 
-	while ((pos = aux.find(delimiter)) != std::string::npos) {
-		ret.push_back(strip(aux.substr(0, pos)));
-		aux.erase(0, pos + delimiter.length());
+// bit i of ws: p[i] is whitespace (is_space); bit i of nl: p[i] is '\n'
+static inline void block_masks(const char* p, uint64_t& ws, uint64_t& nl) {
+	ws = nl = 0;
+#ifdef __SSE2__
+	const __m128i space   = _mm_set1_epi8(' ');
+	const __m128i tab     = _mm_set1_epi8('\t');
+	const __m128i four    = _mm_set1_epi8(4);
+	const __m128i newline = _mm_set1_epi8('\n');
+	const __m128i zero    = _mm_setzero_si128();
+	for (int i = 0; i < 4; i++) {
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16 * i));
+		// '\t'..'\r': (c - '\t') <= 4 as unsigned bytes
+		__m128i ctrl = _mm_cmpeq_epi8(_mm_subs_epu8(_mm_sub_epi8(v, tab), four), zero);
+		__m128i s = _mm_or_si128(ctrl, _mm_cmpeq_epi8(v, space));
+		ws |= (uint64_t)(uint16_t)_mm_movemask_epi8(s) << (16 * i);
+		nl |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, newline)) << (16 * i);
 	}
-	ret.push_back(strip(aux));
+#else
+	for (int i = 0; i < 64; i++) {
+		ws |= (uint64_t)is_space(p[i]) << i;
+		nl |= (uint64_t)(p[i] == '\n') << i;
+	}
+#endif
+}
 
-	return ret;
+ColumnParser::ColumnParser(const std::vector<type_t>& schema) : schema(schema) {
+	if (schema.empty())
+		throw std::invalid_argument("empty ColumnParser schema");
+	int64_columns.resize(schema.size());
+	double_columns.resize(schema.size());
+	string_columns.resize(schema.size());
 }
 
-////////////////////////////////////////////////////////////////////////////////////
-bool debug_parse = false;
+void ColumnParser::clear() {
+	for (auto& i : int64_columns)  i.clear();
+	for (auto& i : double_columns) i.clear();
+	for (auto& i : string_columns) i.clear();
+	rows = skipped = 0;
+}
 
-static bool stobool(const std::string& value) {
-	const std::vector<std::string> true_str  {"y","yes","t","true","1"};
-	const std::vector<std::string> false_str {"n","no","f","false","0"};
+const std::vector<int64_t>& ColumnParser::getInt64(size_t column) const {
+	if (column >= schema.size() || schema[column] != INT64)
+		throw std::invalid_argument(sprintf("column %lu is not an INT64 column", column));
+	return int64_columns[column];
+}
 
-	auto value_strip = strip(value);
-	for (auto i : true_str) {
-		if (value_strip == i)
-			return true;
+const std::vector<double>& ColumnParser::getDouble(size_t column) const {
+	if (column >= schema.size() || schema[column] != DOUBLE)
+		throw std::invalid_argument(sprintf("column %lu is not a DOUBLE column", column));
+	return double_columns[column];
+}
+
+const std::vector<std::string_view>& ColumnParser::getString(size_t column) const {
+	if (column >= schema.size() || schema[column] != STRING)
+		throw std::invalid_argument(sprintf("column %lu is not a STRING column", column));
+	return string_columns[column];
+}
+
+void ColumnParser::endRow(size_t fields) {
+	if (fields == 0)
+		return;
+	if (fields != schema.size()) {
+		staged.resize(staged.size() - std::min(fields, schema.size()));
+		skipped++;
+		return;
 	}
-	for (auto i : false_str) {
-		if (value_strip == i)
-			return false;
+	invalid.push_back(0);
+}
+
+template <typename T>
+static inline bool convert_field(std::string_view field, T& ret) {
+	const char* end = field.data() + field.size();
+	auto r = std::from_chars(field.data(), end, ret);
+	return r.ec == std::errc() && r.ptr == end;
+}
+
+template <typename T>
+static void compact_column(std::vector<T>& column, size_t base, const std::vector<uint8_t>& invalid) {
+	size_t dest = base;
+	for (size_t r = 0; r < invalid.size(); r++) {
+		if (!invalid[r])
+			column[dest++] = column[base + r];
 	}
-	throw std::runtime_error(sprintf("failed to convert the string \"%s\" to boolean", value.c_str()));
+	column.resize(dest);
 }
 
+void ColumnParser::convertStaged() {
+	const size_t n = invalid.size();
+	const size_t ncols = schema.size();
+	if (n == 0)
+		return;
 
-template<typename T> constexpr const char* get_validate_re() { return ".*"; }
-template<> constexpr const char* get_validate_re<int32_t>()  { return "^-{0,1}[0-9]+$"; }
-template<> constexpr const char* get_validate_re<int64_t>()  { return "^-{0,1}[0-9]+$"; }
-template<> constexpr const char* get_validate_re<uint32_t>() { return "^[0-9]+$"; }
-template<> constexpr const char* get_validate_re<uint64_t>() { return "^[0-9]+$"; }
-template<> constexpr const char* get_validate_re<double>()   { return "^-{0,1}([0-9]+\\.{0,1}[0-9]*|[0-9]*\\.[0-9]+)$"; }
+	// column by column: one type and one tight loop at a time
+	std::vector<size_t> base(ncols);
+	for (size_t c = 0; c < ncols; c++) {
+		const std::string_view* field = staged.data() + c;
+		switch (schema[c]) {
+			case INT64: {
+				auto& column = int64_columns[c];
+				base[c] = column.size();
+				column.resize(base[c] + n);
+				int64_t* out = column.data() + base[c];
+				for (size_t r = 0; r < n; r++, field += ncols)
+					invalid[r] |= !convert_field(*field, out[r]);
+				break;
+			}
+			case DOUBLE: {
+				auto& column = double_columns[c];
+				base[c] = column.size();
+				column.resize(base[c] + n);
+				double* out = column.data() + base[c];
+				for (size_t r = 0; r < n; r++, field += ncols)
+					invalid[r] |= !convert_field(*field, out[r]);
+				break;
+			}
+			case STRING: {
+				auto& column = string_columns[c];
+				base[c] = column.size();
+				column.resize(base[c] + n);
+				std::string_view* out = column.data() + base[c];
+				for (size_t r = 0; r < n; r++, field += ncols)
+					out[r] = *field;
+				break;
+			}
+			default:
+				break;
+		}
+	}
 
-template<typename T> static bool validate(const std::string& value) {
-	auto re_str = get_validate_re<T>();
-	return std::regex_match(value, std::regex(re_str));
+	size_t n_invalid = 0;
+	for (auto i : invalid)
+		n_invalid += i;
+	if (n_invalid > 0) {
+		for (size_t c = 0; c < ncols; c++) {
+			switch (schema[c]) {
+				case INT64:  compact_column(int64_columns[c], base[c], invalid); break;
+				case DOUBLE: compact_column(double_columns[c], base[c], invalid); break;
+				case STRING: compact_column(string_columns[c], base[c], invalid); break;
+				default: break;
+			}
+		}
+	}
+	rows += n - n_invalid;
+	skipped += n_invalid;
+	staged.clear();
+	invalid.clear();
 }
 
-template<typename T> inline T stoT(const std::string& value) { throw std::runtime_error("not implemented"); }
-template<> inline bool     stoT<bool>    (const std::string& value) { return stobool(value);     }
-template<> inline int32_t  stoT<int32_t> (const std::string& value) { return std::stol(value);   }
-template<> inline int64_t  stoT<int64_t> (const std::string& value) { return std::stoll(value);  }
-template<> inline uint32_t stoT<uint32_t>(const std::string& value) { return std::stoul(value);  }
-template<> inline uint64_t stoT<uint64_t>(const std::string& value) { return std::stoull(value); }
-template<> inline double   stoT<double>  (const std::string& value) { return std::stod(value);   }
+size_t ColumnParser::parse(std::string_view chunk, bool last) {
+	const char*  data = chunk.data();
+	const size_t size = chunk.size();
+	const size_t ncols = schema.size();
+	size_t   consumed = 0;   // end of the last complete line
+	size_t   fields = 0;     // in the current line
+	size_t   field_begin = 0;
+	bool     in_field = false;
+	uint64_t prev_ws = 1;    // the chunk begins as after whitespace
+	char     tail[64];
+
+	staged.clear();
+	invalid.clear();
+
+	for (size_t block = 0; block < size; block += 64) {
+		uint64_t ws, nl;
+		const size_t n = size - block;
+		if (n >= 64) {
+			block_masks(data + block, ws, nl);
+		} else { // padded with whitespace, which ends the last field
+			std::memcpy(tail, data + block, n);
+			std::memset(tail + n, ' ', 64 - n);
+			block_masks(tail, ws, nl);
+		}
+
+		// field boundaries are the whitespace transitions
+		uint64_t events = (ws ^ ((ws << 1) | prev_ws)) | nl;
+		prev_ws = ws >> 63;
+		while (events != 0) {
+			const int bit = __builtin_ctzll(events);
+			events &= events - 1;
+			const size_t pos = block + bit;
+
+			if (((ws >> bit) & 1) == 0) { // first character of a field
+				field_begin = pos;
+				in_field = true;
+				continue;
+			}
+			if (in_field) {
+				if (fields < ncols)
+					staged.emplace_back(data + field_begin, pos - field_begin);
+				fields++;
+				in_field = false;
+			}
+			if ((nl >> bit) & 1) {
+				endRow(fields);
+				fields = 0;
+				consumed = pos + 1;
+				if (invalid.size() == 1024) // converted while the fields are in cache
+					convertStaged();
+			}
+		}
+	}
+
+	if (last) {
+		if (in_field) { // the chunk size is a multiple of 64
+			if (fields < ncols)
+				staged.emplace_back(data + field_begin, size - field_begin);
+			fields++;
+		}
+		endRow(fields);
+		consumed = size;
+	} else if (fields > 0) { // incomplete line
+		staged.resize(staged.size() - std::min(fields, ncols));
+	}
+
+	convertStaged();
+	return consumed;
+}
+
+////////////////////////////////////////////////////////////////////////////////////
+#undef __CLASS__
+#define __CLASS__ ""
+
+bool debug_parse = false;
 
 template<typename T> constexpr const char* get_type_name()    { throw std::runtime_error("not implemented"); }
 template<> constexpr const char* get_type_name<bool>()        { return "boolean"; }
@@ -133,46 +431,83 @@ template<> constexpr const char* get_type_name<uint64_t>()    { return "uint64";
 template<> constexpr const char* get_type_name<double>()      { return "double";  }
 template<> constexpr const char* get_type_name<std::string>() { return "string";  }
 
-static const char* get_parse_error(std::string& dest, const char* error_msg, const std::string& value, const char* type) {
+// Validation and conversion of the whole string in a single from_chars pass,
+// without allocations. Accepted syntax:
+//   integers: -{0,1}[0-9]+ (no '-' for unsigned types), within the range of T
+//   double:   -{0,1}([0-9]+\.{0,1}[0-9]*|[0-9]*\.[0-9]+), no exponent, inf or nan
+//   boolean:  y, yes, t, true, 1, n, no, f, false or 0
+template<typename T> static bool convert(std::string_view value, T& ret) {
+	const char* end = value.data() + value.size();
+	auto r = std::from_chars(value.data(), end, ret);
+	return r.ec == std::errc() && r.ptr == end;
+}
+
+template<> bool convert<double>(std::string_view value, double& ret) {
+	const char* p = value.data();
+	const char* end = p + value.size();
+	if (p != end && *p == '-')
+		p++;
+	if (p == end || !((*p >= '0' && *p <= '9') || *p == '.')) // from_chars also accepts inf and nan
+		return false;
+	auto r = std::from_chars(value.data(), end, ret, std::chars_format::fixed);
+	return r.ec == std::errc() && r.ptr == end;
+}
+
+template<> bool convert<bool>(std::string_view value, bool& ret) {
+	static const std::string_view true_str[]  {"y","yes","t","true","1"};
+	static const std::string_view false_str[] {"n","no","f","false","0"};
+
+	for (auto i : true_str) {
+		if (value == i) {
+			ret = true;
+			return true;
+		}
+	}
+	for (auto i : false_str) {
+		if (value == i) {
+			ret = false;
+			return true;
+		}
+	}
+	return false;
+}
+
+static const char* get_parse_error(std::string& dest, const char* error_msg, std::string_view value, const char* type) {
 	if (error_msg != nullptr)
 		return error_msg;
-	dest = sprintf("failed to convert the string \"%s\" to type %s", value.c_str(), type);
+	dest = sprintf("failed to convert the string \"%.*s\" to type %s", (int)value.size(), value.data(), type);
 	return dest.c_str();
 }
 
 template<typename T>
-T parse(const std::string &value,
+T parse(std::string_view value,
         const bool required, const T default_, const char* error_msg,
         std::function<bool(T)> check_method)
 {
-	auto type_name = get_type_name<T>();
-	auto value_strip = strip(value);
-	std::string error_buffer;
+	auto value_strip = strip_view(value);
+	std::string error_buffer; // only used to build error messages
 
 	if (debug_parse)
-		PRINT_DEBUG("value=\"%s\"", value_strip.c_str());
-
-	if (required && (value_strip == "" || !validate<T>(value_strip)))
-		throw std::invalid_argument(get_parse_error(error_buffer, error_msg, value_strip, type_name));
+		PRINT_DEBUG("value=\"%.*s\"", (int)value_strip.size(), value_strip.data());
 
 	T ret = default_;
-	try {
-		if (value_strip != "")
-			ret = stoT<T>(value_strip);
-	} catch (std::exception& e) {
-		throw std::invalid_argument(get_parse_error(error_buffer, error_msg, value_strip, type_name));
+	if (value_strip.empty()) {
+		if (required)
+			throw std::invalid_argument(get_parse_error(error_buffer, error_msg, value_strip, get_type_name<T>()));
+	} else if (!convert<T>(value_strip, ret)) {
+		throw std::invalid_argument(get_parse_error(error_buffer, error_msg, value_strip, get_type_name<T>()));
 	}
 
 	if (check_method != nullptr && !check_method(ret))
-		throw std::invalid_argument(get_parse_error(error_buffer, error_msg, value_strip, type_name));
+		throw std::invalid_argument(get_parse_error(error_buffer, error_msg, value_strip, get_type_name<T>()));
 
 	if (debug_parse)
-		PRINT_DEBUG("string \"%s\" parsed to %s", value_strip.c_str(), std::to_string(ret).c_str());
+		PRINT_DEBUG("string \"%.*s\" parsed to %s", (int)value_strip.size(), value_strip.data(), std::to_string(ret).c_str());
 	return ret;
 }
 
 #define DECLARE_PARSE(TYPE)                                                   \
-    template TYPE parse<TYPE>(const std::string &value, const bool required,  \
+    template TYPE parse<TYPE>(std::string_view value, const bool required,    \
                               const TYPE default_, const char* error_msg,     \
                               std::function<bool(TYPE)> check_method)
 
@@ -183,12 +518,12 @@ DECLARE_PARSE(uint32_t);
 DECLARE_PARSE(uint64_t);
 DECLARE_PARSE(double);
 
-template<> std::string parse<std::string>(const std::string &value, const bool required,  \
+template<> std::string parse<std::string>(std::string_view value, const bool required,  \
                               const std::string default_, const char* error_msg,     \
                               std::function<bool(std::string)> check_method)
 {
 	std::string error_buffer;
-	std::string ret = value;
+	std::string ret(value);
 
 	if (required && ret == "")
 		throw std::invalid_argument(get_parse_error(error_buffer, error_msg, ret, get_type_name<std::string>()));
@@ -204,38 +539,58 @@ template<> std::string parse<std::string>(const std::string &value, const bool r
 ////////////////////////////////////////////////////////////////////////////////////
 bool debug_parseSuffix = false;
 
+// Splits the stripped value into -{0,1}[0-9]+\.{0,1}[0-9]* (empty if there
+// is no number) and the stripped rest
+static std::string_view split_number(std::string_view value, std::string_view& rest) {
+	const char* begin = value.data();
+	const char* end = begin + value.size();
+	const char* p = begin;
+	if (p != end && *p == '-')
+		p++;
+	const char* digits = p;
+	while (p != end && *p >= '0' && *p <= '9')
+		p++;
+	if (p != digits && p != end && *p == '.') {
+		p++;
+		while (p != end && *p >= '0' && *p <= '9')
+			p++;
+	}
+	if (p == digits)
+		p = begin; // no number
+	rest = strip_view(std::string_view(p, end - p));
+	return std::string_view(begin, p - begin);
+}
+
+// <number>\s*<suffix>, where number is -{0,1}[0-9]+\.{0,1}[0-9]* and must be
+// valid for T (see convert()), and suffix is empty or one of the suffixes
 template <typename T>
-T parseSuffix(const std::string& value, const std::map<std::string, T>& suffixes) {
-	std::cmatch cm;
-	std::string value_strip = strip(value);
+T parseSuffix(std::string_view value, const std::map<std::string, T>& suffixes) {
+	auto value_strip = strip_view(value);
+	std::string_view suf;
+	auto number = split_number(value_strip, suf);
 
-	std::regex_search(value_strip.c_str(), cm, std::regex("^(-{0,1}[0-9]+\\.{0,1}[0-9]*)\\s*(.*)$"));
 	if (debug_parseSuffix) {
-		PRINT_DEBUG("value='%s', cm[2]='%s', cm[2]='%s'", value.c_str(), cm.str(1).c_str(), cm.str(2).c_str());
+		PRINT_DEBUG("value='%.*s', number='%.*s', suffix='%.*s'", (int)value.size(), value.data(), (int)number.size(), number.data(), (int)suf.size(), suf.data());
 	}
 
 	T val;
-	try {
-		if (!validate<T>(cm.str(1)))
-			throw std::invalid_argument("validation error");
-		val = stoT<T>(cm.str(1));
-	} catch (const std::exception& e) {
-		throw std::runtime_error(sprintf("failed to convert value \"%s\" to type %s from the string \"%s\": %s", cm.str(1).c_str(), get_type_name<T>(), value_strip.c_str(), e.what()).c_str());
-	};
-
-	auto suf = strip(cm.str(2));
-	if (suf != "") {
-		for (auto i : suffixes) {
+	if (!convert<T>(number, val)) {
+		throw std::runtime_error(sprintf("failed to convert value \"%.*s\" to type %s from the string \"%.*s\": validation error",
+			(int)number.size(), number.data(), get_type_name<T>(), (int)value_strip.size(), value_strip.data()));
+	}
+
+	if (!suf.empty()) {
+		for (auto& i : suffixes) {
 			if (suf == i.first)
 				return val * i.second;
 		}
-		throw std::runtime_error(sprintf("invalid suffix \"%s\" in the string \"%s\"", suf.c_str(), value_strip.c_str()));
+		throw std::runtime_error(sprintf("invalid suffix \"%.*s\" in the string \"%.*s\"", (int)suf.size(), suf.data(), (int)value_strip.size(), value_strip.data()));
 	}
 	return val;
 }
 
 #define DECLARE_PARSE_SUFFIX(TYPE)                              \
-    template TYPE parseSuffix<TYPE>(const std::string& value,   \
+    template TYPE parseSuffix<TYPE>(std::string_view value,     \
                   const std::map<std::string, TYPE>& suffixes)
 
 DECLARE_PARSE_SUFFIX(int32_t);
@@ -245,20 +600,148 @@ DECLARE_PARSE_SUFFIX(uint64_t);
 DECLARE_PARSE_SUFFIX(double);
 
 ////////////////////////////////////////////////////////////////////////////////////
+struct Unit {
+	std::string_view name;
+	uint64_t         factor;
+};
 
-std::string vsprintf(const char* format, va_list args) {
-	std::unique_ptr<char[]> buffer;
-	va_list args_copy;
+static constexpr Unit size_units[] {
+	{"", 1}, {"B", 1},
+	{"K", 1000ULL}, {"KB", 1000ULL},
+	{"M", 1000000ULL}, {"MB", 1000000ULL},
+	{"G", 1000000000ULL}, {"GB", 1000000000ULL},
+	{"T", 1000000000000ULL}, {"TB", 1000000000000ULL},
+	{"Ki", 1ULL << 10}, {"KiB", 1ULL << 10},
+	{"Mi", 1ULL << 20}, {"MiB", 1ULL << 20},
+	{"Gi", 1ULL << 30}, {"GiB", 1ULL << 30},
+	{"Ti", 1ULL << 40}, {"TiB", 1ULL << 40},
+};
+
+static constexpr Unit duration_units[] { // nanoseconds
+	{"ns", 1}, {"us", 1000ULL}, {"ms", 1000000ULL}, {"s", 1000000000ULL},
+	{"m", 60000000000ULL}, {"min", 60000000000ULL}, {"h", 3600000000000ULL},
+};
+
+template <size_t N>
+static constexpr const Unit* find_unit(const Unit (&units)[N], std::string_view name) {
+	for (auto& i : units) {
+		if (i.name == name)
+			return &i;
+	}
+	return nullptr;
+}
+
+static_assert(find_unit(size_units, "Mi")->factor == 1048576, "size_units");
+static_assert(find_unit(duration_units, "ms")->factor == 1000000, "duration_units");
+
+// number * factor, exact for integers and rounded for fractional numbers.
+// False if number is invalid or the result does not fit in T.
+template <typename T>
+static bool scale_number(std::string_view number, uint64_t factor, T& ret) {
+	if (number.find('.') == std::string_view::npos) {
+		T val;
+		if (!convert<T>(number, val) || __builtin_mul_overflow(val, (T)factor, &ret))
+			return false;
+		return true;
+	}
+	double val;
+	if (!convert<double>(number, val))
+		return false;
+	double r = std::round(val * factor);
+	double limit = std::ldexp(1.0, std::numeric_limits<T>::digits); // 2^63 or 2^64, exact in a double
+	if (!(r < limit && r >= (std::is_signed<T>::value ? -limit : 0.0)))
+		return false;
+	ret = (T)r;
+	return true;
+}
+
+uint64_t parseSize(std::string_view value) {
+	auto value_strip = strip_view(value);
+	std::string_view unit_name;
+	auto number = split_number(value_strip, unit_name);
+	auto unit = find_unit(size_units, unit_name);
+
+	uint64_t ret;
+	if (unit == nullptr || !scale_number(number, unit->factor, ret))
+		throw std::invalid_argument(sprintf("invalid size \"%.*s\"", (int)value_strip.size(), value_strip.data()));
+	return ret;
+}
+
+std::chrono::nanoseconds parseDuration(std::string_view value, std::chrono::nanoseconds default_unit) {
+	auto value_strip = strip_view(value);
+	std::string_view unit_name;
+	auto number = split_number(value_strip, unit_name);
+
+	uint64_t factor = default_unit.count() > 0 ? default_unit.count() : 0;
+	if (!unit_name.empty()) {
+		auto unit = find_unit(duration_units, unit_name);
+		factor = unit ? unit->factor : 0;
+	}
 
-	for (size_t bs=256; bs*=2; bs<=1024) {
+	int64_t ret;
+	if (factor == 0 || !scale_number(number, factor, ret))
+		throw std::invalid_argument(sprintf("invalid duration \"%.*s\"", (int)value_strip.size(), value_strip.data()));
+	return std::chrono::nanoseconds(ret);
+}
+
+double parseRate(std::string_view value) {
+	auto value_strip = strip_view(value);
+	std::string_view rest;
+	auto number = split_number(value_strip, rest);
+
+	std::string_view per_name("s");
+	auto slash = rest.find('/');
+	if (slash != std::string_view::npos) {
+		per_name = strip_view(rest.substr(slash + 1));
+		rest = strip_view(rest.substr(0, slash));
+	}
+	if (rest.size() >= 3 && rest.substr(rest.size() - 3) == "ops") {
+		rest.remove_suffix(3);
+		inplace_strip(rest);
+	}
+	auto unit = find_unit(size_units, rest);
+	auto per = find_unit(duration_units, per_name);
+
+	double ret;
+	if (unit == nullptr || per == nullptr || !convert<double>(number, ret))
+		throw std::invalid_argument(sprintf("invalid rate \"%.*s\"", (int)value_strip.size(), value_strip.data()));
+	return ret * unit->factor * (1e9 / per->factor);
+}
+
+////////////////////////////////////////////////////////////////////////////////////
+
+// Formats into a stack buffer first, so the arguments can view the previous
+// content of buffer. The result is written into buffer only at the end.
+static std::string_view vsprintf_buffer(std::vector<char>& buffer, const char* format, va_list args) {
+	char local[1024];
+	va_list args_copy;
+	va_copy(args_copy, args);
+	auto r = vsnprintf(local, sizeof(local), format, args_copy);
+	va_end(args_copy);
+	if (r < 0)
+		return std::string_view();
+	if ((size_t)r < sizeof(local)) {
+		if ((size_t)r >= buffer.size())
+			buffer.resize(r + 1);
+		std::memcpy(buffer.data(), local, r + 1);
+	} else { // exact size known now: a single retry
+		std::vector<char> aux(r + 1);
 		va_copy(args_copy, args);
-		buffer.reset(new char[bs]);
-		auto r = vsnprintf(buffer.get(), bs, format, args_copy);
+		r = vsnprintf(aux.data(), aux.size(), format, args_copy);
 		va_end(args_copy);
-		if ((r >= 0) && (r < bs)) break;
+		buffer.swap(aux);
 	}
+	return std::string_view(buffer.data(), r);
+}
+
+std::string_view vsprintf_view(const char* format, va_list args) {
+	thread_local std::vector<char> buffer(256);
+	return vsprintf_buffer(buffer, format, args);
+}
 
-	return std::string(buffer.get());
+std::string vsprintf(const char* format, va_list args) {
+	thread_local std::vector<char> buffer(256);
+	return std::string(vsprintf_buffer(buffer, format, args));
 }
 
 std::string sprintf(const char* format, ...) {
@@ -269,18 +752,270 @@ std::string sprintf(const char* format, ...) {
 	return ret;
 }
 
+////////////////////////////////////////////////////////////////////////////////////
+#undef __CLASS__
+#define __CLASS__ ""
+
+namespace {
+struct FormatWriter {
+	char*  pos;
+	char*  end;    // last usable position (reserved for the null terminator)
+	size_t length = 0;
+
+	FormatWriter(char* buffer, size_t size) : pos(buffer), end(size ? buffer + size - 1 : buffer) {}
+
+	void put(const char* data, size_t size) {
+		length += size;
+		size_t room = end - pos;
+		if (size > room) size = room;
+		memcpy(pos, data, size);
+		pos += size;
+	}
+	void put(char c) {
+		length++;
+		if (pos < end) *pos++ = c;
+	}
+};
+
+struct FormatSpec {
+	int  precision = -1;
+	char type = 0;
+};
+} // namespace
+
+static void format_arg(FormatWriter& writer, const FormatArg& arg, const FormatSpec& spec, const char* format) {
+	char buffer[128];
+	std::to_chars_result r;
+	bool integer = (arg.type == FormatArg::INT || arg.type == FormatArg::UINT);
+	bool floating = (arg.type == FormatArg::DOUBLE);
+
+	if ( (spec.type == 'x' && !integer) ||
+	     ((spec.type == 'f' || spec.type == 'e' || spec.type == 'g') && !floating) ||
+	     (spec.precision >= 0 && !floating) )
+		throw std::invalid_argument(sprintf("invalid format spec for argument type in \"%s\"", format));
+
+	switch (arg.type) {
+		case FormatArg::INT:
+			r = std::to_chars(buffer, buffer + sizeof(buffer), arg.i, spec.type == 'x' ? 16 : 10);
+			writer.put(buffer, r.ptr - buffer);
+			break;
+		case FormatArg::UINT:
+			r = std::to_chars(buffer, buffer + sizeof(buffer), arg.u, spec.type == 'x' ? 16 : 10);
+			writer.put(buffer, r.ptr - buffer);
+			break;
+		case FormatArg::DOUBLE: {
+			if (spec.type == 0 && spec.precision < 0) {
+				r = std::to_chars(buffer, buffer + sizeof(buffer), arg.d);
+			} else {
+				std::chars_format fmt = spec.type == 'e' ? std::chars_format::scientific :
+				                        spec.type == 'g' ? std::chars_format::general :
+				                                           std::chars_format::fixed;
+				r = std::to_chars(buffer, buffer + sizeof(buffer), arg.d, fmt, spec.precision < 0 ? 6 : spec.precision);
+			}
+			if (r.ec == std::errc()) {
+				writer.put(buffer, r.ptr - buffer);
+			} else { // too long in fixed notation
+				r = std::to_chars(buffer, buffer + sizeof(buffer), arg.d, std::chars_format::scientific);
+				writer.put(buffer, r.ptr - buffer);
+			}
+			break;
+		}
+		case FormatArg::BOOL:
+			if (arg.b) writer.put("true", 4);
+			else       writer.put("false", 5);
+			break;
+		case FormatArg::CHAR:
+			writer.put(arg.c);
+			break;
+		case FormatArg::STRING:
+			writer.put(arg.s.data, arg.s.size);
+			break;
+		case FormatArg::POINTER:
+			writer.put("0x", 2);
+			r = std::to_chars(buffer, buffer + sizeof(buffer), (uintptr_t)arg.p, 16);
+			writer.put(buffer, r.ptr - buffer);
+			break;
+		default:
+			throw std::invalid_argument(sprintf("invalid format argument in \"%s\"", format));
+	}
+}
+
+size_t vformat_to(char* buffer, size_t size, const char* format, const FormatArg* args, size_t count) {
+	FormatWriter writer(buffer, size);
+	size_t next_arg = 0;
+	const char* p = format;
+
+	while (*p) {
+		const char* literal = p;
+		while (*p && *p != '{' && *p != '}') p++;
+		writer.put(literal, p - literal);
+		if (*p == 0) break;
+
+		if (p[1] == p[0]) { // "{{" or "}}"
+			writer.put(*p);
+			p += 2;
+			continue;
+		}
+		if (*p == '}')
+			throw std::invalid_argument(sprintf("unmatched '}' in format \"%s\"", format));
+
+		FormatSpec spec;
+		p++;
+		if (*p == ':') {
+			p++;
+			if (*p == '.') {
+				p++;
+				auto r = std::from_chars(p, p + strnlen(p, 3), spec.precision);
+				if (r.ec != std::errc())
+					throw std::invalid_argument(sprintf("invalid precision in format \"%s\"", format));
+				p = r.ptr;
+			}
+			if (*p == 'x' || *p == 'f' || *p == 'e' || *p == 'g')
+				spec.type = *p++;
+		}
+		if (*p != '}')
+			throw std::invalid_argument(sprintf("invalid placeholder in format \"%s\"", format));
+		p++;
+
+		if (next_arg >= count)
+			throw std::invalid_argument(sprintf("format \"%s\" has more placeholders than the %lu arguments", format, count));
+		format_arg(writer, args[next_arg++], spec, format);
+	}
+
+	if (next_arg != count)
+		throw std::invalid_argument(sprintf("format \"%s\" has %lu placeholders for %lu arguments", format, next_arg, count));
+	if (size > 0)
+		*writer.pos = '\0';
+	return writer.length;
+}
+
+std::string_view vformat(const char* format, const FormatArg* args, size_t count) {
+	// The arguments may view the previous result (format("{}", format(...))),
+	// so the thread-local buffer is written only after the formatting.
+	thread_local std::vector<char> buffer(256);
+	char local[1024];
+	size_t length = vformat_to(local, sizeof(local), format, args, count);
+	if (length < sizeof(local)) {
+		if (length >= buffer.size())
+			buffer.resize(length + 1);
+		std::memcpy(buffer.data(), local, length + 1);
+	} else {
+		std::vector<char> aux(length + 1);
+		vformat_to(aux.data(), aux.size(), format, args, count);
+		buffer.swap(aux); // aux (maybe viewed by args) is released after the formatting
+	}
+	return std::string_view(buffer.data(), length);
+}
+
+std::string vformat_str(const char* format, const FormatArg* args, size_t count) {
+	char local[1024];
+	size_t length = vformat_to(local, sizeof(local), format, args, count);
+	if (length < sizeof(local))
+		return std::string(local, length);
+	std::string ret(length, '\0');
+	vformat_to(ret.data(), length + 1, format, args, count); // writes the null terminator of ret
+	return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////////
+#undef __CLASS__
+#define __CLASS__ "Pattern::"
+
+Pattern::Pattern(const std::string& pattern) : pattern(pattern), regex_(pattern) {}
+
+////////////////////////////////////////////////////////////////////////////////////
+#undef __CLASS__
+#define __CLASS__ "PatternCache::"
+
+PatternCache pattern_cache;
+
+PatternCache::PatternCache(size_t capacity) : capacity(capacity) {
+	if (capacity == 0)
+		throw std::invalid_argument("the capacity of PatternCache must be greater than zero");
+}
+
+std::shared_ptr<const Pattern> PatternCache::get(const std::string& pattern) {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = index.find(pattern);
+		if (it != index.end()) {
+			hits++;
+			lru.splice(lru.begin(), lru, it->second);
+			return *it->second;
+		}
+		misses++;
+	}
+
+	// compiled without the lock: a concurrent miss of the same pattern
+	// compiles it twice, but keeps a single entry
+	auto compiled = std::make_shared<const Pattern>(pattern);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it = index.find(pattern);
+	if (it != index.end()) {
+		lru.splice(lru.begin(), lru, it->second);
+		return *it->second;
+	}
+	lru.push_front(compiled);
+	index[compiled->str()] = lru.begin();
+	while (lru.size() > capacity) {
+		index.erase(lru.back()->str());
+		lru.pop_back();
+	}
+	return compiled;
+}
+
+void PatternCache::setCapacity(size_t capacity_) {
+	if (capacity_ == 0)
+		throw std::invalid_argument("the capacity of PatternCache must be greater than zero");
+	std::lock_guard<std::mutex> lock(mutex);
+	capacity = capacity_;
+	while (lru.size() > capacity) {
+		index.erase(lru.back()->str());
+		lru.pop_back();
+	}
+}
+
+size_t PatternCache::size() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return lru.size();
+}
+
+uint64_t PatternCache::getHits() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return hits;
+}
+
+uint64_t PatternCache::getMisses() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return misses;
+}
+
+void PatternCache::clear() {
+	std::lock_guard<std::mutex> lock(mutex);
+	index.clear();
+	lru.clear();
+	hits = misses = 0;
+}
+
 ////////////////////////////////////////////////////////////////////////////////////
 #undef __CLASS__
 #define __CLASS__ "ParseRE::"
 
 ParseRE::ParseRE() {}
 
-ParseRE::ParseRE(const std::string& source, const std::string& pattern) : valid(false), value("") {
-	std::regex_search(source, sm, std::regex(pattern.c_str()), std::regex_constants::match_any);
+ParseRE::ParseRE(const std::string& source, const std::string& pattern)
+	: ParseRE(source, *pattern_cache.get(pattern)) {}
+
+ParseRE::ParseRE(const std::string& source, const std::string& pattern, std::string& dest)
+	: ParseRE(source, *pattern_cache.get(pattern), dest) {}
+
+ParseRE::ParseRE(const std::string& source, const Pattern& pattern) : valid(false), value("") {
+	std::regex_search(source, sm, pattern.regex(), std::regex_constants::match_any);
 	if (log_level == LOG_DEBUG) {
-		PRINT_DEBUG("source = \"%s\"; pattern = \"%s\"", source.c_str(), pattern.c_str());
-		for (int i=0; i<sm.size(); i++) {
-			PRINT_DEBUG("\tsm.str(%d) = %s", i, sm.str(i).c_str());
+		PRINT_DEBUG("source = \"%s\"; pattern = \"%s\"", source.c_str(), pattern.str().c_str());
+		for (size_t i=0; i<sm.size(); i++) {
+			PRINT_DEBUG("\tsm.str(%lu) = %s", i, sm.str(i).c_str());
 		}
 	}
 	if (sm.size() > 0) {
@@ -292,10 +1027,168 @@ ParseRE::ParseRE(const std::string& source, const std::string& pattern) : valid(
 	}
 }
 
-ParseRE::ParseRE(const std::string& source, const std::string& pattern, std::string& dest) : ParseRE(source, pattern) {
+ParseRE::ParseRE(const std::string& source, const Pattern& pattern, std::string& dest) : ParseRE(source, pattern) {
 	if (valid) {
 		dest = value;
 	}
 }
 
+////////////////////////////////////////////////////////////////////////////////////
+#undef __CLASS__
+#define __CLASS__ "PrefixNumberMatcher::"
+
+static inline bool is_digit(char c) {
+	return c >= '0' && c <= '9';
+}
+
+bool PrefixNumberMatcher::match(std::string_view source, std::string_view& number) const {
+	for (size_t pos = source.find(prefix); pos != std::string_view::npos; pos = source.find(prefix, pos + 1)) {
+		const char* p = source.data() + pos + prefix.size();
+		const char* end = source.data() + source.size();
+		while (p < end && is_space(*p)) p++;
+
+		const char* first = p;
+		if (p < end && *p == '-') p++;
+		const char* digits = p;
+		while (p < end && is_digit(*p)) p++;
+		if (p == digits)
+			continue;
+		if (p + 1 < end && *p == '.' && is_digit(p[1])) {
+			p++;
+			while (p < end && is_digit(*p)) p++;
+		}
+		number = std::string_view(first, p - first);
+		return true;
+	}
+	return false;
+}
+
+template <typename T>
+bool PrefixNumberMatcher::match(std::string_view source, T& value) const {
+	std::string_view number;
+	if (!match(source, number))
+		return false;
+	T ret;
+	auto r = std::from_chars(number.data(), number.data() + number.size(), ret);
+	if (r.ec != std::errc() || r.ptr != number.data() + number.size())
+		return false;
+	value = ret;
+	return true;
+}
+
+template bool PrefixNumberMatcher::match<int32_t>(std::string_view source, int32_t& value) const;
+template bool PrefixNumberMatcher::match<int64_t>(std::string_view source, int64_t& value) const;
+template bool PrefixNumberMatcher::match<uint32_t>(std::string_view source, uint32_t& value) const;
+template bool PrefixNumberMatcher::match<uint64_t>(std::string_view source, uint64_t& value) const;
+template bool PrefixNumberMatcher::match<double>(std::string_view source, double& value) const;
+
+////////////////////////////////////////////////////////////////////////////////////
+#undef __CLASS__
+#define __CLASS__ ""
+
+uint64_t fnv1a64(uint64_t value) {
+	uint64_t h = 0xcbf29ce484222325ULL;
+	for (int i = 0; i < 8; i++) {
+		h ^= value & 0xff;
+		h *= 0x100000001b3ULL;
+		value >>= 8;
+	}
+	return h;
+}
+
+////////////////////////////////////////////////////////////////////////////////////
+#undef __CLASS__
+#define __CLASS__ "KeyFormatter::"
+
+static const char digit_pairs[201] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+static inline uint32_t count_digits(uint64_t v) {
+	uint32_t n = 1;
+	while (v >= 10000) { v /= 10000; n += 4; }
+	if (v >= 1000) return n + 3;
+	if (v >= 100)  return n + 2;
+	if (v >= 10)   return n + 1;
+	return n;
+}
+
+// writes the digits of v ending at end, two at a time
+static inline void write_digits(uint64_t v, char* end) {
+	while (v >= 100) {
+		auto i = (v % 100) * 2;
+		v /= 100;
+		*--end = digit_pairs[i + 1];
+		*--end = digit_pairs[i];
+	}
+	if (v >= 10) {
+		*--end = digit_pairs[v * 2 + 1];
+		*--end = digit_pairs[v * 2];
+	} else {
+		*--end = '0' + static_cast<char>(v);
+	}
+}
+
+KeyFormatter::KeyFormatter(const std::string& prefix, uint32_t width, encoding_t encoding, bool hash):
+	prefix(prefix), width(width), encoding(encoding), hash(hash)
+{
+	PRINT_DEBUG("prefix = \"%s\", width = %u, encoding = %d, hash = %d", prefix.c_str(), width, encoding, hash);
+	if (encoding == BINARY) {
+		if (width > 8)
+			throw std::invalid_argument(sprintf("invalid width for binary keys: %u", width));
+		if (width == 0)
+			this->width = 8;
+		max_size = prefix.size() + this->width;
+	} else {
+		if (width > 1024)
+			throw std::invalid_argument(sprintf("invalid width for decimal keys: %u", width));
+		max_size = prefix.size() + std::max<size_t>(width, 20);
+	}
+}
+
+size_t KeyFormatter::format(uint64_t key, char* buffer) const {
+	if (hash)
+		key = fnv1a64(key);
+	const size_t p = prefix.size();
+	std::memcpy(buffer, prefix.data(), p);
+	char* b = buffer + p;
+
+	if (encoding == BINARY) {
+		for (uint32_t i = 0; i < width; i++)
+			b[i] = static_cast<char>(key >> ((width - 1 - i) * 8));
+		return p + width;
+	}
+
+	uint32_t digits = count_digits(key);
+	uint32_t len = std::max(digits, width);
+	std::memset(b, '0', len - digits);
+	write_digits(key, b + len);
+	return p + len;
+}
+
+std::string KeyFormatter::str(uint64_t key) const {
+	std::string ret(max_size, '\0');
+	ret.resize(format(key, &ret[0]));
+	return ret;
+}
+
+template <typename T>
+void KeyFormatter::format_batch(const T* keys, size_t count, char* arena, std::string_view* out) const {
+	for (size_t i = 0; i < count; i++, arena += max_size)
+		out[i] = std::string_view(arena, format(static_cast<uint64_t>(keys[i]), arena));
+}
+
+template void KeyFormatter::format_batch<int32_t> (const int32_t*  keys, size_t count, char* arena, std::string_view* out) const;
+template void KeyFormatter::format_batch<int64_t> (const int64_t*  keys, size_t count, char* arena, std::string_view* out) const;
+template void KeyFormatter::format_batch<uint32_t>(const uint32_t* keys, size_t count, char* arena, std::string_view* out) const;
+template void KeyFormatter::format_batch<uint64_t>(const uint64_t* keys, size_t count, char* arena, std::string_view* out) const;
+
 } // namespace alutils
@@ -0,0 +1,96 @@
+// Copyright (c) 2020-present, Adriano Lange.  All rights reserved.
+// This source code is licensed under both the GPLv2 (found in the
+// LICENSE.GPLv2 file in the root directory) and Apache 2.0 License
+// (found in the LICENSE.Apache file in the root directory).
+
+#include <alutils/print.h>
+#include <alutils/arrival.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <vector>
+
+#include <stdio.h>
+
+using namespace alutils;
+
+static void gap_stats(ArrivalProcess& arrivals, size_t n, double& mean, double& cv) {
+	double sum = 0, sum2 = 0;
+	for (size_t i = 0; i < n; i++) {
+		double g = arrivals.nextGap();
+		sum += g;
+		sum2 += g * g;
+	}
+	mean = sum / n;
+	cv = std::sqrt(sum2 / n - mean * mean) / mean;
+}
+
+int main(int argc, char** argv) {
+	printf("\n\n=====================\narrival-test:\n");
+	log_level = LOG_DEBUG;
+
+	{
+		printf("\ngaps\n");
+		double mean, cv;
+		const size_t n = 2000000;
+
+		ArrivalProcess exponential(1000000);
+		gap_stats(exponential, n, mean, cv);
+		printf("exponential: mean = %.1f ns, cv = %.3f\n", mean, cv);
+		assert( std::abs(mean - 1000) < 10 && std::abs(cv - 1) < 0.01 );
+
+		ArrivalProcess uniform(1000000, ARRIVAL_UNIFORM);
+		gap_stats(uniform, n, mean, cv);
+		printf("uniform:     mean = %.1f ns, cv = %.3f\n", mean, cv);
+		assert( std::abs(mean - 1000) < 10 && std::abs(cv - 1/std::sqrt(3)) < 0.01 );
+
+		MMPPParams mmpp;
+		mmpp.burst_duration = 0.0001;
+		ArrivalProcess bursty(1000000, ARRIVAL_MMPP, mmpp);
+		gap_stats(bursty, n * 5, mean, cv);
+		printf("mmpp:        mean = %.1f ns, cv = %.3f\n", mean, cv);
+		assert( std::abs(mean - 1000) < 30 && cv > 1.2 );
+
+		exponential.setRate(2000);
+		assert( exponential.getRate() == 2000 );
+		gap_stats(exponential, n, mean, cv);
+		assert( std::abs(mean - 500000) < 5000 );
+
+		bool error = false;
+		try { exponential.setRate(0); } catch (std::invalid_argument& e) { error = true; }
+		assert( error );
+
+		std::vector<uint64_t> deadlines(1000);
+		exponential.start(0);
+		exponential.next_batch(deadlines.data(), deadlines.size());
+		assert( std::is_sorted(deadlines.begin(), deadlines.end()) && deadlines[0] > 0 );
+	}
+
+	ArrivalProcess::setTimerSlack(); // opt-in, precise wake ups for the waits below
+	for (double rate : {10000.0, 1000000.0}) {
+		printf("\nwait, rate = %.0f/s\n", rate);
+		ArrivalProcess arrivals(rate);
+		const size_t n = static_cast<size_t>(rate / 5);
+		std::vector<int64_t> lateness(n);
+		std::vector<uint64_t> deadlines(n);
+		uint64_t start = ArrivalProcess::now();
+		arrivals.start(start);
+		for (size_t i = 0; i < n; i++)
+			lateness[i] = arrivals.wait(&deadlines[i]);
+		uint64_t end = ArrivalProcess::now();
+		uint64_t deadline = deadlines[n-1];
+		std::sort(lateness.begin(), lateness.end());
+		// timing is reported only: lateness depends on the scheduler
+		printf("arrivals = %lu, elapsed = %.3f s, schedule = %.3f s, lateness: p50 = %ld ns, p99 = %ld ns, max = %ld ns\n",
+		       n, (end - start) / 1e9, (deadline - start) / 1e9, lateness[n/2], lateness[n*99/100], lateness[n-1]);
+		assert( lateness[0] >= 0 && end >= deadline );        // never returns before the deadline
+		assert( std::is_sorted(deadlines.begin(), deadlines.end()) && deadlines[0] >= start );
+		double mean_gap = static_cast<double>(deadline - start) / n; // open loop: independent of the waits
+		assert( std::abs(mean_gap * rate / 1e9 - 1) < 0.1 );
+	}
+	ArrivalProcess::setTimerSlack(0);
+
+	printf("OK!!\n");
+	return 0;
+}
@@ -83,6 +83,26 @@ int main(int argc, char** argv) {
 		assert( cmd3 == 333 );
 		assert( cmd4 );
 
+		// times below one second
+		Commands commands2;
+		commands2.registerCmd(new CmdUint32("c1", true, 0, &cmd1));
+		commands2.registerCmd(new CmdUint32("c2", true, 0, &cmd2));
+		try { commands2.monitorScript("-1s:c1=1"); fail=true; } catch (std::exception &e) { printf("Expected exception: %s\n", e.what()); }
+		try { commands2.monitorScript("1x:c1=1"); fail=true; } catch (std::exception &e) { printf("Expected exception: %s\n", e.what()); }
+		assert(!fail);
+		assert( ScriptCommand("1.5s: c1=2").time == std::chrono::milliseconds(1500) );
+		assert( ScriptCommand("250ms:c1=2").command == "c1=2" );
+		assert( ScriptCommand("2:c1=2").time == std::chrono::seconds(2) );
+		assert( ScriptCommand("1m:c1=2").time == std::chrono::minutes(1) );
+		cmd1 = cmd2 = 0;
+		auto start = std::chrono::steady_clock::now();
+		commands2.monitorScript("100ms:c1=1; 0.3s:c2=2", true);
+		while (cmd2 != 2 && std::chrono::steady_clock::now() - start < std::chrono::seconds(5))
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		auto elapsed = std::chrono::steady_clock::now() - start;
+		printf("script \"100ms:c1=1; 0.3s:c2=2\" done in %.3f s\n", std::chrono::duration<double>(elapsed).count());
+		assert( cmd1 == 1 && cmd2 == 2 );
+		assert( elapsed >= std::chrono::milliseconds(300) && elapsed < std::chrono::seconds(2) );
 	}
 	printf("OK!!\n");
 	return 0;
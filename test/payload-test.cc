@@ -0,0 +1,111 @@
+// Copyright (c) 2020-present, Adriano Lange.  All rights reserved.
+// This source code is licensed under both the GPLv2 (found in the
+// LICENSE.GPLv2 file in the root directory) and Apache 2.0 License
+// (found in the LICENSE.Apache file in the root directory).
+
+#include <alutils/print.h>
+#include <alutils/payload.h>
+
+#include <cassert>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <stdio.h>
+
+using namespace alutils;
+
+int main(int argc, char** argv) {
+	printf("\n\n=====================\npayload-test:\n");
+	log_level = LOG_DEBUG;
+
+	{
+		printf("\ncompressibility\n");
+		for (double ratio : {0.25, 0.5, 1.0}) {
+			PayloadGenerator payload(1000, ratio);
+			const std::string& pool = payload.getPool();
+			assert( pool.size() == 1 << 20 );
+			size_t raw = (size_t)(100 * ratio);
+			size_t repeated = 0;
+			for (size_t seg = 0; seg + 100 <= pool.size(); seg += 100)
+				for (size_t i = seg + raw; i < seg + 100; i++)
+					repeated += pool[i] == pool[i - raw];
+			for (auto c : pool)
+				assert( c >= ' ' && c <= '~' );
+			printf("ratio %.2f: repeated bytes %.3f\n", ratio, (double)repeated / pool.size());
+			assert( std::abs((double)repeated / pool.size() - (1 - ratio)) < 0.01 );
+		}
+	}
+
+	{
+		printf("\nvalue sizes\n");
+		PayloadGenerator fixed(100);
+		for (int i=0; i<1000; i++) {
+			auto v = fixed.next();
+			assert( v.size() == 100 );
+			assert( v.data() >= fixed.getPool().data() && v.data() + v.size() <= fixed.getPool().data() + fixed.getPool().size() );
+		}
+
+		PayloadGenerator uniform(SIZE_UNIFORM, 10, 19);
+		std::vector<size_t> hist(20, 0);
+		for (int i=0; i<100000; i++) {
+			auto s = uniform.nextSize();
+			assert( s >= 10 && s <= 19 );
+			hist[s]++;
+		}
+		for (int s=10; s<20; s++)
+			assert( std::abs(hist[s] / 100000.0 - 0.1) < 0.01 );
+
+		PayloadGenerator zipf(SIZE_ZIPF, 64, 4096, 0.5, 0.99);
+		std::vector<std::string_view> values(100000);
+		zipf.next_batch(values.data(), values.size());
+		size_t smallest = 0;
+		for (auto v : values) {
+			assert( v.size() >= 64 && v.size() <= 4096 );
+			if (v.size() == 64) smallest++;
+		}
+		assert( smallest > values.size() / 20 );
+
+		bool error = false;
+		try { fixed.next(101); } catch (std::invalid_argument& e) { error = true; }
+		assert( error );
+		error = false;
+		try { PayloadGenerator bad(SIZE_UNIFORM, 10, 5); } catch (std::invalid_argument& e) { error = true; }
+		assert( error );
+
+		std::vector<char> buffer(10000);
+		assert( fixed.fill(buffer.data(), buffer.size()) == buffer.size() );
+		for (auto c : buffer)
+			assert( c >= ' ' && c <= '~' );
+	}
+
+	{
+		printf("\nthroughput\n");
+		PayloadGenerator payload(SIZE_UNIFORM, 100, 4000);
+		std::vector<std::thread> threads;
+		for (int t=0; t<4; t++) {
+			threads.emplace_back([&payload]{
+				auto rand_engine = payload.newEngine();
+				const size_t n = 1000000;
+				size_t bytes = 0;
+				auto start = std::chrono::steady_clock::now();
+				for (size_t i=0; i<n; i++)
+					bytes += payload.next(rand_engine.get()).size();
+				std::chrono::duration<double> t = std::chrono::steady_clock::now() - start;
+				printf("views: %.1f ns/value, %.0f MB/s\n", t.count() * 1e9 / n, bytes / t.count() / 1e6);
+			});
+		}
+		for (auto& t : threads)
+			t.join();
+
+		std::vector<char> buffer(1 << 20);
+		auto start = std::chrono::steady_clock::now();
+		for (int i=0; i<1000; i++)
+			payload.fill(buffer.data(), buffer.size());
+		std::chrono::duration<double> t = std::chrono::steady_clock::now() - start;
+		printf("fill: %.0f MB/s\n", 1000.0 * buffer.size() / t.count() / 1e6);
+	}
+
+	printf("OK!!\n");
+	return 0;
+}
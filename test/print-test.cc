@@ -8,11 +8,24 @@
 
 #include <stdio.h>
 #include <stdarg.h>
+#include <cassert>
+#include <string>
+#include <string_view>
 
 using namespace alutils;
 
 ALUTILS_PRINT_WRAPPER(print2, printf("PRINT2: %s\n", msg.c_str()));
 
+std::string last;
+ALUTILS_PRINT_WRAPPER(print_last, last = msg.c_str());
+// prints from the print function, as a handler that also logs its errors
+ALUTILS_PRINT_WRAPPER(print_nested, print_last("inner %d", 2); last = std::string(msg.c_str()) + " / " + last);
+
+// wrappers written for a std::string msg
+static void store(const std::string& m) { last = m; }
+static size_t view_size(std::string_view m) { return m.size(); }
+ALUTILS_PRINT_WRAPPER(print_string, store(msg); last += std::to_string(view_size(msg)) + msg.str());
+
 int main(int argc, char** argv) {
 	printf("\n\n=====================\nprint-test:\n");
 	log_level = LOG_DEBUG_OUT;
@@ -28,6 +41,16 @@ int main(int argc, char** argv) {
     print_debug = print2;
 	print_debug    ("test2 %d %d %d", 1, 2, 3);
 
+	print_nested("outer %d", 1);
+	assert( last == "outer 1 / inner 2" );
+	std::string big(10000, 'x'); // beyond the initial buffer
+	print_last("<%s>", big.c_str());
+	assert( last == "<" + big + ">" );
+	print_last("%s %d", "short", 3);
+	assert( last == "short 3" );
+	print_string("abc%d", 4);
+	assert( last == "abc44abc4" );
+
 	printf("OK!!\n");
 	return 0;
 }
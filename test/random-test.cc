@@ -6,12 +6,21 @@
 #include <alutils/print.h>
 #include <alutils/string.h>
 #include <alutils/random.h>
+#include <alutils/io.h>
+#include <alutils/command.h>
 
+#include <algorithm>
 #include <cmath>
 #include <random>
 #include <cassert>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <unordered_map>
+#include <chrono>
 
 #include <stdio.h>
+#include <unistd.h>
 
 using namespace alutils;
 
@@ -23,6 +32,126 @@ int main(int argc, char** argv) {
 	printf("random-test:\n");
 	log_level = LOG_DEBUG_OUT;
 
+	{
+		printf("\nzeta\n");
+		auto zeta_loop = [](uint64_t n, double theta) {
+			double ans = 0;
+			for (double i=1; i<=n; i++)
+				ans += std::pow(1.0/i, theta);
+			return ans;
+		};
+		for (double theta : {0.5, 0.99, 1.0, 1.2, 2.0}) {
+			for (uint64_t n : {2, 10, 999, 1000, 1001, 5000, 123457, 2000000}) {
+				double expected = zeta_loop(n, theta);
+				double approx = zeta(n, theta);
+				double exact = zeta_exact(n, theta, 4);
+				printf("zeta(%s, %s) = %.15g, approx error = %.3g, exact error = %.3g\n",
+				       v2s(n), v2s(theta), expected,
+				       std::fabs(approx - expected)/expected, std::fabs(exact - expected)/expected);
+				assert( std::fabs(approx - expected)/expected < 1e-12 );
+				assert( std::fabs(exact - expected)/expected < 1e-12 );
+			}
+		}
+	}
+
+	{
+		printf("\ngrow\n");
+		const uint64_t n_final = 1000000;
+		ZipfDistributionUint64 zipf(10, 0.99);
+		std::atomic<bool> stop(false);
+		std::vector<std::thread> readers;
+		for (int t=0; t<4; t++) {
+			readers.emplace_back([&zipf, &stop]{
+				auto rand_engine = zipf.newEngine();
+				while (!stop.load()) {
+					auto r = zipf.next(rand_engine.get());
+					(void)r;
+					assert( r >= 1 && r <= n_final );
+				}
+			});
+		}
+		for (uint64_t n=11; n<=n_final; n += 1 + n/1000)
+			zipf.grow(n);
+		zipf.grow(n_final);
+		stop = true;
+		for (auto& t : readers)
+			t.join();
+
+		printf("n = %s, zeta_n = %.15g, expected = %.15g\n", v2s(zipf.getN()), zipf.getZetaN(), zeta(n_final, 0.99));
+		assert( zipf.getN() == n_final );
+		assert( std::fabs(zipf.getZetaN() - zeta(n_final, 0.99)) / zeta(n_final, 0.99) < 1e-10 );
+	}
+
+	for (double theta : {0.5, 0.99, 1.0, 1.2, 1.5}) {
+		printf("\nRejectionInversionZipf theta=%s\n", v2s(theta));
+		const uint64_t n_items = 1000;
+		const uint64_t samples = 2000000;
+		std::vector<uint64_t> items(n_items, 0);
+
+		RejectionInversionZipfDistributionUint64 zipf(n_items, theta);
+		for (uint64_t i=0; i<samples; i++) {
+			auto r = zipf.next();
+			assert( r >= 1 && r <= (int64_t)n_items );
+			items[r-1]++;
+		}
+		double zeta_n = zeta(n_items, theta);
+		for (uint64_t i : {1, 2, 3, 10, 100}) {
+			double expected = samples * std::pow(1.0/i, theta) / zeta_n;
+			printf("items[%s] = %s, expected = %.1f\n", v2s(i), v2s(items[i-1]), expected);
+			assert( std::fabs(items[i-1] - expected) < 5 * std::sqrt(expected) );
+		}
+	}
+
+	{
+		printf("\nnext_batch\n");
+		const uint64_t n_items = 1000;
+		const uint64_t samples = 2000000;
+		std::vector<int64_t>  batch(samples);
+		std::vector<uint64_t> items_scalar(n_items, 0), items_batch(n_items, 0);
+
+		ZipfDistributionUint64 zipf(n_items, 0.99);
+		for (uint64_t i=0; i<samples; i++)
+			items_scalar[zipf.next()-1]++;
+		zipf.next_batch(batch.data(), samples);
+		for (auto r : batch) {
+			assert( r >= 1 && r <= (int64_t)n_items );
+			items_batch[r-1]++;
+		}
+		for (uint64_t i : {1, 2, 3, 10, 100, 1000}) {
+			printf("items[%s]: scalar = %s, batch = %s\n", v2s(i), v2s(items_scalar[i-1]), v2s(items_batch[i-1]));
+			double expected = items_scalar[i-1];
+			assert( std::fabs(items_batch[i-1] - expected) < 7 * std::sqrt(expected) + 1 );
+		}
+
+		ScrambledZipfDistributionUint64 szipf(n_items, n_items/5, 0.99);
+		szipf.next_batch(batch.data(), samples);
+		for (auto r : batch)
+			assert( r >= 1 && r <= (int64_t)n_items );
+
+		RejectionInversionZipfDistributionUint64 rzipf(n_items, 1.2);
+		rzipf.next_batch(batch.data(), samples);
+		for (auto r : batch)
+			assert( r >= 1 && r <= (int64_t)n_items );
+
+		for (auto type : {RandEngine::tXoshiro256ss, RandEngine::tPCG64, RandEngine::tSplitMix64, RandEngine::tMT19937_64, RandEngine::tPhilox4x32}) {
+			auto rand_engine = zipf.newEngine(type);
+			auto t0 = std::chrono::steady_clock::now();
+			for (uint64_t i=0; i<samples; i++)
+				batch[i] = zipf.next(rand_engine.get());
+			auto t1 = std::chrono::steady_clock::now();
+			zipf.next_batch(batch.data(), samples, rand_engine.get());
+			auto t2 = std::chrono::steady_clock::now();
+			szipf.next_batch(batch.data(), samples, rand_engine.get());
+			auto t3 = std::chrono::steady_clock::now();
+			for (auto r : batch)
+				assert( r >= 1 && r <= (int64_t)n_items );
+			printf("engine type %d: ZipfDistribution next() = %.2f ns/key, next_batch() = %.2f ns/key, ScrambledZipfDistribution next_batch() = %.2f ns/key\n", type,
+			       std::chrono::duration<double, std::nano>(t1 - t0).count() / samples,
+			       std::chrono::duration<double, std::nano>(t2 - t1).count() / samples,
+			       std::chrono::duration<double, std::nano>(t3 - t2).count() / samples);
+		}
+	}
+
 	{
 		const uint64_t n_items = 1000000;
 		uint64_t items[n_items];
@@ -85,6 +214,757 @@ int main(int argc, char** argv) {
 		}
 	}
 
+	{
+		printf("\nScrambled rejection-inversion 20%%, theta=1.2\n");
+		const uint64_t n_items = 100;
+		const uint64_t samples = 10000;
+		uint64_t items[n_items];
+
+		ScrambledRejectionInversionZipfDistributionUint64 szipf(n_items, n_items/5, 1.2);
+		for (uint64_t i=0; i<n_items; i++)
+			items[i]=0;
+		for (uint64_t i=1; i<samples; i++) {
+			auto r = szipf.next();
+			items[r-1]++;
+		}
+		for (uint64_t i=1; i<=n_items; i++) {
+			if (items[i-1] > samples/40)
+				printf("items[%s] = %s\n", v2s(i), v2s(items[i-1]));
+		}
+	}
+
+	{
+		printf("\nKeyPermutation\n");
+		for (int64_t n : {1, 2, 3, 17, 1000, 65536, 100003}) {
+			KeyPermutation<int64_t> perm(n, 1234);
+			KeyPermutation<int64_t> perm2(n, 1234);
+			std::vector<bool> used(n, false);
+			for (int64_t k=1; k<=n; k++) {
+				auto p = perm(k);
+				assert( p >= 1 && p <= n );
+				assert( !used[p-1] );
+				assert( p == perm2(k) );
+				used[p-1] = true;
+			}
+		}
+		KeyPermutation<int64_t> perm_a(1000000, 1), perm_b(1000000, 2);
+		int equal = 0;
+		for (int64_t k=1; k<=1000; k++)
+			equal += perm_a(k) == perm_b(k);
+		assert( equal < 10 );
+
+		printf("\nScrambled permutation, n = 10^12\n");
+		const int64_t n_items = 1000000000000;
+		ScrambledZipfDistributionUint64 szipf(n_items, n_items, 0.99, SCRAMBLE_PERMUTATION, 42);
+		ScrambledZipfDistributionUint64 szipf2(n_items, n_items, 0.99, SCRAMBLE_PERMUTATION, 42);
+		std::vector<int64_t> batch(100000);
+		szipf.next_batch(batch.data(), batch.size());
+		for (auto r : batch)
+			assert( r >= 1 && r <= n_items );
+		KeyPermutation<int64_t> perm(n_items, 42);
+		printf("hottest keys: %s %s %s\n", v2s(perm(1)), v2s(perm(2)), v2s(perm(3)));
+		uint64_t hot = 0;
+		for (int i=0; i<10000; i++)
+			hot += szipf2.next() == perm(1);
+		assert( hot > 0 );
+	}
+
+	{
+		printf("\nScrambled sample list construction\n");
+		const int64_t n_items = 20000000;
+		for (uint32_t threads : {1, 4}) {
+			for (int64_t sample_size : {n_items/10, n_items/2, n_items}) {
+				auto t0 = std::chrono::steady_clock::now();
+				ScrambledZipfDistributionUint64 szipf(n_items, sample_size, 0.99, SCRAMBLE_LIST, 0, threads);
+				auto t1 = std::chrono::steady_clock::now();
+				printf("threads = %s, sample_size = %s: %.3f s\n", v2s(threads), v2s(sample_size),
+				       std::chrono::duration<double>(t1 - t0).count());
+				for (int i=0; i<100000; i++) {
+					auto r = szipf.next();
+					assert( r >= 1 && r <= n_items );
+				}
+			}
+		}
+
+		// the list depends on the master seed, not on the number of threads
+		auto keys = [](uint32_t threads) {
+			setRandSeed(77);
+			ScrambledZipfDistributionUint64 szipf(1000000, 400000, 0.99, SCRAMBLE_LIST, 0, threads);
+			std::vector<int64_t> ret(10000);
+			szipf.next_batch(ret.data(), ret.size(), newRandEngine(1000).get());
+			return ret;
+		};
+		assert( keys(1) == keys(3) );
+	}
+
+	{
+		printf("\nseeding\n");
+		const int64_t n_items = 1000000;
+		ZipfDistributionUint64 zipf(n_items, 0.99);
+		auto sequence = [&zipf](std::unique_ptr<RandEngine> rand_engine) {
+			std::vector<int64_t> ret(1000);
+			zipf.next_batch(ret.data(), ret.size(), rand_engine.get());
+			return ret;
+		};
+		for (auto type : {RandEngine::tXoshiro256ss, RandEngine::tPCG64, RandEngine::tSplitMix64, RandEngine::tMT19937_64, RandEngine::tPhilox4x32}) {
+			setRandSeed(123);
+			assert( getRandSeed() == 123 );
+			auto s0 = sequence(newRandEngine(type));
+			auto s1 = sequence(newRandEngine(type));
+			assert( s0 != s1 );
+			setRandSeed(123);
+			assert( sequence(newRandEngine(type)) == s0 );
+			assert( sequence(newRandEngine(type)) == s1 );
+			assert( sequence(newRandEngine(1, type)) == s1 );
+			assert( sequence(newRandEngine(0, type)) == s0 );
+			setRandSeed(124);
+			assert( sequence(newRandEngine(type)) != s0 );
+		}
+	}
+
+	{
+		printf("\nthread engines\n");
+		const int64_t n_items = 1000;
+		std::vector<std::unique_ptr<ScrambledZipfDistributionUint64>> szipf;
+		for (int i=0; i<3; i++)
+			szipf.emplace_back(new ScrambledZipfDistributionUint64(n_items, n_items/2, 0.99));
+		std::vector<std::thread> threads;
+		std::vector<std::vector<int64_t>> results(4);
+		for (int t=0; t<4; t++) {
+			threads.emplace_back([&szipf, &results, t]{
+				for (int i=0; i<100000; i++) {
+					auto r = szipf[i % szipf.size()]->next();
+					assert( r >= 1 && r <= n_items );
+					if (i < 1000) results[t].push_back(r);
+				}
+			});
+		}
+		for (auto& t : threads)
+			t.join();
+		for (int t=1; t<4; t++)
+			assert( results[t] != results[0] ); // independent streams per thread
+	}
+
+	{
+		printf("\nYCSB distributions\n");
+		const int64_t n_items = 1000;
+		const size_t n_samples = 1000000;
+		std::vector<int64_t> v(n_samples);
+		auto rand_engine = newRandEngine();
+
+		UniformDistribution<int64_t> uniform(11, 20);
+		uniform.next_batch(v.data(), v.size(), rand_engine.get());
+		std::vector<size_t> hist(21, 0);
+		for (auto x : v) { assert( x >= 11 && x <= 20 ); hist[x]++; }
+		for (int i=11; i<=20; i++)
+			assert( std::abs((double)hist[i] / n_samples - 0.1) < 0.005 );
+
+		HotspotDistribution<int64_t> hotspot(n_items, 0.2, 0.8);
+		hotspot.next_batch(v.data(), v.size(), rand_engine.get());
+		size_t hot = 0;
+		for (auto x : v) { assert( x >= 1 && x <= n_items ); if (x <= 200) hot++; }
+		assert( std::abs((double)hot / n_samples - 0.8) < 0.005 );
+
+		ExponentialDistribution<int64_t> exponential(n_items, 95, 0.5);
+		exponential.next_batch(v.data(), v.size(), rand_engine.get());
+		size_t first_half = 0;
+		for (auto x : v) { assert( x >= 1 && x <= n_items ); if (x <= n_items/2) first_half++; }
+		// 95% of the non rejected values in the first half: 0.95 / (1 - 0.05^2)
+		assert( std::abs((double)first_half / n_samples - 0.95/(1-0.0025)) < 0.005 );
+		assert( exponential.next(rand_engine.get()) <= n_items );
+
+		SequentialDistribution<int64_t> sequential(1, 10);
+		sequential.next_batch(v.data(), 25);
+		for (int i=0; i<25; i++)
+			assert( v[i] == 1 + i % 10 );
+		assert( sequential.next() == 6 );
+
+		CounterDistribution<int64_t> counter(5);
+		assert( counter.lastValue() == 4 );
+		assert( counter.next() == 5 );
+		counter.next_batch(v.data(), 10);
+		assert( v[0] == 6 && v[9] == 15 && counter.lastValue() == 15 );
+
+		AcknowledgedCounterDistribution<int64_t> ack(1);
+		int64_t a1 = ack.next(), a2 = ack.next(), a3 = ack.next();
+		assert( ack.lastValue() == 0 );
+		ack.acknowledge(a2);
+		assert( ack.lastValue() == 0 );
+		ack.acknowledge(a1);
+		assert( ack.lastValue() == 2 );
+		ack.acknowledge(a3);
+		assert( ack.lastValue() == 3 );
+
+		// concurrent acknowledgements are never lost: the final limit is the
+		// last value issued, also when the last one raced with an advancement
+		for (int round = 0; round < 20; round++) {
+			AcknowledgedCounterDistribution<int64_t> acks(1);
+			std::vector<std::thread> ackers;
+			for (int t = 0; t < 8; t++) {
+				ackers.emplace_back([&acks]{
+					for (int i = 0; i < 2000; i++)
+						acks.acknowledge(acks.next());
+				});
+			}
+			for (auto& t : ackers)
+				t.join();
+			assert( acks.lastValue() == 8 * 2000 );
+		}
+
+		CounterDistribution<int64_t> fresh;
+		LatestDistribution<int64_t> fresh_latest(&fresh);
+		bool error = false;
+		try { fresh_latest.next(rand_engine.get()); } catch (std::runtime_error& e) { printf("expected error: %s\n", e.what()); error = true; }
+		assert( error );
+		error = false;
+		try { fresh_latest.next_batch(v.data(), 10, rand_engine.get()); } catch (std::runtime_error& e) { error = true; }
+		assert( error );
+		fresh.next();
+		assert( fresh_latest.next(rand_engine.get()) == 1 );
+
+		CounterDistribution<int64_t> inserts(n_items + 1);
+		LatestDistribution<int64_t> latest(&inserts, 0.99);
+		latest.next_batch(v.data(), v.size(), rand_engine.get());
+		std::vector<size_t> lhist(n_items + 1, 0);
+		for (auto x : v) { assert( x >= 1 && x <= n_items ); lhist[x]++; }
+		assert( lhist[n_items] > lhist[n_items - 1] && lhist[n_items - 1] > lhist[n_items / 2] );
+		for (int i=0; i<100; i++)
+			inserts.next();
+		for (int i=0; i<10000; i++) {
+			auto x = latest.next(rand_engine.get());
+			assert( x >= 1 && x <= n_items + 100 );
+		}
+
+		std::atomic<int64_t> max_read {0};
+		AcknowledgedCounterDistribution<int64_t> ack_inserts(n_items + 1);
+		SkewedLatestDistribution<int64_t> skewed(&ack_inserts, 0.99);
+		std::vector<std::thread> threads;
+		for (int t=0; t<4; t++) {
+			threads.emplace_back([&, t]{
+				std::vector<int64_t> keys(100);
+				for (int i=0; i<1000; i++) {
+					if (t < 2) {
+						ack_inserts.acknowledge(ack_inserts.next());
+					} else {
+						skewed.next_batch(keys.data(), keys.size());
+						for (auto k : keys) {
+							assert( k >= 1 && k <= ack_inserts.lastValue() );
+							int64_t m = max_read.load();
+							while (k > m && !max_read.compare_exchange_weak(m, k));
+						}
+					}
+				}
+			});
+		}
+		for (auto& t : threads)
+			t.join();
+		assert( ack_inserts.lastValue() == n_items + 2000 );
+		assert( max_read.load() <= n_items + 2000 );
+	}
+
+	{
+		printf("\nkey distribution\n");
+		std::vector<int64_t> v(100000);
+		for (auto config : {"type=uniform,n=1000", "type=zipf,n=1000,theta=0.99", "type=zipf_ri, n=1000, theta=1.2",
+		                    "type=scrambled,n=1000,sample_size=500,permutation=true,seed=7", "type=hotspot,n=1000,hot_set=0.1,hot_ops=0.9",
+		                    "type=exponential,n=1000", "type=sequential,n=1000", "type=latest,n=1000", "type=skewed_latest,n=1000,theta=0.8"}) {
+			KeyDistributionUint64 dist(config);
+			auto rand_engine = dist.newEngine();
+			dist.next_batch(v.data(), v.size(), rand_engine.get());
+			for (auto x : v)
+				assert( x >= 1 && x <= 1000 );
+			auto x = dist.next();
+			assert( x >= 1 && x <= 1000 );
+		}
+
+		KeyDistributionUint64 counter("type=counter,start=10");
+		assert( counter.next() == 10 && counter.insertCounter() == nullptr );
+
+		KeyDistributionUint64 latest("type=skewed_latest,n=10");
+		auto ins = latest.insertCounter();
+		assert( ins != nullptr && ins->lastValue() == 10 );
+		ins->acknowledge(ins->next());
+		bool found = false;
+		for (int i=0; i<1000 && !found; i++)
+			found = latest.next() == 11;
+		assert( found );
+
+		for (auto config : {"type=foo,n=10", "type=zipf", "type=zipf,n=10,foo=1", "type=zipf,n=x", "type=uniform,n=10,bar"}) {
+			bool error = false;
+			try {
+				KeyDistributionUint64 dist(config);
+			} catch (std::invalid_argument& e) {
+				printf("expected error: %s\n", e.what());
+				error = true;
+			}
+			assert( error );
+		}
+	}
+
+	{
+		printf("\nalias distribution\n");
+		std::vector<double> weights {0, 5, 1, 0, 2, 2, 0.5, 0, 0, 1.5};
+		double sum = 12;
+		AliasDistributionUint64 alias(weights);
+		assert( alias.getN() == 10 );
+		const size_t n_samples = 2000000;
+		std::vector<int64_t> v(n_samples);
+		auto rand_engine = alias.newEngine();
+		alias.next_batch(v.data(), v.size(), rand_engine.get());
+		std::vector<size_t> hist(11, 0);
+		for (auto x : v) { assert( x >= 1 && x <= 10 ); hist[x]++; }
+		for (int i=1; i<=10; i++) {
+			printf("key %d: expected %.4f, observed %.4f\n", i, weights[i-1]/sum, (double)hist[i]/n_samples);
+			assert( std::abs((double)hist[i]/n_samples - weights[i-1]/sum) < 0.002 );
+			if (weights[i-1] == 0) assert( hist[i] == 0 );
+		}
+		for (int i=0; i<1000; i++)
+			assert( weights[alias.next(rand_engine.get()) - 1] > 0 );
+
+		// Zipf-like histogram with one million buckets, from a weight file
+		const int64_t n_items = 1000000;
+		std::vector<double> zipf_weights(n_items);
+		for (int64_t i=0; i<n_items; i++)
+			zipf_weights[i] = 1.0 / std::pow(i + 1, 0.99);
+		std::string filename = alutils::sprintf("/tmp/alutils-random-test-%d.weights", (int)getpid());
+		FILE* f = fopen(filename.c_str(), "w");
+		assert( f != nullptr );
+		assert( fwrite(zipf_weights.data(), sizeof(double), n_items, f) == (size_t)n_items );
+		fclose(f);
+
+		auto start = std::chrono::steady_clock::now();
+		KeyDistributionUint64 file_alias(alutils::sprintf("type=alias,file=%s", filename.c_str()));
+		std::chrono::duration<double> build_time = std::chrono::steady_clock::now() - start;
+		unlink(filename.c_str());
+		printf("build time (n = %ld): %.3f s\n", n_items, build_time.count());
+
+		start = std::chrono::steady_clock::now();
+		file_alias.next_batch(v.data(), v.size(), rand_engine.get());
+		std::chrono::duration<double> sample_time = std::chrono::steady_clock::now() - start;
+		printf("next_batch: %.2f ns/key\n", sample_time.count() * 1e9 / n_samples);
+		double zeta_n = zeta(n_items, 0.99);
+		size_t ones = 0;
+		for (auto x : v) { assert( x >= 1 && x <= n_items ); if (x == 1) ones++; }
+		assert( std::abs((double)ones/n_samples - 1.0/zeta_n) < 0.002 );
+
+		for (auto bad : {std::vector<double>{}, std::vector<double>{0, 0}, std::vector<double>{1, -1}}) {
+			bool error = false;
+			try {
+				AliasDistributionUint64 a(bad);
+			} catch (std::invalid_argument& e) {
+				printf("expected error: %s\n", e.what());
+				error = true;
+			}
+			assert( error );
+		}
+	}
+
+	{
+		printf("\ntraces\n");
+		const int64_t n_items = 1000000000;
+		const uint64_t n_keys = 2000000;
+		std::string filename = alutils::sprintf("/tmp/alutils-random-test-%d.trace", (int)getpid());
+		ScrambledZipfDistributionUint64 szipf(n_items, n_items, 0.99, SCRAMBLE_PERMUTATION, 1);
+		setRandSeed(42);
+		auto rand_engine = szipf.newEngine();
+		{
+			TraceWriterUint64 writer(filename, 10000);
+			writer.record(szipf, n_keys, rand_engine.get());
+			writer.write(-5); // negative deltas and keys
+			writer.write(n_items);
+		}
+		setRandSeed(42);
+		rand_engine = szipf.newEngine();
+		std::vector<int64_t> expected(n_keys);
+		szipf.next_batch(expected.data(), n_keys, rand_engine.get());
+		expected.push_back(-5);
+		expected.push_back(n_items);
+
+		TraceReaderUint64 reader(filename, false);
+		assert( reader.getKeys() == n_keys + 2 );
+		assert( reader.getBlocks() == n_keys / 10000 + 1 );
+		std::vector<int64_t> v(n_keys + 2);
+		auto start = std::chrono::steady_clock::now();
+		reader.next_batch(v.data(), v.size());
+		std::chrono::duration<double> read_time = std::chrono::steady_clock::now() - start;
+		printf("file size: %.2f bytes/key, read: %.2f Mkeys/s\n",
+		       (double)MMapFile(filename).size() / v.size(), v.size() / read_time.count() / 1e6);
+		assert( v == expected );
+		bool error = false;
+		try { reader.next(); } catch (std::out_of_range& e) { error = true; }
+		assert( error );
+
+		std::vector<int64_t> parts;
+		for (uint32_t p = 0; p < 3; p++) {
+			auto cursor = reader.getCursor(p, 3);
+			std::vector<int64_t> buf(1000);
+			size_t c;
+			while ((c = reader.read(cursor, buf.data(), buf.size())) > 0)
+				parts.insert(parts.end(), buf.begin(), buf.begin() + c);
+		}
+		assert( parts == expected );
+
+		TraceReaderUint64 looping(filename);
+		std::atomic<uint64_t> total {0};
+		std::vector<std::thread> threads;
+		for (int t=0; t<4; t++) {
+			threads.emplace_back([&]{
+				std::vector<int64_t> buf(1000);
+				for (uint64_t i=0; i < n_keys / 1000; i++) {
+					looping.next_batch(buf.data(), buf.size());
+					for (auto k : buf)
+						assert( (k >= 1 && k <= n_items) || k == -5 );
+				}
+				total += n_keys;
+			});
+		}
+		for (auto& t : threads)
+			t.join();
+		assert( total == 4 * n_keys );
+
+		FILE* f = fopen(filename.c_str(), "r+");
+		fseek(f, -1, SEEK_END);
+		fputc('x', f);
+		fclose(f);
+		error = false;
+		try { TraceReaderUint64 bad(filename); } catch (std::runtime_error& e) { printf("expected error: %s\n", e.what()); error = true; }
+		assert( error );
+		unlink(filename.c_str());
+	}
+
+	{
+		printf("\nCDF Zipf\n");
+		const int64_t n_items = 1000;
+		const size_t n_samples = 2000000;
+		std::vector<int64_t> v(n_samples);
+		for (double theta : {0.5, 0.99, 1.5}) {
+			CdfZipfDistributionUint64 cdf_zipf(n_items, theta);
+			auto rand_engine = cdf_zipf.newEngine();
+			cdf_zipf.next_batch(v.data(), v.size(), rand_engine.get());
+			std::vector<size_t> hist(n_items + 1, 0);
+			for (auto x : v) { assert( x >= 1 && x <= n_items ); hist[x]++; }
+			for (int i=0; i<100000; i++) {
+				auto x = cdf_zipf.next(rand_engine.get());
+				assert( x >= 1 && x <= n_items );
+			}
+			double zeta_n = zeta_exact(n_items, theta);
+			for (int64_t k : {1, 2, 3, 10, 100}) {
+				double p = 1.0 / std::pow(k, theta) / zeta_n;
+				printf("theta %.2f, key %ld: expected %.5f, observed %.5f\n", theta, k, p, (double)hist[k]/n_samples);
+				assert( std::abs((double)hist[k]/n_samples - p) < 5 * std::sqrt(p / n_samples) + 1e-6 );
+			}
+		}
+
+		const int64_t n_large = 10000000;
+		auto start = std::chrono::steady_clock::now();
+		CdfZipfDistributionUint64 cdf_zipf(n_large, 0.99);
+		std::chrono::duration<double> build_time = std::chrono::steady_clock::now() - start;
+		std::string filename = alutils::sprintf("/tmp/alutils-random-test-%d.cdf", (int)getpid());
+		cdf_zipf.save(filename);
+		CdfZipfDistributionUint64 mapped(filename);
+		KeyDistributionUint64 from_config(alutils::sprintf("type=zipf_cdf,file=%s", filename.c_str()));
+		unlink(filename.c_str());
+		assert( mapped.getN() == n_large && mapped.getTheta() == 0.99 );
+
+		setRandSeed(5);
+		auto e1 = newRandEngine();
+		setRandSeed(5);
+		auto e2 = newRandEngine();
+		std::vector<int64_t> v2(n_samples);
+		start = std::chrono::steady_clock::now();
+		cdf_zipf.next_batch(v.data(), v.size(), e1.get());
+		std::chrono::duration<double> sample_time = std::chrono::steady_clock::now() - start;
+		mapped.next_batch(v2.data(), v2.size(), e2.get());
+		assert( v == v2 );
+		printf("n = %ld: build %.3f s, next_batch %.2f ns/key\n", n_large, build_time.count(), sample_time.count() * 1e9 / n_samples);
+		size_t ones = 0;
+		for (auto x : v) { assert( x >= 1 && x <= n_large ); if (x == 1) ones++; }
+		assert( std::abs((double)ones/n_samples - 1.0/zeta(n_large, 0.99)) < 0.002 );
+		for (int i=0; i<1000; i++)
+			assert( from_config.next() <= n_large );
+
+		ScrambledCdfZipfDistributionUint64 scrambled(n_items, n_items / 2, 0.99);
+		scrambled.next_batch(v.data(), 10000);
+		for (int i=0; i<10000; i++)
+			assert( v[i] >= 1 && v[i] <= n_items );
+	}
+
+
+	{
+		printf("\nDrifting Zipf\n");
+		const int64_t n_items = 1000;
+		const size_t n_samples = 200000;
+		std::vector<int64_t> v(n_samples);
+		DriftingZipfDistributionUint64 drifting(n_items, 0.99);
+		auto rand_engine = drifting.newEngine();
+		auto hottest = [&](int64_t min, int64_t max) {
+			std::vector<size_t> hist(max - min + 1, 0);
+			drifting.next_batch(v.data(), v.size(), rand_engine.get());
+			for (auto x : v) { assert( x >= min && x <= max ); hist[x - min]++; }
+			return min + (int64_t)(std::max_element(hist.begin(), hist.end()) - hist.begin());
+		};
+		assert( hottest(1, n_items) == 1 );
+		drifting.setHotShift(100);
+		assert( hottest(1, n_items) == 101 );
+		assert( drifting.next(rand_engine.get()) <= n_items );
+		drifting.setHotShift(-1);
+		assert( drifting.getHotShift() == n_items - 1 && hottest(1, n_items) == n_items );
+		drifting.setKeyShift(5000);
+		assert( hottest(5001, 5000 + n_items) == 5000 + n_items );
+
+		bool error = false;
+		try { DriftingZipfDistributionUint32 bad(1000, 0.99); bad.setKeyShift(INT32_MAX); } catch (std::invalid_argument& e) { printf("expected error: %s\n", e.what()); error = true; }
+		assert( error );
+
+		Commands commands;
+		drifting.registerCommands(commands, "drift.");
+		commands.parseCommand("drift.key_shift=0");
+		commands.parseCommand("drift.hot_shift=0");
+		commands.parseCommand("drift.theta=0.5");
+		assert( drifting.getTheta() == 0.5 );
+		error = false;
+		try { commands.parseCommand("drift.theta=-1"); } catch (std::exception& e) { printf("expected error: %s\n", e.what()); error = true; }
+		assert( error && drifting.getTheta() == 0.5 );
+
+		// samplers running while the script changes the parameters
+		std::atomic<bool> stop {false};
+		std::vector<std::thread> threads;
+		for (int t=0; t<4; t++) {
+			threads.emplace_back([&]{
+				auto engine = drifting.newEngine();
+				std::vector<int64_t> buf(1000);
+				while (!stop) {
+					drifting.next_batch(buf.data(), buf.size(), engine.get());
+					for (auto k : buf)
+						assert( k >= 1 && k <= 2000 + n_items );
+					assert( drifting.next(engine.get()) >= 1 );
+				}
+			});
+		}
+		auto script_start = std::chrono::steady_clock::now();
+		commands.monitorScript("0s:drift.theta_ramp=10;0s:drift.theta=1.5;0s:drift.rotate=1000;0s:drift.key_shift=2000");
+		while (commands.isScriptActive())
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		double mid_theta = drifting.getTheta();
+		std::this_thread::sleep_for(std::chrono::milliseconds(400));
+		assert( drifting.getTheta() > mid_theta );
+		drifting.setTheta(1.5); // ends the ramp
+		double shift = drifting.getHotShift();
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - script_start;
+		printf("theta during the ramp: %.3f, after: %.3f, hot shift after ~0.4 s at 1000 keys/s: %.0f\n", mid_theta, drifting.getTheta(), shift);
+		assert( mid_theta >= 0.5 && mid_theta < 1.5 );
+		assert( drifting.getTheta() == 1.5 );
+		assert( shift >= 300 && shift <= elapsed.count() * 1000 + 50 );
+		commands.parseCommand("drift.rotate=0");
+		stop = true;
+		for (auto& t : threads)
+			t.join();
+		shift = drifting.getHotShift();
+		assert( hottest(2001, 2000 + n_items) == 2001 + shift );
+	}
+
+
+	{
+		printf("\npartitioned key streams\n");
+		auto engine = newCounterRandEngine(0);
+		assert( randUint64(engine.get()) == 0xe169c58d6627e8d5ULL ); // Random123 known answer
+		assert( randUint64(engine.get()) == 0x9b00dbd8bc57ac4cULL );
+		uint64_t first = randUint64(engine.get());
+		seekRandEngine(engine.get(), 0);
+		assert( randUint64(engine.get()) == 0xe169c58d6627e8d5ULL );
+		bool error = false;
+		try { seekRandEngine(newRandEngine(RandEngine::tPCG64).get(), 1); } catch (std::invalid_argument& e) { printf("expected error: %s\n", e.what()); error = true; }
+		assert( error );
+		randUint64(engine.get());
+		assert( randUint64(engine.get()) == first );
+
+		const int64_t n_items = 100000;
+		const uint64_t count = 100001;
+		ZipfDistributionUint64 zipf(n_items, 0.99);
+		ScrambledZipfDistributionUint64 szipf(n_items, n_items, 0.99, SCRAMBLE_PERMUTATION, 7);
+		RejectionInversionZipfDistributionUint64 rzipf(n_items, 0.99);
+
+		auto single = [&](auto& dist, uint64_t seed) {
+			PartitionedKeyStream<int64_t, std::remove_reference_t<decltype(dist)>> stream(dist, seed, count);
+			std::vector<int64_t> ret(count + 10);
+			ret.resize(stream.next_batch(ret.data(), ret.size()));
+			assert( ret.size() == count && stream.next_batch(ret.data(), 1) == 0 );
+			return ret;
+		};
+		auto seq = single(zipf, 42);
+		assert( single(zipf, 42) == seq && single(zipf, 43) != seq );
+		for (auto k : seq) assert( k >= 1 && k <= n_items );
+		size_t ones = std::count(seq.begin(), seq.end(), 1);
+		assert( std::abs((double)ones/count - 1.0/zeta(n_items, 0.99)) < 0.01 );
+
+		// the parts, generated by concurrent threads, reproduce the single stream
+		for (uint64_t parts : {2, 7, 64}) {
+			std::vector<int64_t> aggregate(count, 0);
+			std::vector<std::thread> threads;
+			for (uint64_t p=0; p<parts; p++) {
+				threads.emplace_back([&, p]{
+					PartitionedZipfKeyStreamUint64 stream(zipf, 42, count, p, parts);
+					int64_t key;
+					uint64_t i = stream.getFirst();
+					while (stream.next(key))
+						aggregate[i++] = key;
+					assert( i == stream.getLast() );
+				});
+			}
+			for (auto& t : threads)
+				t.join();
+			assert( aggregate == seq );
+		}
+
+		auto sseq = single(szipf, 42);
+		PartitionedScrambledZipfKeyStreamUint64 spart(szipf, 42, count, 3, 5);
+		spart.seek(spart.getFirst() + 10);
+		int64_t key;
+		assert( spart.next(key) && key == sseq[spart.getPosition() - 1] );
+		assert( spart.at(0) == sseq[0] );
+		ScrambledZipfDistributionUint64 szipf2(n_items, n_items, 0.99, SCRAMBLE_PERMUTATION, 7); // another process
+		assert( single(szipf2, 42) == sseq );
+
+		// rejection sampling consumes a variable number of values per key
+		auto rseq = single(rzipf, 1);
+		PartitionedKeyStream<int64_t, RejectionInversionZipfDistributionUint64> rpart(rzipf, 1, count, 1, 3);
+		std::vector<int64_t> rbuf(count);
+		size_t c = rpart.next_batch(rbuf.data(), rbuf.size());
+		assert( std::equal(rbuf.begin(), rbuf.begin() + c, rseq.begin() + rpart.getFirst()) );
+
+		error = false;
+		try { PartitionedZipfKeyStreamUint64 bad(zipf, 42, count, 3, 3); } catch (std::invalid_argument& e) { printf("expected error: %s\n", e.what()); error = true; }
+		assert( error );
+
+		auto t0 = std::chrono::steady_clock::now();
+		PartitionedZipfKeyStreamUint64 stream(zipf, 42, 1000000);
+		seq.resize(1000000);
+		stream.next_batch(seq.data(), seq.size());
+		printf("PartitionedZipfKeyStream: %.2f ns/key\n", std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count() / 1000000);
+	}
+
+
+	{
+		printf("\nskew monitor\n");
+		const int64_t n_items = 1000000;
+		const size_t n_samples = 1000000;
+		std::vector<int64_t> v(n_samples);
+		ZipfDistributionUint64 zipf(n_items, 0.99);
+		auto rand_engine = zipf.newEngine();
+		zipf.next_batch(v.data(), v.size(), rand_engine.get());
+		std::unordered_map<int64_t, uint64_t> exact;
+		for (auto x : v) exact[x]++;
+
+		SpaceSaving small(10);
+		for (int i=0; i<1000; i++) small.add(i % 7, 2);
+		auto small_items = small.items();
+		assert( small_items.size() == 7 && small.minCount() == 0 );
+		for (auto& item : small_items) assert( item.error == 0 && item.count == (item.key < 6 ? 286 : 284) );
+
+		SpaceSaving summary(256);
+		CountMinSketch sketch(16384, 4);
+		for (auto x : v) { summary.add(x); sketch.add(x); }
+		auto items = summary.items();
+		assert( items.size() == 256 && items[0].key == 1 );
+		for (auto& item : items) {
+			assert( item.count >= exact[item.key] && item.count - item.error <= exact[item.key] );
+			assert( item.error <= summary.minCount() );
+		}
+		for (auto& e : exact)
+			if (e.second > n_samples / 256) assert( std::any_of(items.begin(), items.end(), [&](const SpaceSaving::Item& i) { return (int64_t)i.key == e.first; }) );
+		size_t over = 0;
+		for (auto& e : exact) {
+			auto est = sketch.estimate(e.first);
+			assert( est >= e.second );
+			if (est > e.second + 2.72 * n_samples / 16384) over++;
+		}
+		assert( over < exact.size() / 20 );
+
+		for (double theta : {0.8, 0.99, 1.2}) {
+			ZipfDistributionUint64 zipf(n_items, theta);
+			ScrambledZipfDistributionUint64 szipf(n_items, n_items, theta, SCRAMBLE_PERMUTATION, 3);
+			SkewMonitor monitor;
+			SkewMonitor smonitor;
+			std::vector<std::thread> threads;
+			for (int t=0; t<4; t++) {
+				threads.emplace_back([&, t]{
+					auto engine = zipf.newEngine();
+					std::vector<int64_t> buf(1000);
+					for (int i=0; i<500; i++) {
+						zipf.next_batch(buf.data(), buf.size(), engine.get());
+						if (t % 2 == 0) {
+							for (auto k : buf) monitor.record(k);
+						} else {
+							monitor.record_batch(buf.data(), buf.size());
+						}
+						szipf.next_batch(buf.data(), buf.size(), engine.get());
+						smonitor.record_batch(buf.data(), buf.size());
+						if (t == 0 && i % 100 == 0)
+							monitor.estimateTheta(); // reports while the others write
+					}
+					monitor.flush();
+				});
+			}
+			for (auto& t : threads)
+				t.join();
+			assert( monitor.getTotal() == 2000000 && smonitor.getTotal() == 2000000 );
+			auto top = monitor.topK();
+			assert( top.size() == 1024 && top[0].key == 1 && top[1].key == 2 );
+			assert( monitor.estimate(1) >= top[0].count - top[0].error );
+			double fitted = monitor.estimateTheta(), sfitted = smonitor.estimateTheta();
+			printf("theta %.2f: fitted %.3f, scrambled %.3f\n", theta, fitted, sfitted);
+			assert( std::abs(fitted - theta) < 0.05 && std::abs(sfitted - theta) < 0.05 );
+		}
+
+		for (uint32_t sample_every : {1, 16}) {
+			SkewMonitor monitor(1024, 16384, 4, sample_every);
+			auto t0 = std::chrono::steady_clock::now();
+			for (auto x : v) monitor.record(x);
+			auto t1 = std::chrono::steady_clock::now();
+			monitor.record_batch(v.data(), v.size() - 5);
+			monitor.record_batch(v.data(), 5);
+			auto t2 = std::chrono::steady_clock::now();
+			monitor.flush();
+			assert( monitor.getTotal() == 2 * n_samples );
+			auto top = monitor.topK();
+			printf("SkewMonitor sample_every=%u: record() = %.2f ns/key, record_batch() = %.2f ns/key, key 1: %lu (exact %lu), theta %.3f\n", sample_every,
+			       std::chrono::duration<double, std::nano>(t1 - t0).count() / n_samples,
+			       std::chrono::duration<double, std::nano>(t2 - t1).count() / n_samples,
+			       top[0].count, 2 * exact[1], monitor.estimateTheta());
+			assert( top[0].key == 1 && std::abs((double)top[0].count / (2 * exact[1]) - 1) < 0.05 );
+			assert( std::abs(monitor.estimateTheta() - 0.99) < 0.05 );
+		}
+		bool error = false;
+		try { SkewMonitor bad(0); } catch (std::invalid_argument& e) { printf("expected error: %s\n", e.what()); error = true; }
+		assert( error );
+		error = false;
+		try { SkewMonitor bad(16, 0); } catch (std::invalid_argument& e) { printf("expected error: %s\n", e.what()); error = true; }
+		assert( error );
+	}
+
+	{ // per-thread objects: released on thread exit and not leaked by dead instances
+		PerThread<int> counters;
+		PerThread<int> kept(true);
+		auto create = []{ return std::unique_ptr<int>(new int(0)); };
+		std::vector<std::thread> threads;
+		for (int t = 0; t < 4; t++) {
+			threads.emplace_back([&]{
+				for (int i = 0; i < 1000; i++) {
+					PerThread<int> tmp;
+					(*tmp.get(create))++;
+				}
+				(*counters.get(create))++;
+				(*kept.get(create))++;
+				assert( counters.all().size() >= 1 );
+			});
+		}
+		for (auto& t : threads) t.join();
+		assert( counters.all().size() == 0 );
+		assert( kept.all().size() == 4 );
+		(*counters.get(create))++;
+		assert( counters.all().size() == 1 && *counters.all()[0] == 1 );
+	}
+
 	printf("OK!!\n");
 	return 0;
 }
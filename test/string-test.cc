@@ -10,9 +10,37 @@
 #include <cassert>
 #include <iostream>
 #include <sstream>
+#include <chrono>
+#include <vector>
+#include <regex>
+#include <string_view>
+#include <atomic>
+#include <thread>
+#include <new>
+#include <cstdlib>
 
 using namespace alutils;
 
+static std::atomic<size_t> allocations(0);
+void* operator new(size_t size) {
+	allocations++;
+	void* p = malloc(size);
+	if (!p) throw std::bad_alloc();
+	return p;
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+ALUTILS_PRINT_WRAPPER(print_discard, (void)msg.size());
+
+static std::string_view sprintf_view(const char* format, ...) {
+	va_list args;
+	va_start(args, format);
+	auto ret = vsprintf_view(format, args);
+	va_end(args);
+	return ret;
+}
+
 std::string vector_to_str(const std::vector<std::string>& v) {
 	std::string ret = "[";
 	bool delimiter = false;
@@ -86,6 +114,23 @@ int main(int argc, char** argv) {
 		assert (!fail);
 		try {s="ad2"; parseDouble(s.c_str()); fail = true;} catch (std::exception& e) {printf("expected exception for \"%s\": %s\n", s.c_str(), e.what());}
 		assert (!fail);
+		for (auto bad : {"1e5", "inf", "nan", "+5", "0x10", "1.2.3", "- 1"}) {
+			try {parseDouble(bad); fail = true;} catch (std::exception& e) {printf("expected exception for \"%s\": %s\n", bad, e.what());}
+			assert (!fail);
+		}
+		try {s="99999999999"; parseInt32(s); fail = true;} catch (std::exception& e) {printf("expected exception for \"%s\": %s\n", s.c_str(), e.what());}
+		assert (!fail);
+		try {s="+5"; parseInt64(s); fail = true;} catch (std::exception& e) {printf("expected exception for \"%s\": %s\n", s.c_str(), e.what());}
+		assert (!fail);
+		try {s="2a"; parseUint32(s, false, 1); fail = true;} catch (std::exception& e) {printf("expected exception for \"%s\": %s\n", s.c_str(), e.what());}
+		assert (!fail);
+		try {s="10"; parseUint32(s, true, 0, "custom message", [](uint32_t v){ return v < 10; }); fail = true;} catch (std::exception& e) {printf("expected exception for \"%s\": %s\n", s.c_str(), e.what()); assert( std::string(e.what()) == "custom message" );}
+		assert (!fail);
+		assert( parseUint64("18446744073709551615") == UINT64_MAX );
+		assert( parseInt64("-9223372036854775808") == INT64_MIN );
+		std::string_view sv("123456", 3); // not null-terminated
+		assert( parseInt32(sv) == 123 && parseDouble(sv) == 123.0 );
+		assert( strip_view(" \t ") == "" && strip_view(" a b ") == "a b" );
 
 	}
 
@@ -96,6 +141,127 @@ int main(int argc, char** argv) {
 			std::string aux2 = aux + " test %d %d";
 			assert( sprintf(aux2.c_str(),123, i) == aux+std::string(" test 123 ")+std::to_string(i) );
 		}
+		std::string big(100000, 'x'); // beyond the thread-local buffer
+		assert( alutils::sprintf("<%s>", big.c_str()) == "<" + big + ">" );
+		assert( alutils::sprintf("%d", 1) == "1" );
+	}
+
+	{ // parseSize, parseDuration and parseRate
+		using namespace std::chrono;
+		assert( parseSize("4096") == 4096 && parseSize("4Ki") == 4096 && parseSize(" 4 KiB ") == 4096 );
+		assert( parseSize("1.5GB") == 1500000000 && parseSize("2M") == 2000000 && parseSize("1Ti") == (1ULL << 40) );
+		assert( parseSize("0.5Ki") == 512 && parseSize("1.0000001K") == 1000 );
+		assert( parseSize("18446744073709551615B") == UINT64_MAX );
+		for (const char* bad : {"", "Ki", "-1", "1k", "1.5X", "20000000Ti", "1 2"}) {
+			bool error = false;
+			try { parseSize(bad); } catch (std::invalid_argument& e) { error = true; }
+			assert( error );
+		}
+
+		assert( parseDuration("1.5s") == milliseconds(1500) && parseDuration("1500ms") == milliseconds(1500) );
+		assert( parseDuration("10") == seconds(10) && parseDuration("10", milliseconds(1)) == milliseconds(10) );
+		assert( parseDuration("250 us") == microseconds(250) && parseDuration("7ns") == nanoseconds(7) );
+		assert( parseDuration("2m") == minutes(2) && parseDuration("2min") == minutes(2) && parseDuration("1.5h") == minutes(90) );
+		assert( parseDuration("0.1s") == milliseconds(100) && parseDuration("-1ms") == milliseconds(-1) );
+		for (const char* bad : {"", "s", "1x", "1 s s", "3000000h"}) {
+			bool error = false;
+			try { parseDuration(bad); } catch (std::invalid_argument& e) { error = true; }
+			assert( error );
+		}
+
+		assert( parseRate("100MB/s") == 1e8 && parseRate("5K ops/s") == 5000 && parseRate("10/ms") == 10000 );
+		assert( parseRate("5000") == 5000 && parseRate("2.5 ops/s") == 2.5 && parseRate("1KiB/s") == 1024 );
+		assert( parseRate("60/m") == 1 && parseRate("1Mi / h") == 1048576 / 3600.0 );
+		for (const char* bad : {"", "/s", "1/x", "1 X/s", "1ops/s/s"}) {
+			bool error = false;
+			try { parseRate(bad); } catch (std::invalid_argument& e) { error = true; }
+			assert( error );
+		}
+
+		size_t before = allocations;
+		uint64_t total = 0;
+		for (int i = 0; i < 1000; i++)
+			total += parseSize("64 KiB") + parseDuration("1.5ms").count() + (uint64_t)parseRate("10MB/s");
+		assert( allocations == before && total == 1000 * (65536 + 1500000 + 10000000ULL) );
+	}
+
+	{ // format
+		char buffer[64];
+		assert( format("a={} b={} c={}", 1, -2L, 3UL) == "a=1 b=-2 c=3" );
+		assert( format("{} {} {}", true, 'x', std::string("str")) == "true x str" );
+		assert( format("{}|{}|{}", "cstr", std::string_view("view"), (const char*)nullptr) == "cstr|view|(null)" );
+		assert( format("{} {:.2f} {:.1e} {:g}", 0.5, 3.14159, 12345.0, 0.25) == "0.5 3.14 1.2e+04 0.25" );
+		assert( format("{:x} {{}} }}", 255) == "ff {} }" );
+		assert( format("{}", INT64_MIN) == "-9223372036854775808" && format("{}", UINT64_MAX) == "18446744073709551615" );
+		assert( format("{}", (int8_t)-5) == "-5" && format("{}", (uint16_t)7) == "7" );
+		assert( format("{}", (void*)0x1234) == "0x1234" );
+		assert( format("{:.2f}", 1e300).substr(0, 5) == "1e+30" );
+		assert( format("no placeholders") == "no placeholders" );
+		assert( format("{}", format_str("{}-{}", 1, 2)) == "1-2" );
+		assert( format("{}", 1).data()[1] == '\0' );
+
+		assert( format_to(buffer, sizeof(buffer), "{}+{}", 20, 22) == 5 && std::string(buffer) == "20+22" );
+		assert( format_to(buffer, 4, "{}", 123456) == 6 && std::string(buffer) == "123" ); // truncated
+		assert( format_to(nullptr, 0, "{}", 123456) == 6 );
+		std::string big(100000, 'y');
+		assert( format("[{}]", big) == "[" + big + "]" );
+
+		assert( ALUTILS_FORMAT("{} {}", 1, "a") == "1 a" );
+		assert( ALUTILS_FORMAT("none") == "none" );
+		assert( ALUTILS_FORMAT_TO(buffer, sizeof(buffer), "{{{}}}", 7) == 3 && std::string(buffer) == "{7}" );
+		static_assert( FormatChecker<int, int>::check("{} {{}} {:x} }}") == FORMAT_OK );
+		static_assert( FormatChecker<double>::check("{:.2f} {}") == FORMAT_COUNT );
+		static_assert( FormatChecker<double>::check("{:x}") == FORMAT_TYPE );
+		static_assert( FormatChecker<int>::check("{:.2}") == FORMAT_TYPE );
+		static_assert( FormatChecker<const char*>::check("{:f}") == FORMAT_TYPE );
+		static_assert( FormatChecker<int>::check("{:z}") == FORMAT_SPEC && FormatChecker<double>::check("{:.}") == FORMAT_SPEC );
+		static_assert( FormatChecker<int>::check("{} }") == FORMAT_SYNTAX && FormatChecker<int>::check("{") == FORMAT_SYNTAX );
+		static_assert( FormatChecker<std::string, std::string_view, char*, void*, bool, char, uint8_t, float>::check("{}{}{}{}{}{}{:x}{:e}") == FORMAT_OK );
+
+		// the result of one format() can be an argument of the next one
+		assert( format("x{}", format("abc{}", 1)) == "xabc1" );
+		assert( format("{} {}", format_str("q{}", 7), format("{}", 42)) == "q7 42" );
+		std::string long_arg(5000, 'z');
+		auto view = format("{}", long_arg);
+		assert( format("<{}>", view) == "<" + long_arg + ">" );                   // grows the buffer
+		assert( format("{}{}", format("{}", long_arg), long_arg) == long_arg + long_arg );
+		assert( sprintf_view("x%s", sprintf_view("abc%d", 1).data()) == "xabc1" );
+		assert( sprintf_view("<%s>", sprintf_view("%s", long_arg.c_str()).data()) == "<" + long_arg + ">" );
+
+		for (const char* bad : {"{} {}", "{", "}", "{:z}", "{:.}", "{:x}"}) {
+			bool error = false;
+			try { format(bad, 1.5); } catch (std::invalid_argument& e) { error = true; }
+			assert( error );
+		}
+		bool error = false;
+		try { format("{}", 1, 2); } catch (std::invalid_argument& e) { error = true; }
+		assert( error );
+
+		// the typical log line does not allocate memory once the buffers have grown
+		std::string name("sst_file_0001");
+		format("{} {} {:.3f} {}", 1, name, 0.5, -1L);
+		alutils::sprintf("%s", big.c_str());
+		size_t before = allocations;
+		for (int i = 0; i < 1000; i++) {
+			format("file={} level={} size={:.3f} ratio={} ok={}", name, i, i * 1.5, i / 7.0, i % 2 == 0);
+			format_to(buffer, sizeof(buffer), "{} {}", i, name);
+			print_discard("file=%s level=%d size=%.3f", name.c_str(), i, i * 1.5);
+			alutils::sprintf("level=%d", i); // fits in the std::string small buffer
+		}
+		assert( allocations == before );
+
+		const size_t n = 1000000;
+		auto start = std::chrono::steady_clock::now();
+		size_t total = 0;
+		for (size_t i = 0; i < n; i++)
+			total += format("key={} value={:.2f}", i, i * 0.5).size();
+		std::chrono::duration<double> t_format = std::chrono::steady_clock::now() - start;
+		start = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < n; i++)
+			total += sprintf("key=%lu value=%.2f", i, i * 0.5).size();
+		std::chrono::duration<double> t_sprintf = std::chrono::steady_clock::now() - start;
+		printf("format: %.1f ns/line, sprintf: %.1f ns/line (%lu)\n",
+		       t_format.count() * 1e9 / n, t_sprintf.count() * 1e9 / n, total);
 	}
 
 	{ // parse*Suffix
@@ -135,6 +301,216 @@ int main(int argc, char** argv) {
 		assert (!fail);
 		try {str="5.5s"; dv = parseDoubleSuffix(str.c_str(), dsuf); fail = true;} catch (std::exception& e) {printf("expected exception for \"%s\": %s\n", str.c_str(), e.what());}
 		assert (!fail);
+		try {str="1.5m"; u32v = parseUint32Suffix(str, u32suf); fail = true;} catch (std::exception& e) {printf("expected exception for \"%s\": %s\n", str.c_str(), e.what());}
+		assert (!fail);
+		try {str=".5K"; dv = parseDoubleSuffix(str, dsuf); fail = true;} catch (std::exception& e) {printf("expected exception for \"%s\": %s\n", str.c_str(), e.what());}
+		assert (!fail);
+		assert( parseDoubleSuffix("5.K", dsuf) == 5000 );
+	}
+
+	{ // parse benchmark: the former implementation (strip copy, regex validation, stoX) as reference
+		debug_parse = false;
+		auto old_parse_int64 = [](const std::string& value) -> int64_t {
+			auto value_strip = strip(value);
+			if (value_strip == "" || !std::regex_match(value_strip, std::regex("^-{0,1}[0-9]+$")))
+				throw std::invalid_argument("invalid");
+			return std::stoll(value_strip);
+		};
+		auto old_parse_double = [](const std::string& value) -> double {
+			auto value_strip = strip(value);
+			if (value_strip == "" || !std::regex_match(value_strip, std::regex("^-{0,1}([0-9]+\\.{0,1}[0-9]*|[0-9]*\\.[0-9]+)$")))
+				throw std::invalid_argument("invalid");
+			return std::stod(value_strip);
+		};
+		std::vector<std::string> ints, doubles;
+		for (int i = 0; i < 1000; i++) {
+			ints.push_back(" " + std::to_string(i * 7919 - 300000) + " ");
+			doubles.push_back(std::to_string(i * 0.37 - 100));
+		}
+		const int rounds = 100;
+		auto bench = [&](const std::vector<std::string>& values, auto f) {
+			double sum = 0;
+			auto t0 = std::chrono::steady_clock::now();
+			for (int r = 0; r < rounds; r++)
+				for (auto& v : values)
+					sum += f(v);
+			auto t1 = std::chrono::steady_clock::now();
+			assert( sum != 0.5 );
+			return std::chrono::duration<double, std::nano>(t1 - t0).count() / (rounds * values.size());
+		};
+		double t_old_i = bench(ints, old_parse_int64);
+		double t_new_i = bench(ints, [](const std::string& v) { return parseInt64(v); });
+		double t_old_d = bench(doubles, old_parse_double);
+		double t_new_d = bench(doubles, [](const std::string& v) { return parseDouble(v); });
+		for (auto& v : ints) assert( parseInt64(v) == old_parse_int64(v) );
+		for (auto& v : doubles) assert( parseDouble(v) == old_parse_double(v) );
+		printf("parseInt64: %.1f ns (regex + stoll: %.1f ns, %.0fx); parseDouble: %.1f ns (regex + stod: %.1f ns, %.0fx)\n",
+		       t_new_i, t_old_i, t_old_i / t_new_i, t_new_d, t_old_d, t_old_d / t_new_d);
+		assert( t_new_i < t_old_i && t_new_d < t_old_d );
+	}
+
+	{ // Tokenizer, split_columns and split_str
+		auto tokens = [](Tokenizer&& t) {
+			std::vector<std::string> ret;
+			for (auto token : t)
+				ret.emplace_back(token);
+			return vector_to_str(ret);
+		};
+		assert( tokens(Tokenizer("  a bb\tccc \n dddddddddd eeeeeeeeeeeeeeeeeee  f")) == "[\"a\", \"bb\", \"ccc\", \"dddddddddd\", \"eeeeeeeeeeeeeeeeeee\", \"f\"]" );
+		assert( tokens(Tokenizer("                        x                  ")) == "[\"x\"]" );
+		assert( tokens(Tokenizer(" \t\n ")) == "[]" && tokens(Tokenizer("")) == "[]" );
+		assert( tokens(Tokenizer(std::string_view("a\x01" "b c\x80\xff" "d e", 10))) == "[\"a\x01" "b\", \"c\x80\xff" "d\", \"e\"]" );
+		assert( tokens(Tokenizer("a,,b,", ',')) == "[\"a\", \"\", \"b\", \"\"]" );
+		assert( tokens(Tokenizer("", ',')) == "[\"\"]" );
+		assert( tokens(Tokenizer(" a , b ", ',', true)) == "[\"a\", \"b\"]" );
+		assert( tokens(Tokenizer("a::b:c::::d:", "::")) == "[\"a\", \"b:c\", \"\", \"d:\"]" );
+		assert( tokens(Tokenizer("abc", "")) == "[\"abc\"]" );
+		assert( tokens(Tokenizer("a:", "::")) == "[\"a:\"]" );
+
+		Tokenizer t("key=value=x", '=');
+		std::string_view token;
+		assert( t.next(token) && token == "key" && t.rest() == "value=x" );
+
+		std::string_view sv = "  abc \n";
+		assert( inplace_strip(sv) == "abc" && sv == "abc" );
+		std::string str = " abc ";
+		assert( inplace_strip(str) == "abc" );
+
+		std::vector<std::string> cols;
+		assert( split_columns(cols, "  sda  1.0 2.0\n  sdb 3 4") == 6 && cols[5] == "4" );
+		assert( split_columns(cols, "cpu0 1 2\ncpu1 3 4", "cpu1") == 2 && vector_to_str(cols) == "[\"3\", \"4\"]" );
+		assert( split_columns(cols, "cpu0 1 2 3 4\ncpu1 5", "cpu[0-9]") == 4 );
+		assert( split_columns(cols, "cpu0", "cpu0") == 0 && cols.size() == 0 );
+		assert( vector_to_str(split_str("a::b", "::")) == "[\"a\", \"b\"]" );
+
+		// former implementations, as reference
+		auto old_split_columns = [](std::vector<std::string>& ret, const char* str) {
+			std::cmatch cm;
+			ret.clear();
+			for (const char* i = str;;) {
+				std::regex_search(i, cm, std::regex("([^\\s]+)\\s*(.*)"), std::regex_constants::match_any);
+				if (cm.size() >= 3) {
+					ret.push_back(cm[1].str());
+					i = cm[2].first;
+				} else {
+					break;
+				}
+			}
+			return (int)ret.size();
+		};
+		std::string iostat;
+		for (int i = 0; i < 50; i++)
+			iostat += sprintf("nvme%dn1          %8.2f   %8.2f %10.2f  %10.2f    %6.2f   %6.2f    %5.2f\n", i, i * 1.5, i * 2.25, i * 100.0, i * 200.0, 0.5, 1.5, i * 0.1);
+		std::vector<std::string> cols_old;
+		auto t0 = std::chrono::steady_clock::now();
+		old_split_columns(cols_old, iostat.c_str());
+		auto t1 = std::chrono::steady_clock::now();
+		const int rounds = 100;
+		for (int i = 0; i < rounds; i++)
+			split_columns(cols, iostat.c_str());
+		auto t2 = std::chrono::steady_clock::now();
+		assert( cols == cols_old && cols.size() == 50 * 8 );
+		printf("split_columns of %lu bytes: %.1f us (regex: %.1f us)\n", iostat.size(),
+		       std::chrono::duration<double, std::micro>(t2 - t1).count() / rounds,
+		       std::chrono::duration<double, std::micro>(t1 - t0).count());
+	}
+
+	{ // ColumnParser
+		typedef ColumnParser CP;
+		CP p({CP::STRING, CP::INT64, CP::DOUBLE, CP::SKIP});
+		std::string text =
+			"Device  ops  util  x\n"          // header: not numbers
+			"\n"
+			"sda 10 1.5 a\n"
+			"  sdb\t-20   2.25  b  \r\n"
+			"sdc 30\n"                         // fewer fields
+			"sdd 40 4 d e\n"                   // more fields
+			"sde 1.5 5 e\n"                    // not an int64
+			"sdf 60 6 f";                       // incomplete
+		size_t n = p.parse(text);
+		assert( text.substr(n) == "sdf 60 6 f" );
+		assert( p.getRows() == 2 && p.getSkipped() == 4 && p.getColumns() == 4 );
+		assert( p.getString(0)[0] == "sda" && p.getString(0)[1] == "sdb" );
+		assert( p.getInt64(1)[0] == 10 && p.getInt64(1)[1] == -20 );
+		assert( p.getDouble(2)[0] == 1.5 && p.getDouble(2)[1] == 2.25 );
+		assert( p.parse(std::string_view(text).substr(n), true) == text.size() - n );
+		assert( p.getRows() == 3 && p.getString(0)[2] == "sdf" && p.getDouble(2)[2] == 6 );
+		bool error = false;
+		try { p.getDouble(1); } catch (std::invalid_argument& e) { error = true; }
+		assert( error );
+		p.clear();
+		assert( p.getRows() == 0 && p.getInt64(1).empty() );
+
+		// last field ending at a chunk size multiple of 64, without '\n'
+		std::string line64 = "a 1 2.5 " + std::string(64 - 8, 'x');
+		assert( line64.size() == 64 && p.parse(line64) == 0 && p.getRows() == 0 );
+		assert( p.parse(line64, true) == 64 && p.getRows() == 1 && p.getDouble(2)[0] == 2.5 );
+
+		// against split_columns + parse*, with random spacing and chunk splits
+		p.clear();
+		std::string random_text;
+		uint64_t x = 88172645463325252ULL;
+		auto rnd = [&x]() { x ^= x << 13; x ^= x >> 7; x ^= x << 17; return x; };
+		for (int i = 0; i < 20000; i++) {
+			int fields = rnd() % 10 == 0 ? rnd() % 6 : 4;
+			for (int f = 0; f < fields; f++) {
+				random_text.append(rnd() % 4, " \t"[rnd() % 2]);
+				switch (rnd() % 8) {
+					case 0:  random_text += "name" + std::to_string(rnd() % 1000); break;
+					case 1:  random_text += sprintf("%.3f", (double)(rnd() % 100000) / 7); break;
+					default: random_text += std::to_string((int64_t)(rnd() % 2000000) - 1000000); break;
+				}
+				random_text += ' ';
+			}
+			random_text += rnd() % 3 ? "\n" : " \n";
+		}
+		size_t expected_rows = 0;
+		std::vector<std::string> expected_names;
+		std::vector<int64_t> expected_ints;
+		std::vector<double> expected_doubles;
+		for (auto line : Tokenizer(random_text, '\n')) {
+			std::vector<std::string> c;
+			split_columns(c, std::string(line).c_str());
+			if (c.size() != 4) continue;
+			try {
+				int64_t i = parseInt64(c[1]);
+				double d = parseDouble(c[2]);
+				expected_names.push_back(c[0]); expected_ints.push_back(i); expected_doubles.push_back(d);
+				expected_rows++;
+			} catch (std::invalid_argument& e) {}
+		}
+		for (size_t pos = 0; pos < random_text.size();) { // chunks as read from a pipe
+			size_t size = std::min<size_t>(1 + rnd() % 5000, random_text.size() - pos);
+			pos += p.parse(std::string_view(random_text).substr(pos, size), pos + size == random_text.size());
+		}
+		assert( p.getRows() == expected_rows && expected_rows > 1000 );
+		for (size_t i = 0; i < expected_rows; i++)
+			assert( p.getString(0)[i] == expected_names[i] && p.getInt64(1)[i] == expected_ints[i] && p.getDouble(2)[i] == expected_doubles[i] );
+
+		// throughput on iostat output
+		std::string iostat;
+		for (int i = 0; i < 50; i++)
+			iostat += sprintf("nvme%dn1          %8.2f   %8.2f %10.2f  %10.2f    %6.2f   %6.2f    %5.2f\n", i, i * 1.5, i * 2.25, i * 100.0, i * 200.0, 0.5, 1.5, i * 0.1);
+		std::vector<std::string> cols;
+		CP iostat_parser({CP::STRING, CP::DOUBLE, CP::DOUBLE, CP::DOUBLE, CP::DOUBLE, CP::DOUBLE, CP::DOUBLE, CP::DOUBLE});
+		std::string big;
+		while (big.size() < 64 * 1024 * 1024)
+			big += iostat;
+		auto start = std::chrono::steady_clock::now();
+		assert( iostat_parser.parse(big) == big.size() );
+		std::chrono::duration<double> t_parser = std::chrono::steady_clock::now() - start;
+		assert( iostat_parser.getRows() == big.size() / iostat.size() * 50 );
+		start = std::chrono::steady_clock::now();
+		double sum = 0;
+		const size_t reference_size = 4 * 1024 * 1024;
+		for (auto line : Tokenizer(std::string_view(big).substr(0, reference_size), '\n')) {
+			split_columns(cols, std::string(line).c_str());
+			for (size_t c = 1; c < cols.size(); c++)
+				sum += parseDouble(cols[c]);
+		}
+		std::chrono::duration<double> t_reference = std::chrono::steady_clock::now() - start;
+		printf("ColumnParser: %.0f MB/s (split_columns + parseDouble: %.0f MB/s) %.0f\n",
+		       big.size() / t_parser.count() / 1e6, reference_size / t_reference.count() / 1e6, sum);
 	}
 
 	{
@@ -166,6 +542,138 @@ int main(int argc, char** argv) {
 		}
 	}
 
+	{ // Pattern, PatternCache and PrefixNumberMatcher
+		auto log_level_ = log_level;
+		log_level = LOG_ERROR;
+
+		Pattern pattern("read_bytes: ([0-9]+)");
+		std::string dest;
+		ParseRE r("x read_bytes: 4096 y", pattern, dest);
+		assert( r.valid && r.value == "4096" && dest == "4096" && r.sm.size() == 2 );
+		assert( !ParseRE("read_bytes: none", pattern).valid );
+
+		PatternCache cache(2);
+		auto a = cache.get("a+");
+		assert( cache.get("a+") == a && cache.getHits() == 1 && cache.getMisses() == 1 );
+		cache.get("b+");
+		cache.get("a+");                   // a+ is the most recent
+		cache.get("c+");                   // evicts b+
+		assert( cache.size() == 2 && cache.getMisses() == 3 );
+		assert( cache.get("a+") == a && cache.getMisses() == 3 );
+		cache.get("b+");
+		assert( cache.getMisses() == 4 );
+		cache.setCapacity(1);
+		assert( cache.size() == 1 );
+		assert( std::regex_search("aaa", a->regex()) ); // valid after eviction
+		bool error = false;
+		try { PatternCache bad(0); } catch (std::invalid_argument& e) { error = true; }
+		assert( error );
+
+		pattern_cache.clear();
+		for (int i = 0; i < 10; i++)
+			assert( ParseRE("test " + std::to_string(i), "([0-9]+)").value == std::to_string(i) );
+		assert( pattern_cache.getMisses() == 1 && pattern_cache.getHits() == 9 );
+
+		{ // concurrent gets of the same patterns
+			std::vector<std::thread> threads;
+			for (int t = 0; t < 4; t++)
+				threads.emplace_back([t]{
+					for (int i = 0; i < 1000; i++)
+						assert( ParseRE("v=" + std::to_string(i), "v=([0-9]+)").value == std::to_string(i) );
+				});
+			for (auto& t : threads) t.join();
+			assert( pattern_cache.get("v=([0-9]+)") == pattern_cache.get("v=([0-9]+)") );
+		}
+
+		PrefixNumberMatcher mem("MemFree:");
+		std::string_view number;
+		uint64_t u64;
+		int32_t i32;
+		double d;
+		assert( mem.match("MemFree:        1234567 kB", number) && number == "1234567" );
+		assert( mem.match("MemFree:        1234567 kB", u64) && u64 == 1234567 );
+		assert( !mem.match("MemTotal: 1 kB", number) && !mem.match("MemFree: kB", number) );
+		assert( mem.match("MemFree: x MemFree: 5", i32) && i32 == 5 );  // first occurrence with a number
+		assert( mem.match("MemFree:-3.25s", d) && d == -3.25 );
+		assert( mem.match("MemFree:-3.", number) && number == "-3" );
+		assert( mem.match("MemFree:-3", i32) && i32 == -3 && !mem.match("MemFree:-3", u64) );
+		assert( !mem.match("MemFree: 99999999999", i32) );              // does not fit
+		assert( PrefixNumberMatcher("").match("abc 42", number) && number == "42" );
+
+		// the same in a loop over process output lines
+		std::vector<std::string> lines;
+		for (int i = 0; i < 1000; i++)
+			lines.push_back("nvme0n1 read_bytes: " + std::to_string(i * 4096) + " write_bytes: 0");
+		const int rounds = 20;
+		uint64_t total[4] = {0, 0, 0, 0};
+		auto start = std::chrono::steady_clock::now();
+		for (int j = 0; j < 2; j++) for (auto& l : lines)
+			total[0] += parseUint64(ParseRE(l, Pattern("read_bytes: ([0-9]+)")).value); // compiled per line, as before
+		std::chrono::duration<double> t_uncached = std::chrono::steady_clock::now() - start;
+		start = std::chrono::steady_clock::now();
+		for (int j = 0; j < rounds; j++) for (auto& l : lines)
+			total[1] += parseUint64(ParseRE(l, "read_bytes: ([0-9]+)").value);
+		std::chrono::duration<double> t_cached = std::chrono::steady_clock::now() - start;
+		start = std::chrono::steady_clock::now();
+		for (int j = 0; j < rounds; j++) for (auto& l : lines)
+			total[2] += parseUint64(ParseRE(l, pattern).value);
+		std::chrono::duration<double> t_pattern = std::chrono::steady_clock::now() - start;
+		PrefixNumberMatcher read_bytes("read_bytes:");
+		start = std::chrono::steady_clock::now();
+		for (int j = 0; j < rounds; j++) for (auto& l : lines)
+			if (read_bytes.match(l, u64)) total[3] += u64;
+		std::chrono::duration<double> t_matcher = std::chrono::steady_clock::now() - start;
+		assert( total[1] == total[2] && total[2] == total[3] && total[0] * rounds == total[1] * 2 );
+		printf("ParseRE per line: compiling %.1f us, cached %.1f us, Pattern %.1f us, PrefixNumberMatcher %.3f us\n",
+		       t_uncached.count() * 1e6 / (2 * lines.size()), t_cached.count() * 1e6 / (rounds * lines.size()),
+		       t_pattern.count() * 1e6 / (rounds * lines.size()), t_matcher.count() * 1e6 / (rounds * lines.size()));
+
+		log_level = log_level_;
+	}
+
+	{ // KeyFormatter
+		assert( fnv1a64(12345) == 16653943660658674764ULL );
+
+		KeyFormatter user("user", 12);
+		char buffer[64];
+		uint64_t values[] = {0, 1, 9, 10, 99, 100, 12345, 999999999999ULL, 1000000000000ULL, UINT64_MAX};
+		for (auto v : values) {
+			assert( user.format_view(v, buffer) == sprintf("user%012lu", v) );
+			assert( user.str(v) == sprintf("user%012lu", v) );
+			assert( KeyFormatter().str(v) == std::to_string(v) );
+		}
+		assert( KeyFormatter("k", 3, KeyFormatter::DECIMAL, true).str(12345) == "k16653943660658674764" );
+
+		KeyFormatter binary("b", 4, KeyFormatter::BINARY);
+		assert( binary.maxSize() == 5 );
+		assert( binary.str(0x01020304) == std::string("b\x01\x02\x03\x04", 5) );
+		assert( binary.str(100) < binary.str(256) && binary.str(256) < binary.str(70000) );
+		assert( KeyFormatter("", 0, KeyFormatter::BINARY).str(1) == std::string("\0\0\0\0\0\0\0\1", 8) );
+
+		bool error = false;
+		try { KeyFormatter bad("", 9, KeyFormatter::BINARY); } catch (std::invalid_argument& e) { error = true; }
+		assert( error );
+
+		const size_t n = 1000000;
+		std::vector<int64_t> keys(n);
+		for (size_t i = 0; i < n; i++)
+			keys[i] = (int64_t)((i * 0x9e3779b97f4a7c15ULL) >> 24);
+		std::vector<char> arena(n * user.maxSize());
+		std::vector<std::string_view> views(n);
+		auto start = std::chrono::steady_clock::now();
+		user.format_batch(keys.data(), n, arena.data(), views.data());
+		std::chrono::duration<double> t_batch = std::chrono::steady_clock::now() - start;
+		start = std::chrono::steady_clock::now();
+		size_t total = 0;
+		for (size_t i = 0; i < n; i++)
+			total += sprintf("user%012ld", keys[i]).size();
+		std::chrono::duration<double> t_sprintf = std::chrono::steady_clock::now() - start;
+		for (size_t i = 0; i < n; i += 997)
+			assert( views[i] == sprintf("user%012ld", keys[i]) );
+		printf("KeyFormatter::format_batch: %.1f ns/key, sprintf: %.1f ns/key (%lu)\n",
+		       t_batch.count() * 1e9 / n, t_sprintf.count() * 1e9 / n, total);
+	}
+
 	printf("OK!!\n");
 	return 0;
 }